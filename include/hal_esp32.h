@@ -0,0 +1,160 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+#include "config_store.h"
+#include "hal.h"
+#include "spsc_ring.h"
+
+// ESP32 implementations of the HAL interfaces in lib/PoiCore/src/hal.h
+
+// I2C through the Arduino Wire library
+class WireI2cBus : public I2cBus {
+public:
+  explicit WireI2cBus(TwoWire& wire) : wire(wire) {}
+  void begin(uint32_t clockHz);
+  bool writeRegister(uint8_t address, uint8_t reg, uint8_t value) override;
+  bool readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t len) override;
+
+private:
+  TwoWire& wire;
+};
+
+class ArduinoClock : public Clock {
+public:
+  uint32_t millis() override { return ::millis(); }
+};
+
+class GpioLed : public StatusLed {
+public:
+  GpioLed(uint8_t pin, bool activeLow) : pin(pin), activeLow(activeLow) {}
+  void begin();
+  void set(bool on) override;
+
+private:
+  uint8_t pin;
+  bool activeLow;
+};
+
+// TcpConnection on top of AsyncTCP. Callbacks run on the async_tcp task;
+// received bytes are handed to the polling task through a lock-free ring.
+class AsyncTcpConnection : public TcpConnection {
+public:
+  AsyncTcpConnection();
+  bool connect(const char* host, uint16_t port) override;
+  bool send(const char* data, size_t len) override;
+  size_t receive(char* data, size_t max) override;
+  void close() override;
+  TcpState state() override { return (TcpState)tcpState.load(); }
+
+private:
+  static void handleConnect(void* arg, AsyncClient* client);
+  static void handleData(void* arg, AsyncClient* client, void* data, size_t len);
+  static void handleDisconnect(void* arg, AsyncClient* client);
+  static void handleError(void* arg, AsyncClient* client, int8_t error);
+
+  AsyncClient client;
+  std::atomic<uint8_t> tcpState;
+  SpscRing<char, 1024> rx;
+  std::atomic<bool> overflowed;  // rx was full: the response is incomplete, drop it
+  portMUX_TYPE mux;
+  char pending[256];  // queued by send() until the connection is up
+  size_t pendingLen;
+};
+
+// Blocking HTTPClient requests, with the body streamed to the sink rather
+// than buffered. Keeps one keep-alive WiFiClient per host so repeated
+// requests to a poi skip the TCP handshake.
+class Esp32HttpTransport : public HttpTransport {
+public:
+  int get(const char* host, uint16_t port, const char* path, uint32_t timeoutMs,
+          HttpBodySink* body) override;
+
+private:
+  struct CachedClient {
+    const char* host = NULL;
+    WiFiClient client;
+  };
+  WiFiClient& clientFor(const char* host);
+
+  CachedClient clients[4];
+  uint8_t nextSlot = 0;
+};
+
+// Non-blocking UDP through WiFiUDP
+class WifiUdpSocket : public UdpSocket {
+public:
+  bool begin(uint16_t localPort) override { return udp.begin(localPort); }
+  bool sendTo(const char* host, uint16_t port, const uint8_t* data, size_t len) override;
+  size_t receive(uint8_t* data, size_t max, char* fromHost, uint16_t* fromPort) override;
+
+private:
+  WiFiUDP udp;
+};
+
+// FileStore on the LittleFS partition (mounted by initLittleFS()). Writes
+// go to a temporary file that is renamed over the original.
+class LittleFsStore : public FileStore {
+public:
+  int read(const char* path, uint8_t* data, size_t max) override;
+  bool write(const char* path, const uint8_t* data, size_t len) override;
+  bool append(const char* path, const uint8_t* data, size_t len) override;
+  int readAt(const char* path, uint32_t offset, uint8_t* data, size_t max) override;
+  int32_t size(const char* path) override;
+  bool remove(const char* path) override;
+};
+
+// WifiDriver on the Arduino WiFi library. Events arrive on the WiFi event
+// task and reach the main loop through an atomic bit set.
+class Esp32WifiDriver : public WifiDriver {
+public:
+  // Register for WiFi events; call once before the first connect()
+  void begin();
+
+  void connect(const char* ssid, const char* password, const uint8_t* bssid, uint8_t channel,
+               const WiFiLastConnection* lease) override;
+  void disconnect() override;
+  bool startScan() override;
+  int scanResults(WifiScanResult* results, int max) override;
+  void connection(WiFiLastConnection& last) override;
+  uint8_t takeEvents() override { return events.exchange(0); }
+
+private:
+  std::atomic<uint8_t> events{0};
+};
+
+// CPU clock, WiFi power save and light sleep for each PowerLevel. Light
+// sleep needs power management and tickless idle in the SDK config;
+// without them POWER_SLEEP only slows the CPU and the radio.
+class Esp32PowerControl : public PowerControl {
+public:
+  // Optional: the MPU-6050 INT pin. Motion raised there wakes the chip
+  // from light sleep and notifies task at once instead of at its next poll.
+  void attachWakePin(int pin, TaskHandle_t task);
+
+  void setLevel(PowerLevel level) override;
+  void setRadioAwake(bool awake) override;
+
+private:
+  static void IRAM_ATTR wakeInterrupt(void* task);
+  void applyRadio();
+
+  PowerLevel level = POWER_ACTIVE;
+  bool radioAwake = false;
+};
+
+// Telemetry frames to every client of an AsyncWebSocket
+class WebSocketSink : public TelemetrySink {
+public:
+  explicit WebSocketSink(AsyncWebSocket& socket) : socket(socket) {}
+  bool active() override { return socket.count() > 0; }
+  bool trySend(const uint8_t* data, size_t len) override;
+
+private:
+  AsyncWebSocket& socket;
+};
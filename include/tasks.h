@@ -2,23 +2,13 @@
 
 #include <Arduino.h>
 #include "secrets.h"
+#include "config_store.h"
 
 // FreeRTOS task handles
 extern TaskHandle_t elegantOTATaskHandle;
-
-// WiFi configuration structure
-struct WiFiConfig {
-  char ssid[32];
-  char password[64];
-  bool enabled;
-};
-
-// WiFi settings structure for LittleFS storage
-struct WiFiSettings {
-  WiFiConfig networks[3];  // Up to 3 configurable networks
-  bool fallbackEnabled;    // Use secrets.h fallback
-  uint8_t currentNetwork;  // Currently selected network index
-};
+extern TaskHandle_t sensorTaskHandle;
+extern TaskHandle_t patternRefreshTaskHandle;
+extern TaskHandle_t sessionLogTaskHandle;
 
 // Global settings
 extern WiFiSettings wifiSettings;
@@ -32,17 +22,19 @@ extern IPAddress netMask;
 
 // Task declarations
 void elegantOTATask(void *parameter);
+void sensorTask(void *parameter);
+void patternRefreshTask(void *parameter);
+void sessionLogTask(void *parameter);
 
 // WiFi management functions
-bool initWiFi();
-bool connectToWiFi(const char* ssid, const char* password);
 void startCaptivePortal();
 void stopCaptivePortal();
-void saveWiFiSettings();
-bool loadWiFiSettings();
 void resetWiFiSettings();
 
+// Config in LittleFS: WiFi settings and detector parameters. Only the
+// loop task saves; web handlers call requestConfigSave() in main.cpp.
+bool loadConfig();
+void saveConfig();
+
 // LittleFS helpers
 bool initLittleFS();
-String readFile(const char* path);
-bool writeFile(const char* path, const String& content);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A page from data/, gzipped at build time by scripts/embed_web_assets.py
+// into src/web_assets.cpp. The bytes are const, so they stay in flash and
+// are sent from there without a heap copy.
+struct WebAsset {
+  const char* path;         // e.g. "/index.html"
+  const char* contentType;
+  const uint8_t* gzipped;
+  size_t length;
+  const char* etag;         // quoted, changes whenever the page does
+};
+
+extern const WebAsset webAssets[];
+extern const size_t webAssetCount;
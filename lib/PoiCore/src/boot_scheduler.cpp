@@ -0,0 +1,100 @@
+#include "boot_scheduler.h"
+
+#include <string.h>
+
+BootScheduler::BootScheduler(Clock& clock)
+  : clock(clock),
+    stageCount(0),
+    finishedMask(0),
+    pending(0),
+    finishTime(0) {
+  memset(stages, 0, sizeof(stages));
+}
+
+int BootScheduler::add(const char* name, BootStepFunction step, void* context, uint32_t after,
+                       uint32_t delayMs, uint8_t retries, uint32_t retryMs) {
+  if (stageCount >= BOOT_MAX_STAGES) {
+    return -1;
+  }
+  Stage& stage = stages[stageCount];
+  stage.name = name;
+  stage.step = step;
+  stage.context = context;
+  stage.after = after;
+  stage.delayMs = delayMs;
+  stage.retries = retries;
+  stage.retryMs = retryMs;
+  stage.state = BOOT_WAITING;
+  pending++;
+  finishTime = 0;
+  return stageCount++;
+}
+
+const char* BootScheduler::stateName(BootStageState state) {
+  switch (state) {
+    case BOOT_WAITING: return "waiting";
+    case BOOT_RUNNING: return "running";
+    case BOOT_RETRYING: return "retrying";
+    case BOOT_DONE: return "done";
+    case BOOT_FAILED: return "failed";
+    default: return "unknown";
+  }
+}
+
+bool BootScheduler::poll() {
+  for (int i = 0; i < stageCount; i++) {
+    Stage& stage = stages[i];
+    uint32_t now = clock.millis();
+
+    if (stage.state == BOOT_WAITING) {
+      if ((stage.after & ~finishedMask) != 0) {
+        continue;
+      }
+      // Dependencies just finished: start the clock on the start delay
+      stage.state = BOOT_RETRYING;
+      stage.readyAt = now + stage.delayMs;
+    }
+    if (stage.state == BOOT_RETRYING) {
+      if ((int32_t)(now - stage.readyAt) < 0) {
+        continue;
+      }
+      if (stage.attempts == 0) {
+        stage.start = now;
+      }
+      stage.attempts++;
+      stage.state = BOOT_RUNNING;
+    }
+    if (stage.state != BOOT_RUNNING) {
+      continue;
+    }
+
+    BootStep result = stage.step(stage.context);
+    uint32_t after = clock.millis();
+    stage.steps++;
+    if (after - now > stage.longestStep) {
+      stage.longestStep = after - now;
+    }
+
+    if (result == BOOT_STEP_DONE) {
+      finish(i, BOOT_DONE, after);
+    } else if (result == BOOT_STEP_FAILED) {
+      if (stage.attempts <= stage.retries) {
+        stage.state = BOOT_RETRYING;
+        stage.readyAt = after + stage.retryMs;
+      } else {
+        finish(i, BOOT_FAILED, after);
+      }
+    }
+  }
+  return finished();
+}
+
+void BootScheduler::finish(int index, BootStageState state, uint32_t now) {
+  Stage& stage = stages[index];
+  stage.state = state;
+  stage.end = now;
+  finishedMask |= BOOT_AFTER(index);
+  if (--pending == 0) {
+    finishTime = now;
+  }
+}
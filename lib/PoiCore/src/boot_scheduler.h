@@ -0,0 +1,91 @@
+#pragma once
+
+#include "hal.h"
+
+#define BOOT_MAX_STAGES 16
+#define BOOT_AFTER(stage) (1u << (stage))  // dependency mask for add()
+
+enum BootStageState : uint8_t {
+  BOOT_WAITING,   // for the stages it runs after, or its start delay
+  BOOT_RUNNING,   // stepped on every poll() until it finishes
+  BOOT_RETRYING,  // failed, next attempt after retryMs
+  BOOT_DONE,
+  BOOT_FAILED,    // out of attempts
+};
+
+// What one call of a stage's step function came to
+enum BootStep : uint8_t {
+  BOOT_STEP_DONE,
+  BOOT_STEP_PENDING,  // call again on the next poll()
+  BOOT_STEP_FAILED,
+};
+
+typedef BootStep (*BootStepFunction)(void* context);
+
+// Runs the firmware's start-up as stages polled from the main loop, each
+// one as soon as the stages it depends on have finished. A stage's step
+// function must not block; one that waits on hardware or the network
+// returns BOOT_STEP_PENDING and is called again on the next poll(), so
+// independent stages (sensor bring-up, WiFi, flash) make progress side by
+// side. A failed stage still counts as finished for the stages after it;
+// they run on defaults, and the report shows what failed.
+//
+// Every stage's start and end time (Clock::millis(), so time since power
+// on on the ESP32) and attempt count is kept for the boot report.
+class BootScheduler {
+public:
+  explicit BootScheduler(Clock& clock);
+
+  // Add a stage that starts delayMs after every stage in the after mask
+  // (BOOT_AFTER(a) | BOOT_AFTER(b)) has finished. A failed step is tried
+  // again after retryMs, up to retries more times. Returns the stage
+  // number, or -1 when BOOT_MAX_STAGES are in use.
+  int add(const char* name, BootStepFunction step, void* context, uint32_t after = 0,
+          uint32_t delayMs = 0, uint8_t retries = 0, uint32_t retryMs = 0);
+
+  // Step every stage that is due. Returns true once all have finished.
+  bool poll();
+
+  bool finished() const { return pending == 0; }
+  bool done(int stage) const { return stages[stage].state == BOOT_DONE; }
+  // Time the last stage finished, 0 while some are still pending
+  uint32_t finishedAt() const { return finishTime; }
+
+  int count() const { return stageCount; }
+  const char* name(int stage) const { return stages[stage].name; }
+  BootStageState state(int stage) const { return stages[stage].state; }
+  static const char* stateName(BootStageState state);
+  uint32_t startedAt(int stage) const { return stages[stage].start; }   // first step
+  uint32_t endedAt(int stage) const { return stages[stage].end; }       // 0 until finished
+  uint8_t attempts(int stage) const { return stages[stage].attempts; }
+  uint32_t steps(int stage) const { return stages[stage].steps; }
+  // Longest single call of the step function, to find stages that block
+  uint32_t longestStep(int stage) const { return stages[stage].longestStep; }
+
+private:
+  struct Stage {
+    const char* name;
+    BootStepFunction step;
+    void* context;
+    uint32_t after;
+    uint32_t delayMs;
+    uint32_t retryMs;
+    uint8_t retries;
+    BootStageState state;
+    uint8_t attempts;
+    uint32_t readyAt;  // dependencies finished, or last attempt failed
+    uint32_t start;
+    uint32_t end;
+    uint32_t steps;
+    uint32_t longestStep;
+  };
+
+  void finish(int stage, BootStageState state, uint32_t now);
+
+  Clock& clock;
+  Stage stages[BOOT_MAX_STAGES];
+  int stageCount;
+  uint32_t finishedMask;
+  int pending;
+  uint32_t finishTime;
+};
@@ -0,0 +1,160 @@
+#include "clock_sync.h"
+
+#include <string.h>
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ============================================================================
+// PoiClock
+// ============================================================================
+
+size_t PoiClock::answer(const uint8_t* data, size_t len, uint32_t receivedAt, uint32_t now, uint8_t* reply) {
+  if (len < CLOCK_SYNC_REQUEST_SIZE || data[0] != 'S' || data[1] != 'Y' || data[2] != CLOCK_SYNC_REQUEST) {
+    return 0;
+  }
+  if (data[13]) {
+    offset = (int32_t)get32(data + 9);
+    valid = true;
+  }
+  reply[0] = 'S';
+  reply[1] = 'Y';
+  reply[2] = CLOCK_SYNC_REPLY;
+  memcpy(reply + 3, data + 3, 6);  // seq and t0
+  put32(reply + 9, receivedAt);
+  put32(reply + 13, now);
+  return CLOCK_SYNC_REPLY_SIZE;
+}
+
+uint32_t PoiClock::switchTime(const SwitchCommand& command, uint32_t now) const {
+  if (!command.scheduled || !valid) return now;
+  uint32_t due = toLocal(command.switchAt);
+  // Already past (a late repeat), or nonsense from a stale offset
+  int32_t ahead = (int32_t)(due - now);
+  if (ahead <= 0 || ahead > SWITCH_MAX_LEAD_MS) return now;
+  return due;
+}
+
+// ============================================================================
+// ClockSync
+// ============================================================================
+
+ClockSync::ClockSync(UdpSocket& socket, Clock& clock, const PoiRegistry& registry,
+                     uint32_t intervalMs, uint32_t fastIntervalMs)
+  : socket(socket),
+    clock(clock),
+    registry(registry),
+    intervalMs(intervalMs),
+    fastIntervalMs(fastIntervalMs),
+    started(false),
+    seq(0),
+    requests(0),
+    replies(0) {
+  memset(peers, 0, sizeof(peers));
+}
+
+bool ClockSync::begin() {
+  started = socket.begin(0);
+  if (!started) {
+    poiLog("Clock sync socket failed to open\n");
+  }
+  return started;
+}
+
+void ClockSync::ping(int i, uint32_t now) {
+  Peer& peer = peers[i];
+  uint8_t data[CLOCK_SYNC_REQUEST_SIZE];
+  data[0] = 'S';
+  data[1] = 'Y';
+  data[2] = CLOCK_SYNC_REQUEST;
+  put16(data + 3, ++seq);
+  put32(data + 5, now);
+  put32(data + 9, (uint32_t)peer.offset);
+  data[13] = synced(i);
+
+  // An unanswered ping is simply superseded
+  peer.pendingSeq = seq;
+  peer.pending = true;
+  peer.lastPing = now;
+  requests++;
+  socket.sendTo(registry.host(i), CLOCK_SYNC_PORT, data, sizeof(data));
+}
+
+void ClockSync::estimate(Peer& peer) {
+  const Sample* best = &peer.samples[0];
+  int32_t lowest = best->offset;
+  int32_t highest = best->offset;
+  for (int k = 1; k < peer.sampleCount; k++) {
+    const Sample& s = peer.samples[k];
+    if (s.delay < best->delay) best = &s;
+    if (s.offset < lowest) lowest = s.offset;
+    if (s.offset > highest) highest = s.offset;
+  }
+  peer.offset = best->offset;
+  peer.roundTrip = best->delay;
+  peer.jitter = (uint32_t)(highest - lowest);
+}
+
+void ClockSync::handleReply(const uint8_t* data, size_t len, uint32_t now) {
+  if (len < CLOCK_SYNC_REPLY_SIZE || data[0] != 'S' || data[1] != 'Y' || data[2] != CLOCK_SYNC_REPLY) {
+    return;
+  }
+  uint16_t replySeq = get16(data + 3);
+  int n = registry.count();
+  for (int i = 0; i < n; i++) {
+    Peer& peer = peers[i];
+    if (!peer.pending || peer.pendingSeq != replySeq) continue;
+    peer.pending = false;
+    replies++;
+
+    uint32_t t0 = get32(data + 5);
+    uint32_t t1 = get32(data + 9);
+    uint32_t t2 = get32(data + 13);
+    Sample& s = peer.samples[peer.next];
+    // Differences first so the sum is immune to wraparound
+    s.offset = (int32_t)(((int64_t)(int32_t)(t1 - t0) + (int32_t)(t2 - now)) / 2);
+    s.delay = (now - t0) - (t2 - t1);
+    peer.next = (peer.next + 1) % CLOCK_SYNC_SAMPLES;
+    if (peer.sampleCount < CLOCK_SYNC_SAMPLES) peer.sampleCount++;
+    estimate(peer);
+    return;
+  }
+}
+
+void ClockSync::poll() {
+  if (!started) return;
+  uint32_t now = clock.millis();
+
+  int n = registry.count();
+  for (int i = 0; i < n; i++) {
+    if (!registry.online(i) || !(registry.features(i) & POI_FEATURE_CLOCK_SYNC)) continue;
+    uint32_t interval = synced(i) ? intervalMs : fastIntervalMs;
+    if (peers[i].lastPing == 0 || now - peers[i].lastPing >= interval) {
+      ping(i, now);
+    }
+  }
+
+  uint8_t data[32];
+  char from[POI_HOST_LEN];
+  size_t len;
+  while ((len = socket.receive(data, sizeof(data), from, NULL)) > 0) {
+    handleReply(data, len, clock.millis());
+  }
+}
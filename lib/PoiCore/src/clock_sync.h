@@ -0,0 +1,102 @@
+#pragma once
+
+#include "hal.h"
+#include "multicast_switcher.h"
+#include "poi_registry.h"
+
+#define CLOCK_SYNC_PORT SWITCH_PORT    // same socket on the poi as switch commands
+#define CLOCK_SYNC_INTERVAL_MS 2000    // ping each synced poi this often
+#define CLOCK_SYNC_FAST_INTERVAL_MS 250  // and unsynced ones this often
+#define CLOCK_SYNC_SAMPLES 16          // offset filter window
+#define CLOCK_SYNC_MIN_SAMPLES 3       // before a poi counts as synced
+
+// NTP-style ping exchange, little-endian:
+//   request 'S' 'Y' 0x01 seq(u16) t0(u32) offset(i32) offsetValid(u8)
+//   reply   'S' 'Y' 0x02 seq(u16) t0(u32) t1(u32) t2(u32)
+// t0 is the controller's send time, t1 and t2 the poi's receive and
+// reply times. The request hands the poi the controller's latest estimate
+// of its offset, so it can turn scheduled switch times (controller clock)
+// into its own.
+#define CLOCK_SYNC_REQUEST 0x01
+#define CLOCK_SYNC_REPLY 0x02
+#define CLOCK_SYNC_REQUEST_SIZE 14
+#define CLOCK_SYNC_REPLY_SIZE 17
+
+// Poi side, for the poi firmware: answers requests and keeps the offset
+// the controller measured.
+class PoiClock {
+public:
+  PoiClock() : offset(0), valid(false) {}
+
+  // Fill reply for a request received at receivedAt (local millis) and
+  // answered at now. Returns the reply size, 0 if data is not a request.
+  size_t answer(const uint8_t* data, size_t len, uint32_t receivedAt, uint32_t now, uint8_t* reply);
+
+  bool synced() const { return valid; }
+  // Local millis at the given controller millis
+  uint32_t toLocal(uint32_t controllerTime) const { return controllerTime + (uint32_t)offset; }
+  // Local millis at which to apply a switch command received at now:
+  // its switch time if scheduled and plausible, otherwise now
+  uint32_t switchTime(const SwitchCommand& command, uint32_t now) const;
+
+private:
+  int32_t offset;
+  bool valid;
+};
+
+// Controller side: pings every online poi that advertises
+// POI_FEATURE_CLOCK_SYNC and estimates offset = poi clock - controller
+// clock from the lowest-delay exchange of the last CLOCK_SYNC_SAMPLES,
+// which is the one least skewed by asymmetric queuing. poll() never
+// blocks and is called from the main loop.
+class ClockSync {
+public:
+  ClockSync(UdpSocket& socket, Clock& clock, const PoiRegistry& registry,
+            uint32_t intervalMs = CLOCK_SYNC_INTERVAL_MS,
+            uint32_t fastIntervalMs = CLOCK_SYNC_FAST_INTERVAL_MS);
+
+  bool begin();
+  void poll();
+
+  bool synced(int i) const { return peers[i].sampleCount >= CLOCK_SYNC_MIN_SAMPLES; }
+  // Poi clock minus controller clock, ms
+  int32_t offset(int i) const { return peers[i].offset; }
+  // Round trip of the exchange the offset came from
+  uint32_t roundTrip(int i) const { return peers[i].roundTrip; }
+  // Spread of the offsets in the window: how far the estimate may be off
+  uint32_t jitter(int i) const { return peers[i].jitter; }
+  uint32_t requestCount() const { return requests; }
+  uint32_t replyCount() const { return replies; }
+
+private:
+  struct Sample {
+    int32_t offset;
+    uint32_t delay;
+  };
+  struct Peer {
+    uint16_t pendingSeq;
+    bool pending;
+    uint32_t lastPing;
+    Sample samples[CLOCK_SYNC_SAMPLES];
+    uint8_t sampleCount;
+    uint8_t next;
+    int32_t offset;
+    uint32_t roundTrip;
+    uint32_t jitter;
+  };
+
+  void ping(int i, uint32_t now);
+  void handleReply(const uint8_t* data, size_t len, uint32_t now);
+  void estimate(Peer& peer);
+
+  UdpSocket& socket;
+  Clock& clock;
+  const PoiRegistry& registry;
+  uint32_t intervalMs;
+  uint32_t fastIntervalMs;
+  bool started;
+  uint16_t seq;
+  uint32_t requests;
+  uint32_t replies;
+  Peer peers[MAX_POI_SERVERS];
+};
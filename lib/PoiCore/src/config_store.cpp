@@ -0,0 +1,219 @@
+#include "config_store.h"
+
+#include <string.h>
+
+#include "crc.h"
+
+// Sequential little-endian field writer/reader over a payload
+struct ConfigWriter {
+  uint8_t* p;
+
+  void u8(uint8_t v) { *p++ = v; }
+  void u32(uint32_t v) {
+    for (int i = 0; i < 4; i++) *p++ = (uint8_t)(v >> (8 * i));
+  }
+  void f32(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    u32(bits);
+  }
+  void chars(const char* s, size_t size) {
+    strncpy((char*)p, s, size);
+    p[size - 1] = '\0';
+    p += size;
+  }
+};
+
+// Reads stop at the end of the payload; a field past it is left as it was
+struct ConfigReader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  bool has(size_t n) const { return (size_t)(end - p) >= n; }
+  void u8(uint8_t& v) {
+    if (has(1)) v = *p++;
+  }
+  void flag(bool& v) {
+    if (has(1)) v = *p++ != 0;
+  }
+  void u32(uint32_t& v) {
+    if (!has(4)) return;
+    v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    p += 4;
+  }
+  void f32(float& v) {
+    if (!has(4)) return;
+    uint32_t bits;
+    u32(bits);
+    memcpy(&v, &bits, sizeof(v));
+  }
+  void chars(char* s, size_t size) {
+    if (!has(size)) return;
+    memcpy(s, p, size);
+    s[size - 1] = '\0';
+    p += size;
+  }
+};
+
+void resetConfig(PoiConfig& config) {
+  memset(&config.wifi, 0, sizeof(config.wifi));
+  config.wifi.fallbackEnabled = true;
+  config.wifi.last.network = CONFIG_NO_NETWORK;
+  config.detector = StallDetectorConfig();
+  config.calibration = CalibrationState();
+  config.totals = SpinTotals();
+  config.gestures = GestureConfig();
+}
+
+size_t encodeConfig(uint8_t* data, const PoiConfig& config) {
+  ConfigWriter w = {data + CONFIG_HEADER_SIZE};
+  for (int i = 0; i < CONFIG_NETWORKS; i++) {
+    const WiFiConfig& net = config.wifi.networks[i];
+    w.chars(net.ssid, sizeof(net.ssid));
+    w.chars(net.password, sizeof(net.password));
+    w.u8(net.enabled);
+  }
+  w.u8(config.wifi.fallbackEnabled);
+  w.u8(config.wifi.currentNetwork);
+
+  const StallDetectorConfig& d = config.detector;
+  w.f32(d.gyroThreshold);
+  w.f32(d.stopThreshold);
+  w.u32(d.startHoldMs);
+  w.u32(d.stillTimeoutMs);
+  w.u8(d.predictive);
+  w.f32(d.confidence);
+  w.u32(d.settleMs);
+  w.f32(d.decelReference);
+
+  const WiFiLastConnection& last = config.wifi.last;
+  w.u8(config.wifi.reuseLease);
+  w.u8(last.network);
+  for (int i = 0; i < 6; i++) w.u8(last.bssid[i]);
+  w.u8(last.channel);
+  w.u32(last.ip);
+  w.u32(last.gateway);
+  w.u32(last.subnet);
+  w.u32(last.dns);
+
+  const CalibrationState& c = config.calibration;
+  w.u8(d.autoCalibrate);
+  w.u32((uint32_t)c.biasQ4);
+  w.u32((uint32_t)c.noise);
+  w.u32((uint32_t)c.spinRate);
+  w.u32(c.spins);
+  w.u32(c.rests);
+
+  w.u32(config.totals.revolutions);
+  w.u32(config.totals.spinMs);
+
+  w.u8(config.gestures.enabled);
+  for (int i = GESTURE_NONE + 1; i < GESTURES; i++) w.u8(config.gestures.actions[i]);
+
+  size_t payload = w.p - data - CONFIG_HEADER_SIZE;
+  memcpy(data, "PCFG", 4);
+  data[4] = CONFIG_VERSION;
+  data[5] = 0;
+  data[6] = (uint8_t)payload;
+  data[7] = (uint8_t)(payload >> 8);
+  uint16_t crc = crc16(data, CONFIG_HEADER_SIZE + payload);
+  w.p[0] = (uint8_t)crc;
+  w.p[1] = (uint8_t)(crc >> 8);
+  return CONFIG_HEADER_SIZE + payload + 2;
+}
+
+bool decodeConfig(const uint8_t* data, size_t len, PoiConfig& config) {
+  if (len < CONFIG_HEADER_SIZE + 2 || memcmp(data, "PCFG", 4) != 0 || data[4] == 0) {
+    return false;
+  }
+  size_t payload = data[6] | (data[7] << 8);
+  if (CONFIG_HEADER_SIZE + payload + 2 != len) {
+    return false;
+  }
+  const uint8_t* end = data + CONFIG_HEADER_SIZE + payload;
+  if ((uint16_t)(end[0] | (end[1] << 8)) != crc16(data, CONFIG_HEADER_SIZE + payload)) {
+    return false;
+  }
+
+  ConfigReader r = {data + CONFIG_HEADER_SIZE, end};
+  for (int i = 0; i < CONFIG_NETWORKS; i++) {
+    WiFiConfig& net = config.wifi.networks[i];
+    r.chars(net.ssid, sizeof(net.ssid));
+    r.chars(net.password, sizeof(net.password));
+    r.flag(net.enabled);
+  }
+  r.flag(config.wifi.fallbackEnabled);
+  r.u8(config.wifi.currentNetwork);
+
+  StallDetectorConfig& d = config.detector;
+  r.f32(d.gyroThreshold);
+  r.f32(d.stopThreshold);
+  r.u32(d.startHoldMs);
+  r.u32(d.stillTimeoutMs);
+  r.flag(d.predictive);
+  r.f32(d.confidence);
+  r.u32(d.settleMs);
+  r.f32(d.decelReference);
+
+  WiFiLastConnection& last = config.wifi.last;
+  r.flag(config.wifi.reuseLease);
+  r.u8(last.network);
+  for (int i = 0; i < 6; i++) r.u8(last.bssid[i]);
+  r.u8(last.channel);
+  r.u32(last.ip);
+  r.u32(last.gateway);
+  r.u32(last.subnet);
+  r.u32(last.dns);
+
+  CalibrationState& c = config.calibration;
+  r.flag(d.autoCalibrate);
+  r.u32((uint32_t&)c.biasQ4);
+  r.u32((uint32_t&)c.noise);
+  r.u32((uint32_t&)c.spinRate);
+  r.u32(c.spins);
+  r.u32(c.rests);
+
+  r.u32(config.totals.revolutions);
+  r.u32(config.totals.spinMs);
+
+  r.flag(config.gestures.enabled);
+  for (int i = GESTURE_NONE + 1; i < GESTURES; i++) {
+    r.u8(config.gestures.actions[i]);
+    if (config.gestures.actions[i] >= GESTURE_ACTIONS) config.gestures.actions[i] = GESTURE_ACTION_NONE;
+  }
+  return true;
+}
+
+// ============================================================================
+// ConfigStore
+// ============================================================================
+
+ConfigStore::ConfigStore(FileStore& store, const char* path)
+  : store(store),
+    path(path) {
+}
+
+bool ConfigStore::load(PoiConfig& config) {
+  uint8_t data[CONFIG_MAX_SIZE];
+  int len = store.read(path, data, sizeof(data));
+  if (len < 0) {
+    return false;
+  }
+  // Decode into a copy so a damaged file cannot leave config half-updated
+  PoiConfig loaded = config;
+  if (!decodeConfig(data, len, loaded)) {
+    return false;
+  }
+  config = loaded;
+  return true;
+}
+
+bool ConfigStore::save(const PoiConfig& config) {
+  uint8_t data[CONFIG_MAX_SIZE];
+  size_t len = encodeConfig(data, config);
+  if (!store.write(path, data, len)) {
+    poiLog("Config: cannot write %s\n", path);
+    return false;
+  }
+  return true;
+}
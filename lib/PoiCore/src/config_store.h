@@ -0,0 +1,101 @@
+#pragma once
+
+#include "gesture_engine.h"
+#include "gyro_calibration.h"
+#include "hal.h"
+#include "revolution_counter.h"
+#include "stall_detector.h"
+
+#define CONFIG_PATH "/config.bin"
+#define CONFIG_NETWORKS 3
+#define CONFIG_FALLBACK_NETWORK CONFIG_NETWORKS  // network index of the secrets.h credentials
+#define CONFIG_NO_NETWORK 0xFF
+#define CONFIG_MAX_SIZE 512  // whole file, header and CRC included
+
+// File layout, little-endian:
+//   'P' 'C' 'F' 'G' version(u8) 0 payloadLength(u16) payload crc16(u16)
+// The CRC covers header and payload. Fields are only ever appended to the
+// payload, and version goes up when they are: a reader decodes the fields
+// it knows from any version, and anything missing from an older file
+// keeps its default.
+//
+// Version 1 payload:
+//   CONFIG_NETWORKS x { ssid[32] password[64] enabled(u8) }
+//   fallbackEnabled(u8) currentNetwork(u8)
+//   gyroThreshold(f32) stopThreshold(f32) startHoldMs(u32) stillTimeoutMs(u32)
+//   predictive(u8) confidence(f32) settleMs(u32) decelReference(f32)
+// Version 2 adds:
+//   reuseLease(u8) last.network(u8) last.bssid[6] last.channel(u8)
+//   last.ip(u32) last.gateway(u32) last.subnet(u32) last.dns(u32)
+// Version 3 adds:
+//   autoCalibrate(u8) calibration.biasQ4(u32) calibration.noise(u32)
+//   calibration.spinRate(u32) calibration.spins(u32) calibration.rests(u32)
+// Version 4 adds:
+//   totals.revolutions(u32) totals.spinMs(u32)
+// Version 5 adds:
+//   gestures.enabled(u8) GESTURES - 1 x { gestures.actions[gesture](u8) }
+#define CONFIG_VERSION 5
+#define CONFIG_HEADER_SIZE 8
+
+// WiFi configuration structure
+struct WiFiConfig {
+  char ssid[32];
+  char password[64];
+  bool enabled;
+};
+
+// Where the last successful connection went, so the next boot can join
+// the same access point without scanning
+struct WiFiLastConnection {
+  uint8_t network;   // index into networks, CONFIG_FALLBACK_NETWORK or CONFIG_NO_NETWORK
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;       // DHCP lease, as IPAddress converts to uint32_t
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// WiFi settings structure for LittleFS storage
+struct WiFiSettings {
+  WiFiConfig networks[CONFIG_NETWORKS];  // Up to 3 configurable networks
+  bool fallbackEnabled;    // Use secrets.h fallback
+  uint8_t currentNetwork;  // Currently selected network index
+  bool reuseLease;         // take last's addresses as a static IP instead of asking DHCP
+  WiFiLastConnection last;
+};
+
+// Everything kept across reboots
+struct PoiConfig {
+  WiFiSettings wifi;
+  StallDetectorConfig detector;
+  CalibrationState calibration;
+  SpinTotals totals;
+  GestureConfig gestures;
+};
+
+// No networks, secrets.h fallback on, default detector, nothing learned
+// or counted, gestures off
+void resetConfig(PoiConfig& config);
+
+// Returns the encoded size, at most CONFIG_MAX_SIZE
+size_t encodeConfig(uint8_t* data, const PoiConfig& config);
+// False if data is not a config file or its CRC does not match; config is
+// then left alone
+bool decodeConfig(const uint8_t* data, size_t len, PoiConfig& config);
+
+// Typed config in one small binary file. Loading is a single read and a
+// CRC; saving goes through FileStore::write, which replaces the file by
+// rename, so a reset mid-save leaves the previous config intact.
+class ConfigStore {
+public:
+  explicit ConfigStore(FileStore& store, const char* path = CONFIG_PATH);
+
+  // False if the file is missing or damaged; config keeps what it had
+  bool load(PoiConfig& config);
+  bool save(const PoiConfig& config);
+
+private:
+  FileStore& store;
+  const char* path;
+};
@@ -0,0 +1,185 @@
+#include "connection_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// ============================================================================
+// HttpResponseParser
+// ============================================================================
+
+void HttpResponseParser::reset() {
+  stage = STATUS_LINE;
+  lineLen = 0;
+  statusCode = 0;
+  contentLength = -1;
+  connectionClose = false;
+}
+
+void HttpResponseParser::endOfLine() {
+  line[lineLen] = '\0';
+  if (stage == STATUS_LINE) {
+    // "HTTP/1.1 200 OK"
+    if (strncmp(line, "HTTP/1.", 7) == 0 && lineLen >= 12) {
+      statusCode = atoi(line + 9);
+      connectionClose = line[7] == '0';  // HTTP/1.0 defaults to close
+    }
+    stage = HEADERS;
+  } else if (lineLen == 0) {
+    // Blank line ends the headers; without a length the body runs to close
+    stage = contentLength > 0 ? BODY : COMPLETE;
+    if (contentLength < 0) connectionClose = true;
+  } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+    contentLength = atol(line + 15);
+  } else if (strncasecmp(line, "Connection:", 11) == 0) {
+    const char* value = line + 11;
+    while (*value == ' ') value++;
+    if (strncasecmp(value, "close", 5) == 0) connectionClose = true;
+    if (strncasecmp(value, "keep-alive", 10) == 0) connectionClose = false;
+  }
+  lineLen = 0;
+}
+
+bool HttpResponseParser::feed(const char* data, size_t len) {
+  for (size_t i = 0; i < len && stage != COMPLETE; i++) {
+    char c = data[i];
+    if (stage == BODY) {
+      if (--contentLength <= 0) stage = COMPLETE;
+    } else if (c == '\n') {
+      endOfLine();
+    } else if (c != '\r' && lineLen < sizeof(line) - 1) {
+      line[lineLen++] = c;
+    }
+  }
+  return stage == COMPLETE;
+}
+
+// ============================================================================
+// ConnectionPool
+// ============================================================================
+
+ConnectionPool::ConnectionPool(Clock& clock, TcpConnection* const* connections,
+                               const PoiRegistry& registry)
+  : clock(clock),
+    connections(connections),
+    registry(registry),
+    connects(0),
+    reuses(0) {
+  for (int i = 0; i < MAX_POI_SERVERS; i++) {
+    slots[i].busy = false;
+    slots[i].nextRetry = 0;
+    slots[i].retryDelay = POOL_RETRY_MIN_MS;
+  }
+}
+
+bool ConnectionPool::open(int i) {
+  connects++;
+  return connections[i]->connect(registry.host(i), registry.port(i));
+}
+
+void ConnectionPool::maintain() {
+  uint32_t now = clock.millis();
+  int count = registry.count();
+  for (int i = 0; i < count; i++) {
+    Slot& s = slots[i];
+    TcpState state = connections[i]->state();
+    if (!registry.online(i)) {
+      if (!s.busy && (state == TCP_CONNECTED || state == TCP_CONNECTING)) {
+        connections[i]->close();
+      }
+      s.retryDelay = POOL_RETRY_MIN_MS;  // try straight away once it is back
+      s.nextRetry = now;
+      continue;
+    }
+    if (state == TCP_CONNECTED) {
+      s.retryDelay = POOL_RETRY_MIN_MS;  // reachable again
+      continue;
+    }
+    if (s.busy || state == TCP_CONNECTING || (int32_t)(now - s.nextRetry) < 0) {
+      continue;
+    }
+    // Idle and closed: warm it up for the next request
+    open(i);
+    s.nextRetry = now + s.retryDelay;
+    s.retryDelay = s.retryDelay * 2 < POOL_RETRY_MAX_MS ? s.retryDelay * 2 : POOL_RETRY_MAX_MS;
+  }
+}
+
+bool ConnectionPool::request(int i, const char* data, size_t len) {
+  Slot& s = slots[i];
+  TcpConnection* conn = connections[i];
+
+  // Throw away anything the server sent after the previous response
+  char discard[64];
+  while (conn->receive(discard, sizeof(discard)) > 0) {
+  }
+
+  s.data = data;
+  s.len = len;
+  s.parser.reset();
+  s.busy = true;
+
+  TcpState state = conn->state();
+  s.reused = state == TCP_CONNECTED;
+  if (s.reused) {
+    reuses++;
+  } else if (state != TCP_CONNECTING && !open(i)) {
+    s.busy = false;
+    return false;
+  }
+  if (!conn->send(data, len)) {
+    s.busy = false;
+    return false;
+  }
+  return true;
+}
+
+int ConnectionPool::poll(int i) {
+  Slot& s = slots[i];
+  if (!s.busy) return -1;
+  TcpConnection* conn = connections[i];
+
+  char buf[64];
+  size_t n;
+  while (!s.parser.complete() && (n = conn->receive(buf, sizeof(buf))) > 0) {
+    s.parser.feed(buf, n);
+  }
+
+  if (s.parser.complete()) {
+    s.busy = false;
+    if (!s.parser.keepAlive()) {
+      conn->close();
+    }
+    return s.parser.status();
+  }
+
+  if (conn->state() == TCP_CLOSED) {
+    if (s.reused) {
+      // The server dropped the idle connection under us: retry once fresh
+      s.reused = false;
+      s.parser.reset();
+      if (open(i) && conn->send(s.data, s.len)) {
+        return 0;
+      }
+    }
+    s.busy = false;
+    return -1;
+  }
+  return 0;
+}
+
+void ConnectionPool::abort(int i) {
+  slots[i].busy = false;
+  connections[i]->close();
+  slots[i].nextRetry = clock.millis() + slots[i].retryDelay;
+}
+
+void ConnectionPool::reset() {
+  uint32_t now = clock.millis();
+  for (int i = 0; i < MAX_POI_SERVERS; i++) {
+    slots[i].busy = false;
+    connections[i]->close();
+    slots[i].retryDelay = POOL_RETRY_MIN_MS;
+    slots[i].nextRetry = now;
+  }
+}
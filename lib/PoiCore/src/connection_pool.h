@@ -0,0 +1,80 @@
+#pragma once
+
+#include "hal.h"
+#include "poi_registry.h"
+
+#define POOL_RETRY_MIN_MS 1000   // first reconnect attempt after a failure
+#define POOL_RETRY_MAX_MS 30000  // reconnect backoff cap
+
+// Incremental parser for small HTTP/1.1 responses: status line, headers,
+// then a Content-Length body. Enough to know when a keep-alive response
+// is complete so the connection can be reused.
+class HttpResponseParser {
+public:
+  HttpResponseParser() { reset(); }
+  void reset();
+  // Returns true once the whole response has been fed
+  bool feed(const char* data, size_t len);
+
+  bool complete() const { return stage == COMPLETE; }
+  int status() const { return statusCode; }
+  bool keepAlive() const { return !connectionClose; }
+
+private:
+  enum Stage { STATUS_LINE, HEADERS, BODY, COMPLETE };
+  void endOfLine();
+
+  Stage stage;
+  char line[64];  // current line, truncated if longer
+  uint8_t lineLen;
+  int statusCode;
+  long contentLength;  // -1 if not given
+  bool connectionClose;
+};
+
+// One persistent HTTP connection per online poi in a PoiRegistry. connections
+// holds MAX_POI_SERVERS connections, one per registry index. Connections are
+// opened ahead of time by maintain(), reused across requests, and
+// transparently re-established when the server has closed them.
+class ConnectionPool {
+public:
+  ConnectionPool(Clock& clock, TcpConnection* const* connections, const PoiRegistry& registry);
+
+  // Keep idle connections to online poi open, reconnecting with backoff,
+  // and close those to poi that went offline. Call regularly.
+  void maintain();
+
+  // Send a complete request to server i. data must stay valid until the
+  // response arrives, as it is resent if a reused connection turns out stale.
+  bool request(int i, const char* data, size_t len);
+  // 0 while waiting, the HTTP status when done, -1 if the request failed
+  int poll(int i);
+  // Give up on the request in flight and drop the connection
+  void abort(int i);
+  // Drop every connection and forget the backoff, e.g. once the network
+  // is back after an outage; maintain() reconnects straight away
+  void reset();
+
+  uint32_t connectCount() const { return connects; }
+  uint32_t reuseCount() const { return reuses; }
+
+private:
+  struct Slot {
+    bool busy;
+    bool reused;      // request went out on an already open connection
+    const char* data;
+    size_t len;
+    uint32_t nextRetry;
+    uint32_t retryDelay;
+    HttpResponseParser parser;
+  };
+
+  bool open(int i);
+
+  Clock& clock;
+  TcpConnection* const* connections;
+  const PoiRegistry& registry;
+  Slot slots[MAX_POI_SERVERS];
+  uint32_t connects;
+  uint32_t reuses;
+};
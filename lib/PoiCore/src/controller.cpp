@@ -0,0 +1,244 @@
+#include "controller.h"
+
+Controller::Controller(ImuSource& imu, Clock& clock, StatusLed& led, PatternClient& patterns,
+                       PatternDispatcher& dispatcher, const ControllerConfig& config)
+  : detector(config.detector),
+    samplesProcessed(0),
+    imu(imu),
+    clock(clock),
+    led(led),
+    patterns(patterns),
+    dispatcher(dispatcher),
+    refresher(NULL),
+    telemetry(NULL),
+    sessionLog(NULL),
+    revolutionCallback(NULL),
+    revolutionContext(NULL),
+    config(config),
+    sensorReady(false),
+    patternSentForCurrentPause(false),
+    stallLogged(false),
+    spinLogged(true),
+    spinPeak(0),
+    shownIndex(0),
+    gestureSelected(false),
+    gestureResend(false) {
+  switch (config.rotationAxis) {
+    case 0: processBatch = &Controller::processBatchOn<0>; break;
+    case 2: processBatch = &Controller::processBatchOn<2>; break;
+    default: processBatch = &Controller::processBatchOn<1>;
+  }
+  dispatcher.onComplete(dispatchComplete, this);
+  calibration.setEnabled(config.detector.autoCalibrate);
+  revolutions.onRevolution(revolutionComplete, this);
+}
+
+void Controller::configureDetector(const StallDetectorConfig& settings) {
+  config.detector = settings;
+  calibration.setEnabled(settings.autoCalibrate);
+  detector.configure(calibration.effective(settings));
+}
+
+void Controller::dispatchComplete(void* context, int server, int patternNumber,
+                                  int httpStatus, uint32_t elapsedMs) {
+  (void)patternNumber;
+  Controller* self = (Controller*)context;
+  self->latency.serverResponded(server, httpStatus, self->clock.millis());
+  if (self->sessionLog) {
+    self->sessionLog->record(LOG_SERVER_LATENCY, self->clock.millis(), (uint8_t)server,
+                             (int32_t)elapsedMs, (uint16_t)(int16_t)httpStatus);
+  }
+}
+
+void Controller::revolutionComplete(void* context, uint32_t now, uint32_t periodMs, int8_t direction) {
+  Controller* self = (Controller*)context;
+  if (self->revolutionCallback) {
+    self->revolutionCallback(self->revolutionContext, now, periodMs, direction);
+  }
+  if (self->config.debugMode) {
+    poiLog("Revolution %lu at %lu ms: %lu ms, %s, %u.%u RPM smoothed\n",
+           (unsigned long)self->revolutions.revolutions(), (unsigned long)now, (unsigned long)periodMs,
+           direction > 0 ? "forward" : "backward", self->revolutions.smoothedRpmTenths() / 10,
+           self->revolutions.smoothedRpmTenths() % 10);
+  }
+}
+
+int32_t axisRotationSpeed(const ImuSample& sample, int rotationAxis) {
+  switch (rotationAxis) {
+    case 0: return axisSpeed<0>(sample);
+    case 2: return axisSpeed<2>(sample);
+    default: return axisSpeed<1>(sample);
+  }
+}
+
+uint8_t Controller::telemetryState(uint32_t now) const {
+  uint8_t state = 0;
+  if (detector.isRotating()) state |= TELEMETRY_ROTATING;
+  if (detector.isStill(now)) state |= TELEMETRY_STILL;
+  if (detector.confirmedEarly()) state |= TELEMETRY_PREDICTED;
+  return state;
+}
+
+template <int Axis>
+void Controller::processBatchOn(const ImuSample* batch, size_t n) {
+  samplesProcessed += n;
+  TelemetryStream* stream = telemetry && telemetry->active() ? telemetry : NULL;
+  for (size_t i = 0; i < n; i++) {
+    int32_t speed = calibration.update(axisSpeed<Axis>(batch[i]), batch[i].timestamp);
+    if (detector.update(speed, batch[i].timestamp)) {
+      movementResumed(batch[i].timestamp);
+    }
+    revolutions.update(speed, batch[i].timestamp, detector.isRotating());
+    if (gestureConfig.enabled) {
+      Gesture gesture = gestures.update(speed, batch[i].timestamp);
+      if (gesture != GESTURE_NONE) {
+        gestureRecognized(gesture, batch[i].timestamp);
+      }
+    }
+    if (sessionLog) {
+      trackSpin(speed, batch[i].timestamp);
+    }
+    if (stream) {
+      uint16_t confidence = detector.stallConfidenceQ8();
+      stream->add(batch[i], telemetryState(batch[i].timestamp), confidence > 255 ? 255 : (uint8_t)confidence);
+    }
+  }
+  // Learned thresholds take over between spins
+  calibration.apply(detector, config.detector);
+}
+
+// Peak speed of each spin, logged when it ends
+void Controller::trackSpin(int32_t speed, uint32_t now) {
+  if (detector.isRotating()) {
+    int32_t magnitude = speed < 0 ? -speed : speed;
+    if (magnitude > spinPeak) spinPeak = magnitude;
+    spinLogged = false;
+  } else if (!spinLogged) {
+    // RPM * 10 = deg/s / 6 * 10 = LSB * 10 / (GYRO_LSB_PER_DPS * 6)
+    sessionLog->record(LOG_PEAK_RPM, now, 0, spinPeak * 100 / 984);
+    spinLogged = true;
+    spinPeak = 0;
+  }
+}
+
+void Controller::movementResumed(uint32_t now) {
+  // Reset sent flag for new pause cycle
+  patternSentForCurrentPause = false;
+
+  if (sessionLog && stallLogged) {
+    sessionLog->record(LOG_STALL_END, now, 0, (int32_t)(now - detector.stopTime()));
+  }
+  stallLogged = false;
+
+  // A gesture already chose what the next pause shows
+  if (gestureSelected) {
+    return;
+  }
+
+  // Increment pattern index when movement resumes (next pause)
+  if (patterns.count() > 0) {
+    patterns.advance();
+    poiLog("Movement resumed - next pattern index: %d (pattern %d)\n",
+           patterns.currentIndex(), patterns.currentPattern());
+  }
+}
+
+// The action picks the pattern the next pattern change sends. In a pause
+// that already had its change, previous and first are sent straight away.
+void Controller::gestureRecognized(Gesture gesture, uint32_t now) {
+  GestureAction action = (GestureAction)gestureConfig.actions[gesture];
+  if (sessionLog) {
+    sessionLog->record(LOG_GESTURE, now, gesture, action);
+  }
+  if (action == GESTURE_ACTION_NONE || patterns.count() == 0) {
+    return;
+  }
+  switch (action) {
+    case GESTURE_ACTION_PREVIOUS: patterns.select(shownIndex - 1); break;
+    case GESTURE_ACTION_FIRST: patterns.select(0); break;
+    default: patterns.select(shownIndex); break;
+  }
+  gestureSelected = true;
+  if (action != GESTURE_ACTION_HOLD && patternSentForCurrentPause && !detector.isRotating()) {
+    patternSentForCurrentPause = false;
+    gestureResend = true;
+  }
+  poiLog("Gesture %s - %s, next pattern index: %d (pattern %d)\n", GestureEngine::name(gesture),
+         GestureEngine::actionName(action), patterns.currentIndex(), patterns.currentPattern());
+}
+
+void Controller::update() {
+  if (telemetry) {
+    telemetry->poll();
+  }
+
+  if (sensorReady) {
+    // Drain everything the sensor buffered since the last call
+    ImuSample batch[IMU_BATCH_SIZE];
+    size_t n;
+    do {
+      n = imu.readBatch(batch, IMU_BATCH_SIZE);
+      (this->*processBatch)(batch, n);
+    } while (n == IMU_BATCH_SIZE);
+
+    if (config.debugMode && n > 0) {
+      const ImuSample& sample = batch[n - 1];
+      poiLog("Gyro: X:%.1f Y:%.1f Z:%.1f deg/s | Rot: %d | Still: %lums\n",
+             sample.gyroX / GYRO_LSB_PER_DPS, sample.gyroY / GYRO_LSB_PER_DPS, sample.gyroZ / GYRO_LSB_PER_DPS,
+             detector.isRotating(), (unsigned long)(clock.millis() - detector.lastMovementTime()));
+    }
+  }
+
+  // A refreshed pattern list only goes live between dispatches
+  if (!dispatcher.busy()) {
+    patterns.applyPending();
+  }
+
+  // Control LED: Only turn ON once the stall is confirmed
+  bool is_still = detector.isStill(clock.millis());
+  led.set(is_still);
+
+  if (is_still && sessionLog && !stallLogged) {
+    sessionLog->record(LOG_STALL_START, detector.stopTime(), detector.confirmedEarly(),
+                       (int32_t)(clock.millis() - detector.stopTime()));
+    stallLogged = true;
+  }
+
+  // Send ONE pattern change per pause. Without a network the pause is
+  // still unanswered once it comes back, if the poi are still stopped.
+  if (is_still && patterns.loaded() && patterns.count() > 0 && !patternSentForCurrentPause
+      && !dispatcher.paused()) {
+    uint32_t now = clock.millis();
+    if (gestureResend) {
+      // Not a stall of its own, so not timed either
+      poiLog("Gesture in the pause - sending pattern %d\n", patterns.currentPattern());
+    } else if (detector.confirmedEarly()) {
+      poiLog("Pause predicted after %lu ms (confidence %.2f) - sending pattern %d\n",
+             (unsigned long)(now - detector.stopTime()), detector.stallConfidence(), patterns.currentPattern());
+    } else {
+      poiLog("Pause detected - sending pattern %d\n", patterns.currentPattern());
+    }
+    if (!gestureResend) {
+      latency.stallConfirmed(detector.stopTime(), now);
+    }
+    if (sessionLog) {
+      sessionLog->record(LOG_PATTERN_SENT, now, (uint8_t)patterns.currentPattern(), patterns.currentIndex(),
+                         (uint16_t)dispatcher.targetCount());
+    }
+    latency.setServerCount(dispatcher.serverCount());
+    latency.requestStarted(clock.millis(), dispatcher.targetCount());
+    dispatcher.dispatch(patterns.currentPattern());
+    patternSentForCurrentPause = true;
+    shownIndex = patterns.currentIndex();
+    gestureSelected = false;
+    gestureResend = false;
+  }
+
+  dispatcher.poll();
+
+  // The listing is only fetched mid-spin with nothing in flight, so the
+  // fetch is over before the next pause needs the poi
+  if (refresher) {
+    refresher->setQuiet(!dispatcher.busy() && detector.isRotating());
+  }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "gesture_engine.h"
+#include "gyro_calibration.h"
+#include "hal.h"
+#include "latency_tracker.h"
+#include "pattern_client.h"
+#include "pattern_dispatcher.h"
+#include "pattern_refresher.h"
+#include "revolution_counter.h"
+#include "session_log.h"
+#include "stall_detector.h"
+#include "telemetry.h"
+
+#define IMU_BATCH_SIZE 32  // samples drained from the IMU per readBatch()
+
+struct ControllerConfig {
+  int rotationAxis;  // 0=X, 1=Y, 2=Z
+  bool debugMode;    // print every gyro sample
+  StallDetectorConfig detector;
+};
+
+// Raw rotation speed on a gyro axis chosen at compile time. X is
+// sign-inverted to match how the sensor is mounted on the handle.
+template <int Axis> inline int32_t axisSpeed(const ImuSample& sample);
+template <> inline int32_t axisSpeed<0>(const ImuSample& sample) { return -(int32_t)sample.gyroX; }
+template <> inline int32_t axisSpeed<1>(const ImuSample& sample) { return sample.gyroY; }
+template <> inline int32_t axisSpeed<2>(const ImuSample& sample) { return sample.gyroZ; }
+
+// Same, with the axis chosen at run time (0=X, 1=Y, 2=Z, anything else Y)
+int32_t axisRotationSpeed(const ImuSample& sample, int rotationAxis);
+
+// One iteration of the main loop: read the gyro, track rotation, drive the
+// status LED and dispatch one pattern change per pause. Never blocks.
+class Controller {
+public:
+  Controller(ImuSource& imu, Clock& clock, StatusLed& led, PatternClient& patterns,
+             PatternDispatcher& dispatcher, const ControllerConfig& config);
+
+  // Call when the IMU came up; until then update() only drives the LED
+  void setSensorReady(bool ready) { sensorReady = ready; }
+  // Optional: tell the refresher when it may fetch the pattern listing
+  void setRefresher(PatternRefresher* refresher) { this->refresher = refresher; }
+  // Optional: stream downsampled samples and detector state
+  void setTelemetry(TelemetryStream* telemetry) { this->telemetry = telemetry; }
+  // Optional: record stalls, pattern changes, latencies and spin speeds
+  void setSessionLog(SessionLog* log) { sessionLog = log; }
+  // Optional: called for every revolution RevolutionCounter completes
+  void onRevolution(RevolutionCallback callback, void* context) {
+    revolutionCallback = callback;
+    revolutionContext = context;
+  }
+  void update();
+
+  // Detector parameters as configured; with autoCalibrate the detector
+  // runs on the learned thresholds instead once there are enough spins
+  void configureDetector(const StallDetectorConfig& settings);
+  const StallDetectorConfig& detectorSettings() const { return config.detector; }
+  // Gestures and the action each one takes; off until enabled here
+  void configureGestures(const GestureConfig& settings) { gestureConfig = settings; }
+  const GestureConfig& gestureSettings() const { return gestureConfig; }
+
+  StallDetector detector;
+  GyroCalibrator calibration;
+  RevolutionCounter revolutions;
+  GestureEngine gestures;
+  LatencyTracker latency;
+  uint32_t samplesProcessed;
+
+private:
+  static void dispatchComplete(void* context, int server, int patternNumber,
+                               int httpStatus, uint32_t elapsedMs);
+  // processBatch points at the instantiation for config.rotationAxis, so
+  // the per-sample loop has no axis switch
+  template <int Axis> void processBatchOn(const ImuSample* batch, size_t n);
+  void (Controller::*processBatch)(const ImuSample* batch, size_t n);
+  static void revolutionComplete(void* context, uint32_t now, uint32_t periodMs, int8_t direction);
+  void movementResumed(uint32_t now);
+  void gestureRecognized(Gesture gesture, uint32_t now);
+  void trackSpin(int32_t speed, uint32_t now);
+  uint8_t telemetryState(uint32_t now) const;
+
+  ImuSource& imu;
+  Clock& clock;
+  StatusLed& led;
+  PatternClient& patterns;
+  PatternDispatcher& dispatcher;
+  PatternRefresher* refresher;
+  TelemetryStream* telemetry;
+  SessionLog* sessionLog;
+  RevolutionCallback revolutionCallback;
+  void* revolutionContext;
+  ControllerConfig config;
+  GestureConfig gestureConfig;
+
+  bool sensorReady;
+  bool patternSentForCurrentPause;  // Track if pattern already sent for current pause
+  bool stallLogged;      // LOG_STALL_START written for the current pause
+  bool spinLogged;       // ... and the spin before it has its LOG_PEAK_RPM
+  int32_t spinPeak;      // fastest |speed| of the current spin, raw LSB
+  int shownIndex;        // pattern index last sent
+  bool gestureSelected;  // a gesture chose the next pattern: do not advance past it
+  bool gestureResend;    // ... and this pause already had its pattern sent
+};
@@ -0,0 +1,12 @@
+#include "crc.h"
+
+uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc) {
+  // Bitwise: the records it guards are 14 bytes, a table is not worth 512 bytes
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
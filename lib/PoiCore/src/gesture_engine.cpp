@@ -0,0 +1,173 @@
+#include "gesture_engine.h"
+
+#include <string.h>
+
+// In frames of GESTURE_FRAME_MS
+const GestureEngine::Template GestureEngine::templates[] = {
+  // A spin of 300 ms or more, then 200 ms the other way, through zero or
+  // with a stop of up to 100 ms (160 ms with the slowing down and speeding
+  // up either side). Fires while the second spin goes on.
+  {GESTURE_REVERSAL, 2, {{MATCH_SAME, 15, GESTURE_OPEN}, {MATCH_OPPOSITE, 10, GESTURE_OPEN}}},
+  {GESTURE_REVERSAL, 3, {{MATCH_SAME, 15, GESTURE_OPEN}, {MATCH_STILL, 1, 8}, {MATCH_OPPOSITE, 10, GESTURE_OPEN}}},
+  // A spin of 500 ms or more, a stop of 160-800 ms, 200 ms to 1 s of
+  // spin and a second stop; fires 160 ms into it
+  {GESTURE_DOUBLE_STALL, 4, {{MATCH_ANY, 25, GESTURE_OPEN}, {MATCH_STILL, 8, 40},
+                             {MATCH_ANY, 10, 50}, {MATCH_STILL, 8, GESTURE_OPEN}}},
+  // Held still for 200 ms, then four half-swings of 40-200 ms each; fires
+  // as the fourth ends
+  {GESTURE_SHAKE, 5, {{MATCH_STILL, 10, GESTURE_OPEN}, {MATCH_ANY, 2, 10}, {MATCH_OPPOSITE, 2, 10},
+                      {MATCH_SAME, 2, 10}, {MATCH_OPPOSITE, 2, 10}}},
+};
+
+GestureEngine::GestureEngine()
+  : stillRaw((int32_t)(GESTURE_STILL_DPS * GYRO_LSB_PER_DPS)),
+    moveRaw((int32_t)(GESTURE_MOVE_DPS * GYRO_LSB_PER_DPS)),
+    frameSum(0),
+    frameCount(0),
+    frameStart(0),
+    framing(false),
+    newest(0),
+    stored(0) {
+  memset(runs, 0, sizeof(runs));
+  memset(counts, 0, sizeof(counts));
+}
+
+Gesture GestureEngine::update(int32_t speed, uint32_t now) {
+  if (!framing) {
+    framing = true;
+    frameStart = now;
+  }
+  frameSum += speed;
+  frameCount++;
+  if (now - frameStart < GESTURE_FRAME_MS) {
+    return GESTURE_NONE;
+  }
+  int32_t mean = frameSum / frameCount;
+  frameSum = 0;
+  frameCount = 0;
+  frameStart = now;
+  return closeFrame(mean);
+}
+
+Gesture GestureEngine::closeFrame(int32_t mean) {
+  int32_t magnitude = mean < 0 ? -mean : mean;
+  uint8_t symbol;
+  if (magnitude < stillRaw) {
+    symbol = GESTURE_STILL;
+  } else if (magnitude > moveRaw) {
+    symbol = mean > 0 ? GESTURE_FORWARD : GESTURE_BACKWARD;
+  } else if (stored > 0) {
+    symbol = runs[newest].symbol;  // hysteresis
+  } else {
+    symbol = GESTURE_STILL;
+  }
+
+  if (stored == 0) {
+    runs[newest] = Run{symbol, 1};
+    stored = 1;
+    return GESTURE_NONE;
+  }
+  Run& current = runs[newest];
+  if (symbol == current.symbol) {
+    if (current.frames < GESTURE_OPEN - 1) current.frames++;
+    return recognize(false);
+  }
+
+  // A still run of a frame or two between turns is the speed passing
+  // through zero: fold it into the turn that follows
+  if (current.symbol == GESTURE_STILL && current.frames <= GESTURE_GLITCH_FRAMES && stored > 1
+      && symbol != GESTURE_STILL && run(1).symbol != GESTURE_STILL) {
+    uint16_t frames = current.frames + 1;
+    newest = (newest + GESTURE_RUNS - 1) % GESTURE_RUNS;
+    stored--;
+    if (runs[newest].symbol == symbol) {
+      runs[newest].frames += frames;
+      return recognize(false);
+    }
+    newest = (newest + 1) % GESTURE_RUNS;
+    runs[newest] = Run{symbol, frames};
+    stored++;
+    return GESTURE_NONE;
+  }
+
+  Gesture closed = recognize(true);
+  newest = (newest + 1) % GESTURE_RUNS;
+  runs[newest] = Run{symbol, 1};
+  if (stored < GESTURE_RUNS) stored++;
+  return closed;
+}
+
+Gesture GestureEngine::recognize(bool closing) {
+  for (const Template& t : templates) {
+    if (matches(t, closing)) {
+      counts[t.gesture]++;
+      restart();
+      return t.gesture;
+    }
+  }
+  return GESTURE_NONE;
+}
+
+void GestureEngine::restart() {
+  stored = 1;
+}
+
+bool GestureEngine::matches(const Template& t, bool closing) const {
+  const Element& last = t.elements[t.length - 1];
+  // Open-ended templates fire as soon as their last run is long enough
+  // (and restart() keeps them from firing again), bounded ones when it ends
+  if (closing == (last.maxFrames == GESTURE_OPEN)) {
+    return false;
+  }
+  if (stored < t.length) {
+    return false;
+  }
+
+  uint8_t direction = GESTURE_STILL;
+  for (int i = 0; i < t.length; i++) {
+    const Element& e = t.elements[i];
+    const Run& r = run(t.length - 1 - i);
+    if (r.frames < e.minFrames || r.frames > e.maxFrames) {
+      return false;
+    }
+    if (e.match == MATCH_STILL) {
+      if (r.symbol != GESTURE_STILL) return false;
+      continue;
+    }
+    if (r.symbol == GESTURE_STILL) {
+      return false;
+    }
+    if (direction == GESTURE_STILL) {
+      // The first turn sets the direction the others are relative to
+      if (e.match == MATCH_OPPOSITE) return false;
+      direction = r.symbol;
+    } else if (e.match == MATCH_SAME && r.symbol != direction) {
+      return false;
+    } else if (e.match == MATCH_OPPOSITE && r.symbol == direction) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char* GestureEngine::name(Gesture gesture) {
+  switch (gesture) {
+    case GESTURE_REVERSAL: return "reversal";
+    case GESTURE_DOUBLE_STALL: return "doubleStall";
+    case GESTURE_SHAKE: return "shake";
+    default: return "none";
+  }
+}
+
+static const char* const actionNames[GESTURE_ACTIONS] = {"none", "previous", "first", "hold"};
+
+const char* GestureEngine::actionName(GestureAction action) {
+  return action < GESTURE_ACTIONS ? actionNames[action] : "none";
+}
+
+GestureAction GestureEngine::actionFromName(const char* name) {
+  for (int i = 0; i < GESTURE_ACTIONS; i++) {
+    if (strcmp(name, actionNames[i]) == 0) return (GestureAction)i;
+  }
+  return GESTURE_ACTIONS;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+#define GESTURE_FRAME_MS 20       // samples are averaged into frames this long
+#define GESTURE_RUNS 16           // recent runs of same-symbol frames kept
+#define GESTURE_STILL_DPS 40.0f   // frame mean below this is still
+#define GESTURE_MOVE_DPS 120.0f   // ... above this is turning; in between extends the current run
+#define GESTURE_GLITCH_FRAMES 2   // still runs this short between turns are a zero crossing
+#define GESTURE_MAX_ELEMENTS 5
+#define GESTURE_OPEN 0xFFFF       // template element without a maximum length
+
+enum Gesture : uint8_t {
+  GESTURE_NONE = 0,
+  GESTURE_REVERSAL,      // spinning one way, then the other
+  GESTURE_DOUBLE_STALL,  // stop, a short spin, stop again
+  GESTURE_SHAKE,         // held still, then a quick back and forth
+  GESTURES
+};
+
+enum GestureAction : uint8_t {
+  GESTURE_ACTION_NONE = 0,
+  GESTURE_ACTION_PREVIOUS,  // the next pattern change goes back one
+  GESTURE_ACTION_FIRST,     // ... to the first pattern
+  GESTURE_ACTION_HOLD,      // ... keeps the pattern that is showing
+  GESTURE_ACTIONS
+};
+
+// Off by default: a performer's own reversals and stop-go moves would
+// otherwise change patterns
+struct GestureConfig {
+  bool enabled = false;
+  uint8_t actions[GESTURES] = {GESTURE_ACTION_NONE, GESTURE_ACTION_PREVIOUS, GESTURE_ACTION_FIRST,
+                               GESTURE_ACTION_HOLD};
+};
+
+// Frame symbols
+enum GestureSymbol : uint8_t {
+  GESTURE_STILL = 0,
+  GESTURE_FORWARD,
+  GESTURE_BACKWARD
+};
+
+// Recognizes gestures in the rotation speed.
+//
+// Samples are averaged into GESTURE_FRAME_MS frames, each frame becomes a
+// symbol (still, forward, backward) and equal symbols are run-length
+// coded into a ring of the last GESTURE_RUNS runs. Each gesture is a
+// template of runs with a symbol and a length range in frames, matched
+// against the newest runs whenever a frame closes. Memory is the ring;
+// per sample it is an add and a compare, per frame a few dozen compares.
+//
+// Integer only and constant time, so it can sit in the per-sample loop
+// next to the stall detector.
+class GestureEngine {
+public:
+  GestureEngine();
+
+  // Bias-corrected rotation speed in raw LSB. Returns the gesture that
+  // completed with this sample, if any.
+  Gesture update(int32_t speed, uint32_t now);
+
+  uint32_t recognized(Gesture gesture) const { return counts[gesture]; }
+  static const char* name(Gesture gesture);
+  static const char* actionName(GestureAction action);
+  // GESTURE_ACTIONS if name is not an action
+  static GestureAction actionFromName(const char* name);
+
+private:
+  struct Run {
+    uint8_t symbol;
+    uint16_t frames;
+  };
+  // Template element: SAME and OPPOSITE are relative to the first
+  // turning element of the template, ANY is either direction
+  enum Match : uint8_t { MATCH_STILL, MATCH_SAME, MATCH_OPPOSITE, MATCH_ANY };
+  struct Element {
+    uint8_t match;
+    uint16_t minFrames;
+    uint16_t maxFrames;  // GESTURE_OPEN: no limit
+  };
+  struct Template {
+    Gesture gesture;
+    uint8_t length;
+    Element elements[GESTURE_MAX_ELEMENTS];
+  };
+  static const Template templates[];
+
+  Gesture closeFrame(int32_t mean);
+  Gesture recognize(bool closing);
+  // Keep only the newest run, so one gesture's runs do not make another
+  void restart();
+  // The newest runs match t; closing is true when the newest run just
+  // ended, false while it is still growing
+  bool matches(const Template& t, bool closing) const;
+  const Run& run(int back) const { return runs[(newest + GESTURE_RUNS - back) % GESTURE_RUNS]; }
+
+  int32_t stillRaw;
+  int32_t moveRaw;
+  int32_t frameSum;
+  uint16_t frameCount;
+  uint32_t frameStart;
+  bool framing;
+
+  Run runs[GESTURE_RUNS];
+  int newest;      // index of the run being extended
+  int stored;      // runs in the ring, up to GESTURE_RUNS
+  uint32_t counts[GESTURES];
+};
@@ -0,0 +1,224 @@
+#include "gyro_calibration.h"
+
+#include "hal.h"
+
+#define DPS_TO_RAW(dps) ((int32_t)((dps) * GYRO_LSB_PER_DPS))
+
+static inline int32_t absolute(int32_t v) {
+  return v < 0 ? -v : v;
+}
+
+GyroCalibrator::GyroCalibrator()
+  : on(true),
+    bias(0),
+    motionRaw(DPS_TO_RAW(CALIBRATION_MOTION_DPS)),
+    dirty(true),
+    unsaved(false),
+    savedBiasQ4(0),
+    restStart(0),
+    restCount(0),
+    restMin(0),
+    restMax(0),
+    restSum(0),
+    runCount(0),
+    runSumQ4(0),
+    inSpin(false),
+    spinStart(0),
+    lastMotion(0),
+    spinSum(0),
+    spinCount(0) {
+}
+
+void GyroCalibrator::setEnabled(bool enabled) {
+  if (enabled != on) {
+    on = enabled;
+    dirty = true;
+  }
+}
+
+void GyroCalibrator::restore(const CalibrationState& state) {
+  learned = state;
+  bias = (learned.biasQ4 + 8) >> 4;
+  savedBiasQ4 = learned.biasQ4;
+  updateMotionFloor();
+  dirty = true;
+  unsaved = false;
+}
+
+void GyroCalibrator::reset() {
+  restore(CalibrationState());
+  restCount = 0;
+  runCount = 0;
+  inSpin = false;
+  unsaved = true;
+}
+
+void GyroCalibrator::updateMotionFloor() {
+  motionRaw = learned.noise * CALIBRATION_NOISE_MARGIN;
+  if (motionRaw < DPS_TO_RAW(CALIBRATION_MOTION_DPS)) {
+    motionRaw = DPS_TO_RAW(CALIBRATION_MOTION_DPS);
+  }
+}
+
+float GyroCalibrator::biasDps() const {
+  return learned.biasQ4 / 16.0f / GYRO_LSB_PER_DPS;
+}
+
+float GyroCalibrator::noiseDps() const {
+  return learned.noise / GYRO_LSB_PER_DPS;
+}
+
+float GyroCalibrator::spinRateDps() const {
+  return learned.spinRate / GYRO_LSB_PER_DPS;
+}
+
+int32_t GyroCalibrator::update(int32_t rawSpeed, uint32_t now) {
+  if (!on) {
+    return rawSpeed;
+  }
+  int32_t speed = rawSpeed - bias;
+
+  // Rest windows look at the raw value, so the bias they find is absolute
+  if (restCount == 0) {
+    restStart = now;
+    restMin = restMax = rawSpeed;
+    restSum = 0;
+  }
+  if (rawSpeed < restMin) restMin = rawSpeed;
+  if (rawSpeed > restMax) restMax = rawSpeed;
+  restSum += rawSpeed;
+  restCount++;
+  if (now - restStart >= CALIBRATION_REST_WINDOW_MS) {
+    closeRestWindow();
+  }
+
+  int32_t magnitude = absolute(speed);
+  if (magnitude > motionRaw) {
+    if (!inSpin) {
+      inSpin = true;
+      spinStart = now;
+      spinSum = 0;
+      spinCount = 0;
+    }
+    lastMotion = now;
+  }
+  if (inSpin) {
+    if (now - lastMotion > CALIBRATION_SPIN_GAP_MS) {
+      closeSpin();
+    } else {
+      spinSum += magnitude;
+      spinCount++;
+    }
+  }
+  return speed;
+}
+
+void GyroCalibrator::closeRestWindow() {
+  int32_t peakToPeak = restMax - restMin;
+  int32_t meanQ4 = (int32_t)(restSum * 16 / (int64_t)restCount);
+  restCount = 0;
+  if (peakToPeak > DPS_TO_RAW(CALIBRATION_REST_BAND_DPS)) {
+    runCount = 0;
+    return;
+  }
+
+  const int32_t trackQ4 = DPS_TO_RAW(CALIBRATION_TRACK_DPS) * 16;
+  if (runCount > 0 && absolute(meanQ4 - (int32_t)(runSumQ4 / runCount)) <= trackQ4) {
+    runSumQ4 += meanQ4;
+    runCount++;
+  } else {
+    runSumQ4 = meanQ4;
+    runCount = 1;
+  }
+  int32_t runMeanQ4 = (int32_t)(runSumQ4 / runCount);
+
+  bool updated = false;
+  if (runCount >= CALIBRATION_REST_RUN && absolute(runMeanQ4) <= DPS_TO_RAW(CALIBRATION_MAX_BIAS_DPS) * 16) {
+    // Lying still for a while: trust the run outright if it disagrees
+    if (learned.rests == 0 || absolute(runMeanQ4 - learned.biasQ4) > trackQ4) {
+      learned.biasQ4 = runMeanQ4;
+    } else {
+      learned.biasQ4 += (meanQ4 - learned.biasQ4) / 8;
+    }
+    updated = true;
+  } else if (learned.rests > 0 && absolute(meanQ4 - learned.biasQ4) <= trackQ4) {
+    // A brief rest near the current bias: follow temperature drift
+    learned.biasQ4 += (meanQ4 - learned.biasQ4) / 8;
+    updated = true;
+  }
+  if (!updated) {
+    return;
+  }
+
+  int32_t noise = peakToPeak / 2;
+  learned.noise = learned.rests == 0 ? noise : learned.noise + (noise - learned.noise) / 8;
+  learned.rests++;
+  bias = (learned.biasQ4 + 8) >> 4;
+  updateMotionFloor();
+  if (absolute(learned.biasQ4 - savedBiasQ4) > DPS_TO_RAW(CALIBRATION_SAVE_BIAS_DPS) * 16) {
+    unsaved = true;
+  }
+}
+
+void GyroCalibrator::closeSpin() {
+  inSpin = false;
+  if (lastMotion - spinStart < CALIBRATION_MIN_SPIN_MS || spinCount == 0) {
+    return;
+  }
+  int32_t rate = (int32_t)(spinSum / spinCount);
+  // Plain mean over the first few spins, then a moving average that
+  // follows the performer through a set
+  uint32_t weight = learned.spins < 8 ? learned.spins + 1 : 8;
+  learned.spinRate += (rate - learned.spinRate) / (int32_t)weight;
+  learned.spins++;
+  if (learned.spins >= CALIBRATION_SPINS_NEEDED) {
+    dirty = true;
+  }
+  unsaved = true;
+}
+
+StallDetectorConfig GyroCalibrator::effective(const StallDetectorConfig& base) const {
+  StallDetectorConfig config = base;
+  if (!ready()) {
+    return config;
+  }
+  float spin = spinRateDps();
+  float noise = noiseDps();
+
+  float start = spin * CALIBRATION_START_FRACTION;
+  if (start < noise * CALIBRATION_NOISE_MARGIN) start = noise * CALIBRATION_NOISE_MARGIN;
+  if (start < CALIBRATION_MIN_START_DPS) start = CALIBRATION_MIN_START_DPS;
+  if (start > CALIBRATION_MAX_START_DPS) start = CALIBRATION_MAX_START_DPS;
+
+  float stop = spin * CALIBRATION_STOP_FRACTION;
+  if (stop < noise * CALIBRATION_NOISE_MARGIN / 2) stop = noise * CALIBRATION_NOISE_MARGIN / 2;
+  if (stop < CALIBRATION_MIN_STOP_DPS) stop = CALIBRATION_MIN_STOP_DPS;
+  if (stop > start * 0.75f) stop = start * 0.75f;
+
+  float decel = spin * CALIBRATION_DECEL_PER_SECOND;
+  if (decel < CALIBRATION_MIN_DECEL) decel = CALIBRATION_MIN_DECEL;
+  if (decel > CALIBRATION_MAX_DECEL) decel = CALIBRATION_MAX_DECEL;
+
+  config.gyroThreshold = start;
+  config.stopThreshold = stop;
+  config.decelReference = decel;
+  return config;
+}
+
+bool GyroCalibrator::apply(StallDetector& detector, const StallDetectorConfig& base) {
+  if (!dirty || detector.isRotating()) {
+    return false;
+  }
+  detector.configure(effective(base));
+  dirty = false;
+  return true;
+}
+
+bool GyroCalibrator::takeUnsaved() {
+  if (!unsaved) {
+    return false;
+  }
+  unsaved = false;
+  savedBiasQ4 = learned.biasQ4;
+  return true;
+}
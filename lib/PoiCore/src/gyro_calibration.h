@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "stall_detector.h"
+
+#define CALIBRATION_REST_WINDOW_MS 1000
+#define CALIBRATION_REST_BAND_DPS 6.0f     // peak to peak within a window at rest
+#define CALIBRATION_REST_RUN 5             // windows in a row that agree: lying on a table
+#define CALIBRATION_TRACK_DPS 2.0f         // a lone window this close to the bias refines it
+#define CALIBRATION_MAX_BIAS_DPS 25.0f     // MPU-6050 zero-rate offset is within +/-20 deg/s
+#define CALIBRATION_MOTION_DPS 20.0f       // spin segments: above this, or the noise margin
+#define CALIBRATION_SPIN_GAP_MS 250        // dips shorter than this (reversals) stay in the spin
+#define CALIBRATION_MIN_SPIN_MS 1500       // shorter segments are not spins
+#define CALIBRATION_SPINS_NEEDED 3         // before learned thresholds replace the configured ones
+#define CALIBRATION_START_FRACTION 0.35f   // of the typical spin rate
+#define CALIBRATION_STOP_FRACTION 0.15f
+#define CALIBRATION_NOISE_MARGIN 8         // start at least this many noise floors above zero
+#define CALIBRATION_MIN_START_DPS 45.0f
+#define CALIBRATION_MAX_START_DPS 300.0f
+#define CALIBRATION_MIN_STOP_DPS 15.0f
+#define CALIBRATION_DECEL_PER_SECOND 3.0f  // a deliberate stop loses the spin rate in ~1/3 s
+#define CALIBRATION_MIN_DECEL 400.0f
+#define CALIBRATION_MAX_DECEL 4000.0f
+#define CALIBRATION_SAVE_BIAS_DPS 0.5f     // bias drift that is worth a flash write
+
+// What GyroCalibrator has learned, kept in the config store. Raw gyro
+// LSB (GYRO_LSB_PER_DPS per deg/s) on the rotation axis.
+struct CalibrationState {
+  int32_t biasQ4 = 0;    // zero-rate offset in 1/16 LSB
+  int32_t noise = 0;     // half the peak to peak at rest
+  int32_t spinRate = 0;  // typical |speed| of a spin
+  uint32_t spins = 0;    // spin segments learned from
+  uint32_t rests = 0;    // rest windows that updated the bias
+};
+
+// Online calibration of the rotation axis: the zero-rate offset and noise
+// floor from windows where the speed holds steady near zero, and the
+// performer's typical spin rate from sustained spins, whatever the
+// detector thresholds make of them. Start and stop thresholds follow from
+// those once CALIBRATION_SPINS_NEEDED spins are in, so slow flow styles
+// get a start threshold below their spin rate and fast ones an earlier
+// stop.
+//
+// A window that holds steady away from the current bias is only trusted
+// after CALIBRATION_REST_RUN of them agree; a hand slowly turning the poi
+// during a pause is steady too, but not for five seconds.
+//
+// update() runs per sample on the loop task and is integer only.
+class GyroCalibrator {
+public:
+  GyroCalibrator();
+
+  // Off: update() passes speeds through and apply() uses base as it is
+  void setEnabled(bool enabled);
+  bool enabled() const { return on; }
+  void restore(const CalibrationState& state);
+  void reset();
+  const CalibrationState& state() const { return learned; }
+
+  // Raw rotation speed in, bias-corrected speed out
+  int32_t update(int32_t rawSpeed, uint32_t now);
+
+  bool ready() const { return on && learned.spins >= CALIBRATION_SPINS_NEEDED; }
+  float biasDps() const;
+  float noiseDps() const;
+  float spinRateDps() const;
+  // base with the learned thresholds and decelReference, once ready()
+  StallDetectorConfig effective(const StallDetectorConfig& base) const;
+  // Configure detector with effective(base) if the thresholds moved,
+  // but never mid-spin. Returns true if it did.
+  bool apply(StallDetector& detector, const StallDetectorConfig& base);
+  // Learned enough since the last call to be worth saving?
+  bool takeUnsaved();
+
+private:
+  void closeRestWindow();
+  void closeSpin();
+  void updateMotionFloor();
+
+  bool on;
+  CalibrationState learned;
+  int32_t bias;         // learned.biasQ4 rounded to LSB
+  int32_t motionRaw;
+  bool dirty;           // thresholds changed since apply()
+  bool unsaved;
+  int32_t savedBiasQ4;
+
+  // Current rest window
+  uint32_t restStart;
+  uint32_t restCount;
+  int32_t restMin;
+  int32_t restMax;
+  int64_t restSum;
+  // Agreeing windows in a row
+  int32_t runCount;
+  int64_t runSumQ4;
+
+  // Current spin segment
+  bool inSpin;
+  uint32_t spinStart;
+  uint32_t lastMotion;
+  int64_t spinSum;
+  uint32_t spinCount;
+};
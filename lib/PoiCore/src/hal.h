@@ -0,0 +1,207 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// Hardware Abstraction Layer
+// ============================================================================
+// The stall detection and pattern dispatch code only talks to these
+// interfaces. On the ESP32-C3 they are backed by the MPU-6050, millis(),
+// the status LED, HTTPClient and LittleFS (see src/hal_esp32.cpp); under env:native
+// they are backed by fakes (see src/native/).
+
+// Gyro full scale is +/-2000 deg/s
+#define GYRO_LSB_PER_DPS 16.4f
+
+// One raw gyro reading, straight from the sensor registers
+struct ImuSample {
+  uint32_t timestamp;  // Clock::millis() when the sample was taken
+  int16_t gyroX;       // GYRO_LSB_PER_DPS per deg/s
+  int16_t gyroY;
+  int16_t gyroZ;
+};
+
+class ImuSource {
+public:
+  virtual ~ImuSource() {}
+  virtual bool begin() = 0;
+  virtual bool read(ImuSample& sample) = 0;
+  // Read up to max buffered samples, oldest first. Sources without a
+  // hardware buffer return at most one.
+  virtual size_t readBatch(ImuSample* samples, size_t max) {
+    return max > 0 && read(samples[0]) ? 1 : 0;
+  }
+  // Samples lost inside the sensor itself (e.g. hardware FIFO overflow)
+  virtual uint32_t overflowCount() const { return 0; }
+
+  // Power saving, for sources that support it (see PowerManager). Lower
+  // the output rate to hz; begin() goes back to the full rate.
+  virtual bool setSampleRate(uint16_t hz) { (void)hz; return false; }
+  // Stop sampling and watch for motion above thresholdMg at a few Hz;
+  // begin() starts sampling again
+  virtual bool enableMotionWake(uint16_t thresholdMg) { (void)thresholdMg; return false; }
+  // After enableMotionWake(): has the sensor seen motion since?
+  virtual bool motionWakePending() { return true; }
+};
+
+// Raw register access to an I2C device
+class I2cBus {
+public:
+  virtual ~I2cBus() {}
+  virtual bool writeRegister(uint8_t address, uint8_t reg, uint8_t value) = 0;
+  // Burst read of len consecutive registers (or len bytes of a FIFO port)
+  virtual bool readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t len) = 0;
+};
+
+// How hard the platform runs the CPU and radio, see PowerManager
+enum PowerLevel : uint8_t {
+  POWER_ACTIVE,  // full CPU clock, radio in modem sleep between beacons
+  POWER_IDLE,    // lower CPU clock
+  POWER_SLEEP,   // light sleep whenever nothing is due, woken by the sensor
+  POWER_LEVELS,
+};
+
+class PowerControl {
+public:
+  virtual ~PowerControl() {}
+  virtual void setLevel(PowerLevel level) = 0;
+  // Keep the radio out of power save, e.g. while waiting for the poi to
+  // answer a pattern change; otherwise it follows the level
+  virtual void setRadioAwake(bool awake) = 0;
+};
+
+class Clock {
+public:
+  virtual ~Clock() {}
+  virtual uint32_t millis() = 0;
+};
+
+class StatusLed {
+public:
+  virtual ~StatusLed() {}
+  virtual void set(bool on) = 0;  // true = lit, polarity handled by the implementation
+};
+
+// Receives the response body of an HTTP request as it arrives
+class HttpBodySink {
+public:
+  virtual ~HttpBodySink() {}
+  virtual void write(const char* data, size_t len) = 0;
+};
+
+class HttpTransport {
+public:
+  virtual ~HttpTransport() {}
+  // Blocking GET of http://host:port + path. Returns the HTTP status code,
+  // or a negative value on connection/timeout errors. body may be NULL.
+  virtual int get(const char* host, uint16_t port, const char* path, uint32_t timeoutMs,
+                  HttpBodySink* body) = 0;
+};
+
+enum TcpState {
+  TCP_IDLE,
+  TCP_CONNECTING,
+  TCP_CONNECTED,
+  TCP_CLOSED,  // closed by either side, or failed to connect
+};
+
+// Non-blocking TCP client. Implementations may receive network events on
+// another task but must make them visible through state() and receive(),
+// so callers can poll from a single task.
+class TcpConnection {
+public:
+  virtual ~TcpConnection() {}
+  // Start connecting and return immediately
+  virtual bool connect(const char* host, uint16_t port) = 0;
+  // Queue data for sending; allowed while still connecting
+  virtual bool send(const char* data, size_t len) = 0;
+  // Copy out up to max bytes received so far
+  virtual size_t receive(char* data, size_t max) = 0;
+  virtual void close() = 0;
+  virtual TcpState state() = 0;
+};
+
+// Non-blocking UDP endpoint
+class UdpSocket {
+public:
+  virtual ~UdpSocket() {}
+  // Bind to a local port, 0 for any
+  virtual bool begin(uint16_t localPort) = 0;
+  // Send one datagram; host may be a broadcast address
+  virtual bool sendTo(const char* host, uint16_t port, const uint8_t* data, size_t len) = 0;
+  // Copy out the next queued datagram and the sender's IPv4 address
+  // (fromHost must hold 16 bytes) and port (fromPort may be NULL).
+  // Returns its length, 0 if none is waiting.
+  virtual size_t receive(uint8_t* data, size_t max, char* fromHost, uint16_t* fromPort) = 0;
+};
+
+// Small files in flash (LittleFS on the ESP32)
+class FileStore {
+public:
+  virtual ~FileStore() {}
+  // Read up to max bytes from the start of a file. Returns the number of
+  // bytes read, or -1 if the file does not exist.
+  virtual int read(const char* path, uint8_t* data, size_t max) = 0;
+  // Replace the whole file. A reset part way through leaves either the old
+  // or the new contents, never a mix.
+  virtual bool write(const char* path, const uint8_t* data, size_t len) = 0;
+  // Add to the end of a file, creating it if needed. A reset part way
+  // through may leave part of the new data.
+  virtual bool append(const char* path, const uint8_t* data, size_t len) = 0;
+  // Read up to max bytes starting at offset. Returns the number of bytes
+  // read (0 at or past the end), or -1 if the file does not exist.
+  virtual int readAt(const char* path, uint32_t offset, uint8_t* data, size_t max) = 0;
+  // File size in bytes, -1 if it does not exist
+  virtual int32_t size(const char* path) = 0;
+  // Delete a file; true if it is gone afterwards
+  virtual bool remove(const char* path) = 0;
+};
+
+// Where live telemetry frames go, e.g. WebSocket clients
+class TelemetrySink {
+public:
+  virtual ~TelemetrySink() {}
+  // Is anyone listening? No frames are built while nobody is.
+  virtual bool active() = 0;
+  // Queue one binary frame without waiting. Returns false if it cannot be
+  // taken right now; the frame is then dropped, never retried.
+  virtual bool trySend(const uint8_t* data, size_t len) = 0;
+};
+
+// Station-mode WiFi. Calls return at once; what happens next arrives as
+// events, which the driver collects from whatever task the platform
+// raises them on until the main loop takes them.
+#define POI_WIFI_CONNECTED 0x01     // joined and has an address
+#define POI_WIFI_DISCONNECTED 0x02  // lost the network, or failed to join it
+#define POI_WIFI_SCAN_DONE 0x04
+
+struct WifiScanResult {
+  char ssid[33];
+  uint8_t bssid[6];
+  uint8_t channel;
+  int8_t rssi;
+};
+
+struct WiFiLastConnection;  // config_store.h
+
+class WifiDriver {
+public:
+  virtual ~WifiDriver() {}
+  // Start joining a network; bssid NULL and channel 0 mean any access
+  // point. With lease, its addresses are used instead of asking DHCP.
+  virtual void connect(const char* ssid, const char* password, const uint8_t* bssid, uint8_t channel,
+                       const WiFiLastConnection* lease) = 0;
+  // Leave the network. Raises no event.
+  virtual void disconnect() = 0;
+  virtual bool startScan() = 0;
+  // After POI_WIFI_SCAN_DONE: copy up to max results, return how many
+  virtual int scanResults(WifiScanResult* results, int max) = 0;
+  // While connected: fill in the access point, channel and addresses
+  virtual void connection(WiFiLastConnection& last) = 0;
+  // POI_WIFI_* bits raised since the last call
+  virtual uint8_t takeEvents() = 0;
+};
+
+// printf-style logging, Serial on the ESP32 and stdout on the host
+void poiLog(const char* fmt, ...);
@@ -0,0 +1,45 @@
+#include "latency_histogram.h"
+
+static const uint32_t BOUNDS[LATENCY_BUCKETS - 1] = {
+  1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+uint32_t LatencyHistogram::bucketBound(int i) {
+  return i < LATENCY_BUCKETS - 1 ? BOUNDS[i] : UINT32_MAX;
+}
+
+void LatencyHistogram::reset() {
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    buckets[i] = 0;
+  }
+  total = 0;
+  minMs = UINT32_MAX;
+  maxMs = 0;
+  sumMs = 0;
+}
+
+void LatencyHistogram::record(uint32_t ms) {
+  int i = 0;
+  while (i < LATENCY_BUCKETS - 1 && ms > BOUNDS[i]) {
+    i++;
+  }
+  buckets[i]++;
+  total++;
+  sumMs += ms;
+  if (ms < minMs) minMs = ms;
+  if (ms > maxMs) maxMs = ms;
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t p) const {
+  if (total == 0) return 0;
+  uint32_t target = (uint32_t)(((uint64_t)total * p + 99) / 100);
+  uint32_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= target) {
+      // Never report more than the real maximum (the overflow bucket has no bound)
+      return i < LATENCY_BUCKETS - 1 && BOUNDS[i] < maxMs ? BOUNDS[i] : maxMs;
+    }
+  }
+  return maxMs;
+}
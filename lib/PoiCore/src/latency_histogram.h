@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 13
+
+// Fixed-bucket latency histogram in milliseconds. Bucket i counts samples
+// <= bucketBound(i); the last bucket catches everything above.
+class LatencyHistogram {
+public:
+  LatencyHistogram() { reset(); }
+
+  void reset();
+  void record(uint32_t ms);
+
+  uint32_t count() const { return total; }
+  uint32_t min() const { return total ? minMs : 0; }
+  uint32_t max() const { return maxMs; }
+  uint32_t mean() const { return total ? (uint32_t)(sumMs / total) : 0; }
+  // Upper bound of the bucket holding the p-th percentile (0-100), capped at max()
+  uint32_t percentile(uint8_t p) const;
+  uint32_t bucket(int i) const { return buckets[i]; }
+
+  // Upper bound of bucket i, UINT32_MAX for the overflow bucket
+  static uint32_t bucketBound(int i);
+
+private:
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t total;
+  uint32_t minMs;
+  uint32_t maxMs;
+  uint64_t sumMs;
+};
@@ -0,0 +1,41 @@
+#include "latency_tracker.h"
+
+#include "pattern_dispatcher.h"
+
+void LatencyTracker::stallConfirmed(uint32_t stop, uint32_t now) {
+  stopTime = stop;
+  confirmTime = now;
+  pending = -1;  // waiting for the request
+  stopToConfirm.record(now - stop);
+}
+
+void LatencyTracker::requestStarted(uint32_t now, int targets) {
+  if (pending != -1) return;
+  pending = targets;
+  requestTime = now;
+  confirmToRequest.record(now - confirmTime);
+}
+
+void LatencyTracker::serverResponded(int server, int httpStatus, uint32_t now) {
+  // Manual dispatches from the web server are not part of a stall
+  if (pending <= 0 || server < 0 || server >= serverCount) return;
+  pending--;
+  // A multicast switch counts as delivered when the datagram is sent
+  if (httpStatus != 200 && httpStatus != DISPATCH_SENT_MULTICAST) {
+    failures++;
+    return;
+  }
+  requestToResponse[server].record(now - requestTime);
+  stopToResponse[server].record(now - stopTime);
+}
+
+void LatencyTracker::reset() {
+  stopToConfirm.reset();
+  confirmToRequest.reset();
+  for (int i = 0; i < MAX_POI_SERVERS; i++) {
+    requestToResponse[i].reset();
+    stopToResponse[i].reset();
+  }
+  failures = 0;
+  pending = 0;
+}
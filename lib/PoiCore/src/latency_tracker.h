@@ -0,0 +1,47 @@
+#pragma once
+
+#include "connection_pool.h"
+#include "latency_histogram.h"
+
+// Stall-to-switch latency, broken down by stage:
+//
+//   stop       rotation speed fell below stopThreshold
+//   confirm    the detector declared a stall
+//   request    the /pattern dispatch started
+//   response   each poi answered, or was sent the multicast datagram
+//
+// Updated from the main loop; readers on other tasks may see a histogram
+// that is one sample behind, which is fine for monitoring. reset() belongs
+// to the main loop as well.
+class LatencyTracker {
+public:
+  LatencyTracker()
+    : serverCount(0), failures(0), stopTime(0), confirmTime(0), requestTime(0), pending(0) {}
+
+  // Histograms [0, count) are in use; count grows as poi are discovered
+  void setServerCount(int count) { serverCount = count < MAX_POI_SERVERS ? count : MAX_POI_SERVERS; }
+
+  // A stall was confirmed; stop is when rotation actually ended
+  void stallConfirmed(uint32_t stop, uint32_t now);
+  // The dispatch went out to targets poi
+  void requestStarted(uint32_t now, int targets);
+  void serverResponded(int server, int httpStatus, uint32_t now);
+
+  void reset();
+
+  LatencyHistogram stopToConfirm;
+  LatencyHistogram confirmToRequest;
+  LatencyHistogram requestToResponse[MAX_POI_SERVERS];
+  LatencyHistogram stopToResponse[MAX_POI_SERVERS];
+
+  int servers() const { return serverCount; }
+  uint32_t failureCount() const { return failures; }
+
+private:
+  int serverCount;
+  uint32_t failures;
+  uint32_t stopTime;
+  uint32_t confirmTime;
+  uint32_t requestTime;
+  int pending;  // responses still expected for the stall being timed
+};
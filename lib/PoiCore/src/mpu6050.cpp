@@ -0,0 +1,151 @@
+#include "mpu6050.h"
+
+static int16_t bigEndian16(const uint8_t* p) {
+  return (int16_t)((p[0] << 8) | p[1]);
+}
+
+bool mpu6050Configure(I2cBus& bus, uint16_t sampleRateHz) {
+  uint8_t whoAmI = 0;
+  if (!bus.readRegisters(MPU6050_ADDRESS, MPU6050_WHO_AM_I, &whoAmI, 1) || whoAmI != 0x68) {
+    return false;
+  }
+
+  // With the DLPF enabled the gyro output rate is 1 kHz, divided down by SMPLRT_DIV
+  if (sampleRateHz < 4) sampleRateHz = 4;
+  if (sampleRateHz > 1000) sampleRateHz = 1000;
+  uint8_t divider = (uint8_t)(1000 / sampleRateHz - 1);
+  uint8_t dlpf = sampleRateHz >= 500 ? 1 : 3;  // 188 Hz or 44 Hz bandwidth
+
+  // Also undoes mpu6050EnableMotionWake(): gyro out of standby, cycle mode and interrupt off
+  return bus.writeRegister(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1, 0x01)      // wake, PLL on gyro X
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_PWR_MGMT_2, 0)
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_INT_ENABLE, 0)
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_CONFIG, dlpf)
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_SMPLRT_DIV, divider)
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_GYRO_CONFIG, 0x18)     // +/-2000 deg/s
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_ACCEL_CONFIG, 0x10);   // +/-8 g
+}
+
+bool mpu6050EnableMotionWake(I2cBus& bus, uint16_t thresholdMg) {
+  uint16_t threshold = thresholdMg / MPU6050_MOT_MG_PER_LSB;
+  if (threshold < 1) threshold = 1;
+  if (threshold > 255) threshold = 255;
+
+  // The high-pass filter has to pass through reset before it can hold the
+  // current orientation as the reference motion is measured against
+  if (!(bus.writeRegister(MPU6050_ADDRESS, MPU6050_INT_ENABLE, 0)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_ACCEL_CONFIG, 0x10)   // +/-8 g, HPF reset
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_MOT_THR, (uint8_t)threshold)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_MOT_DUR, 1)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_INT_PIN_CFG, MPU6050_INT_LATCH)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_ACCEL_CONFIG, 0x10 | MPU6050_ACCEL_HPF_HOLD)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_PWR_MGMT_2, MPU6050_LP_WAKE_5HZ | MPU6050_STBY_GYRO)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1, MPU6050_PWR_CYCLE | MPU6050_PWR_TEMP_DIS)
+        && bus.writeRegister(MPU6050_ADDRESS, MPU6050_INT_ENABLE, MPU6050_INT_MOT))) {
+    return false;
+  }
+  mpu6050MotionWakePending(bus);  // clear anything latched while switching over
+  return true;
+}
+
+bool mpu6050MotionWakePending(I2cBus& bus) {
+  uint8_t status = 0;
+  // A failed read counts as motion, so a sensor that stops answering
+  // hands control back to the normal bring-up path
+  if (!bus.readRegisters(MPU6050_ADDRESS, MPU6050_INT_STATUS, &status, 1)) {
+    return true;
+  }
+  return (status & MPU6050_INT_MOT) != 0;
+}
+
+// ============================================================================
+// Mpu6050Polled
+// ============================================================================
+
+bool Mpu6050Polled::read(ImuSample& sample) {
+  uint8_t data[6];
+  if (!bus.readRegisters(MPU6050_ADDRESS, MPU6050_GYRO_XOUT_H, data, sizeof(data))) {
+    return false;
+  }
+  sample.timestamp = clock.millis();
+  sample.gyroX = bigEndian16(data);
+  sample.gyroY = bigEndian16(data + 2);
+  sample.gyroZ = bigEndian16(data + 4);
+  return true;
+}
+
+// ============================================================================
+// Mpu6050Fifo
+// ============================================================================
+
+Mpu6050Fifo::Mpu6050Fifo(I2cBus& bus, Clock& clock, uint16_t sampleRateHz)
+  : bus(bus),
+    clock(clock),
+    fullRateHz(sampleRateHz),
+    sampleRateHz(sampleRateHz),
+    overflows(0) {
+  if (fullRateHz < 4) fullRateHz = 4;
+  if (fullRateHz > 1000) fullRateHz = 1000;
+  this->sampleRateHz = fullRateHz;
+}
+
+bool Mpu6050Fifo::begin() {
+  return setSampleRate(fullRateHz);
+}
+
+bool Mpu6050Fifo::setSampleRate(uint16_t hz) {
+  if (hz < 4) hz = 4;
+  if (hz > fullRateHz) hz = fullRateHz;
+  // Frames are timestamped from the rate, so none at the old rate may remain
+  sampleRateHz = hz;
+  return mpu6050Configure(bus, sampleRateHz)
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_FIFO_EN, MPU6050_FIFO_EN_GYRO)
+      && resetFifo();
+}
+
+bool Mpu6050Fifo::resetFifo() {
+  return bus.writeRegister(MPU6050_ADDRESS, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_RST)
+      && bus.writeRegister(MPU6050_ADDRESS, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN);
+}
+
+size_t Mpu6050Fifo::readBatch(ImuSample* samples, size_t max) {
+  uint8_t status = 0;
+  uint8_t countBytes[2];
+  if (!bus.readRegisters(MPU6050_ADDRESS, MPU6050_INT_STATUS, &status, 1)
+      || !bus.readRegisters(MPU6050_ADDRESS, MPU6050_FIFO_COUNTH, countBytes, 2)) {
+    return 0;
+  }
+  uint32_t now = clock.millis();
+  uint16_t count = (uint16_t)((countBytes[0] << 8) | countBytes[1]);
+
+  // Once the FIFO overflows, frames are no longer aligned: start over
+  if ((status & MPU6050_INT_FIFO_OFLOW) || count >= MPU6050_FIFO_SIZE) {
+    overflows++;
+    resetFifo();
+    return 0;
+  }
+
+  size_t buffered = count / MPU6050_FIFO_FRAME_BYTES;
+  size_t total = buffered < max ? buffered : max;
+
+  uint8_t burst[MPU6050_FIFO_BURST_FRAMES * MPU6050_FIFO_FRAME_BYTES];
+  size_t done = 0;
+  while (done < total) {
+    size_t frames = total - done;
+    if (frames > MPU6050_FIFO_BURST_FRAMES) frames = MPU6050_FIFO_BURST_FRAMES;
+    if (!bus.readRegisters(MPU6050_ADDRESS, MPU6050_FIFO_R_W, burst, frames * MPU6050_FIFO_FRAME_BYTES)) {
+      break;
+    }
+    for (size_t f = 0; f < frames; f++) {
+      const uint8_t* p = burst + f * MPU6050_FIFO_FRAME_BYTES;
+      ImuSample& s = samples[done + f];
+      // The newest buffered frame was sampled at about 'now'
+      s.timestamp = now - (uint32_t)((buffered - 1 - (done + f)) * 1000 / sampleRateHz);
+      s.gyroX = bigEndian16(p);
+      s.gyroY = bigEndian16(p + 2);
+      s.gyroZ = bigEndian16(p + 4);
+    }
+    done += frames;
+  }
+  return done;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "hal.h"
+
+// MPU-6050 register map (subset used by the drivers)
+#define MPU6050_ADDRESS        0x68
+#define MPU6050_SMPLRT_DIV     0x19
+#define MPU6050_CONFIG         0x1A
+#define MPU6050_GYRO_CONFIG    0x1B
+#define MPU6050_ACCEL_CONFIG   0x1C
+#define MPU6050_MOT_THR        0x1F
+#define MPU6050_MOT_DUR        0x20
+#define MPU6050_FIFO_EN        0x23
+#define MPU6050_INT_PIN_CFG    0x37
+#define MPU6050_INT_ENABLE     0x38
+#define MPU6050_INT_STATUS     0x3A
+#define MPU6050_GYRO_XOUT_H    0x43
+#define MPU6050_USER_CTRL      0x6A
+#define MPU6050_PWR_MGMT_1     0x6B
+#define MPU6050_PWR_MGMT_2     0x6C
+#define MPU6050_FIFO_COUNTH    0x72
+#define MPU6050_FIFO_R_W       0x74
+#define MPU6050_WHO_AM_I       0x75
+
+#define MPU6050_FIFO_EN_GYRO       0x70  // XG_FIFO_EN | YG_FIFO_EN | ZG_FIFO_EN
+#define MPU6050_USER_CTRL_FIFO_EN  0x40
+#define MPU6050_USER_CTRL_FIFO_RST 0x04
+#define MPU6050_INT_FIFO_OFLOW     0x10
+#define MPU6050_INT_MOT            0x40
+#define MPU6050_INT_LATCH          0x20  // INT_PIN_CFG: hold INT high until INT_STATUS is read
+#define MPU6050_PWR_CYCLE          0x20  // PWR_MGMT_1: accelerometer only, waking at LP_WAKE_CTRL
+#define MPU6050_PWR_TEMP_DIS       0x08
+#define MPU6050_LP_WAKE_5HZ        0x40  // PWR_MGMT_2 LP_WAKE_CTRL
+#define MPU6050_STBY_GYRO          0x07  // PWR_MGMT_2: X, Y and Z gyro in standby
+#define MPU6050_ACCEL_HPF_HOLD     0x07  // ACCEL_CONFIG: motion measured against the held reference
+#define MPU6050_MOT_MG_PER_LSB     2
+#define MPU6050_FIFO_SIZE          1024
+
+#define MPU6050_FIFO_FRAME_BYTES   6     // gyro X, Y, Z big-endian int16
+#define MPU6050_FIFO_BURST_FRAMES  20    // 120 bytes, fits the 128 byte Wire buffer
+
+// Wake the sensor and set +/-2000 deg/s, +/-8 g and the given output rate
+bool mpu6050Configure(I2cBus& bus, uint16_t sampleRateHz);
+
+// Gyro to standby and the accelerometer to 5 Hz cycle mode, raising the
+// motion interrupt (INT pin and INT_STATUS) on a change above thresholdMg.
+// About 20 uA instead of 3.9 mA; mpu6050Configure() brings it back.
+bool mpu6050EnableMotionWake(I2cBus& bus, uint16_t thresholdMg);
+// Motion interrupt raised since the last call (reading clears it)
+bool mpu6050MotionWakePending(I2cBus& bus);
+
+// Reads the gyro output registers directly, one 6 byte burst per sample
+class Mpu6050Polled : public ImuSource {
+public:
+  Mpu6050Polled(I2cBus& bus, Clock& clock) : bus(bus), clock(clock) {}
+
+  bool begin() override { return mpu6050Configure(bus, 200); }  // polled every 5 ms
+  bool read(ImuSample& sample) override;
+  bool setSampleRate(uint16_t hz) override { return mpu6050Configure(bus, hz); }
+  bool enableMotionWake(uint16_t thresholdMg) override { return mpu6050EnableMotionWake(bus, thresholdMg); }
+  bool motionWakePending() override { return mpu6050MotionWakePending(bus); }
+
+private:
+  I2cBus& bus;
+  Clock& clock;
+};
+
+// Gyro-only sampling through the MPU-6050 hardware FIFO. The sensor samples
+// at sampleRateHz on its own clock and readBatch() drains everything
+// buffered since the last call in multi-frame I2C bursts.
+class Mpu6050Fifo : public ImuSource {
+public:
+  Mpu6050Fifo(I2cBus& bus, Clock& clock, uint16_t sampleRateHz = 1000);
+
+  bool begin() override;
+  bool read(ImuSample& sample) override { return readBatch(&sample, 1) == 1; }
+  size_t readBatch(ImuSample* samples, size_t max) override;
+  bool setSampleRate(uint16_t hz) override;
+  bool enableMotionWake(uint16_t thresholdMg) override { return mpu6050EnableMotionWake(bus, thresholdMg); }
+  bool motionWakePending() override { return mpu6050MotionWakePending(bus); }
+
+  // Discard the FIFO contents, e.g. after a long gap between reads
+  bool resetFifo();
+
+  uint16_t sampleRate() const { return sampleRateHz; }
+  uint32_t overflowCount() const override { return overflows; }
+
+private:
+  I2cBus& bus;
+  Clock& clock;
+  uint16_t fullRateHz;    // as constructed, restored by begin()
+  uint16_t sampleRateHz;  // current, lower while PowerManager has it idle
+  uint32_t overflows;
+};
@@ -0,0 +1,98 @@
+#include "multicast_switcher.h"
+
+size_t encodeSwitchCommand(uint8_t* data, const SwitchCommand& command) {
+  data[0] = 'S';
+  data[1] = 'W';
+  data[2] = SWITCH_VERSION;
+  data[3] = command.pattern;
+  data[4] = (uint8_t)command.seq;
+  data[5] = (uint8_t)(command.seq >> 8);
+  data[6] = (uint8_t)command.timestamp;
+  data[7] = (uint8_t)(command.timestamp >> 8);
+  data[8] = (uint8_t)(command.timestamp >> 16);
+  data[9] = (uint8_t)(command.timestamp >> 24);
+  if (!command.scheduled) {
+    return SWITCH_COMMAND_SIZE;
+  }
+  data[10] = (uint8_t)command.switchAt;
+  data[11] = (uint8_t)(command.switchAt >> 8);
+  data[12] = (uint8_t)(command.switchAt >> 16);
+  data[13] = (uint8_t)(command.switchAt >> 24);
+  return SWITCH_SCHEDULED_SIZE;
+}
+
+bool decodeSwitchCommand(const uint8_t* data, size_t len, SwitchCommand& command) {
+  // Newer versions may append fields
+  if (len < SWITCH_COMMAND_SIZE || data[0] != 'S' || data[1] != 'W') {
+    return false;
+  }
+  command.pattern = data[3];
+  command.seq = (uint16_t)(data[4] | (data[5] << 8));
+  command.timestamp = (uint32_t)data[6] | ((uint32_t)data[7] << 8)
+                    | ((uint32_t)data[8] << 16) | ((uint32_t)data[9] << 24);
+  command.scheduled = len >= SWITCH_SCHEDULED_SIZE;
+  command.switchAt = 0;
+  if (command.scheduled) {
+    command.switchAt = (uint32_t)data[10] | ((uint32_t)data[11] << 8)
+                     | ((uint32_t)data[12] << 16) | ((uint32_t)data[13] << 24);
+  }
+  return true;
+}
+
+bool SwitchDeduplicator::accept(const SwitchCommand& command) {
+  // Newer if ahead by less than half the sequence space
+  if (anySeen && (int16_t)(command.seq - lastSeq) <= 0) {
+    return false;
+  }
+  lastSeq = command.seq;
+  anySeen = true;
+  return true;
+}
+
+MulticastSwitcher::MulticastSwitcher(UdpSocket& socket, Clock& clock, const char* group)
+  : socket(socket),
+    clock(clock),
+    group(group),
+    leadMs(0),
+    started(false),
+    command(),
+    repeatsLeft(0),
+    lastSent(0),
+    commands(0),
+    datagrams(0) {
+}
+
+bool MulticastSwitcher::begin() {
+  started = socket.begin(0);
+  if (!started) {
+    poiLog("Switch multicast socket failed to open\n");
+  }
+  return started;
+}
+
+bool MulticastSwitcher::transmit() {
+  uint8_t data[SWITCH_SCHEDULED_SIZE];
+  lastSent = clock.millis();
+  datagrams++;
+  return socket.sendTo(group, SWITCH_PORT, data, encodeSwitchCommand(data, command));
+}
+
+bool MulticastSwitcher::send(int patternNumber) {
+  if (!started || patternNumber < 0 || patternNumber > 255) return false;
+  command.pattern = (uint8_t)patternNumber;
+  command.seq++;
+  command.timestamp = clock.millis();
+  command.scheduled = leadMs > 0;
+  command.switchAt = command.timestamp + leadMs;
+  repeatsLeft = SWITCH_REPEATS;
+  commands++;
+  return transmit();
+}
+
+void MulticastSwitcher::poll() {
+  if (repeatsLeft == 0 || clock.millis() - lastSent < SWITCH_REPEAT_INTERVAL_MS) {
+    return;
+  }
+  repeatsLeft--;
+  transmit();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "hal.h"
+
+#define SWITCH_MULTICAST_GROUP "239.83.80.1"
+#define SWITCH_PORT 4211
+#define SWITCH_REPEATS 3               // copies sent after the first
+#define SWITCH_REPEAT_INTERVAL_MS 10   // apart, so one WiFi hiccup does not eat them all
+#define SWITCH_LEAD_MS 50              // scheduled switches: after the last repeat lands
+#define SWITCH_MAX_LEAD_MS 1000        // poi ignore switch times further out than this
+
+// Switch command datagram, little-endian:
+//   'S' 'W' version pattern(u8) seq(u16) timestamp(u32) [switchAt(u32)]
+// Repeats of one command carry the same seq and timestamp (the
+// controller's millis() when it was first sent). Scheduled commands add
+// the controller millis() at which every poi should switch; poi turn it
+// into their own time with PoiClock (clock_sync.h).
+#define SWITCH_VERSION 2
+#define SWITCH_COMMAND_SIZE 10
+#define SWITCH_SCHEDULED_SIZE 14
+
+struct SwitchCommand {
+  uint8_t pattern;
+  uint16_t seq;
+  uint32_t timestamp;
+  bool scheduled;
+  uint32_t switchAt;
+};
+
+size_t encodeSwitchCommand(uint8_t* data, const SwitchCommand& command);
+bool decodeSwitchCommand(const uint8_t* data, size_t len, SwitchCommand& command);
+
+// Receiver side, for the poi firmware: drops repeats and anything older
+// than the last command applied. Sequence numbers wrap.
+class SwitchDeduplicator {
+public:
+  SwitchDeduplicator() : lastSeq(0), anySeen(false) {}
+  // True if the command is new and should be applied
+  bool accept(const SwitchCommand& command);
+  // Forget the sequence, e.g. when the controller restarted
+  void reset() { anySeen = false; }
+
+private:
+  uint16_t lastSeq;
+  bool anySeen;
+};
+
+// Sends one switch command per stall to every poi at once as a multicast
+// datagram, plus SWITCH_REPEATS repeats from poll(). Never blocks and
+// never waits for an answer.
+class MulticastSwitcher {
+public:
+  MulticastSwitcher(UdpSocket& socket, Clock& clock, const char* group = SWITCH_MULTICAST_GROUP);
+
+  bool begin();
+  // Schedule each switch leadMs after it is sent, 0 to switch on arrival
+  void setLeadTime(uint32_t leadMs) { this->leadMs = leadMs; }
+  uint32_t leadTime() const { return leadMs; }
+  // First copy goes out now; a command still repeating is superseded
+  bool send(int patternNumber);
+  // Send repeats when due. Call from the main loop.
+  void poll();
+
+  uint16_t sequence() const { return command.seq; }
+  uint32_t commandCount() const { return commands; }
+  uint32_t datagramCount() const { return datagrams; }
+
+private:
+  bool transmit();
+
+  UdpSocket& socket;
+  Clock& clock;
+  const char* group;
+  uint32_t leadMs;
+  bool started;
+  SwitchCommand command;
+  uint8_t repeatsLeft;
+  uint32_t lastSent;
+  uint32_t commands;
+  uint32_t datagrams;
+};
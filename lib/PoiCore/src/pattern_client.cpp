@@ -0,0 +1,370 @@
+#include "pattern_client.h"
+
+#include <string.h>
+
+// Cache file layout, little-endian:
+//   magic, listing hash, pattern count, count pattern numbers, checksum
+// where the checksum is fnv1a() of everything before it.
+#define PATTERN_CACHE_MAGIC 0x31544350u  // "PCT1"
+#define PATTERN_CACHE_HEADER_BYTES 9
+
+static void putU32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t fnv1a(const void* data, size_t len, uint32_t hash) {
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ p[i]) * 16777619u;
+  }
+  return hash;
+}
+
+int patternNumberForFile(const char* name) {
+  // Check if it's a single character file (a.bin, b.bin, etc.)
+  if (!name || strlen(name) != 5 || strcmp(name + 1, ".bin") != 0) {
+    return -1;
+  }
+
+  // Map character to pattern number starting at 8
+  char firstChar = name[0];
+  if (firstChar >= 'a' && firstChar <= 'z') {
+    return 8 + (firstChar - 'a');
+  } else if (firstChar >= 'A' && firstChar <= 'Z') {
+    return 8 + 26 + (firstChar - 'A');
+  } else if (firstChar >= '0' && firstChar <= '9') {
+    return 8 + 52 + (firstChar - '0');
+  }
+  return -1;
+}
+
+// ============================================================================
+// PatternListParser
+// ============================================================================
+
+void PatternListParser::reset() {
+  state = BEFORE_ARRAY;
+  depth = 0;
+  objectLevels = 0;
+  inString = false;
+  escaped = false;
+  expectKey = false;
+  nameKey = false;
+  strLen = 0;
+  patternCount = 0;
+  entries = 0;
+  bodyHash = fnv1a(NULL, 0);
+  bodyBytes = 0;
+}
+
+void PatternListParser::write(const char* data, size_t len) {
+  bodyHash = fnv1a(data, len, bodyHash);
+  bodyBytes += len;
+
+  for (size_t i = 0; i < len && (state == BEFORE_ARRAY || state == IN_ARRAY); i++) {
+    char c = data[i];
+
+    if (inString) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        // No pattern name needs escaping, so the string cannot match
+        escaped = true;
+        strLen = sizeof(str);
+      } else if (c == '"') {
+        inString = false;
+        endOfString();
+      } else {
+        if (strLen < sizeof(str) - 1) str[strLen] = c;
+        if (strLen < 255) strLen++;
+      }
+      continue;
+    }
+
+    if (state == BEFORE_ARRAY) {
+      if (c == '[') {
+        state = IN_ARRAY;
+        depth = 1;
+      } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        state = FAILED;  // not a listing, e.g. an error page
+      }
+      continue;
+    }
+
+    switch (c) {
+      case '"':
+        inString = true;
+        strLen = 0;
+        break;
+      case '{':
+      case '[':
+        if (depth >= 32) {
+          state = FAILED;
+          break;
+        }
+        if (c == '{') {
+          if (depth == 1) entries++;
+          objectLevels |= 1u << depth;
+        } else {
+          objectLevels &= ~(1u << depth);
+        }
+        depth++;
+        expectKey = c == '{';
+        nameKey = false;
+        break;
+      case '}':
+      case ']':
+        if ((c == '}') != (bool)((objectLevels >> (depth - 1)) & 1)) {
+          state = FAILED;
+          break;
+        }
+        depth--;
+        expectKey = false;
+        if (depth == 0) state = DONE;
+        break;
+      case ',':
+        expectKey = (objectLevels >> (depth - 1)) & 1;
+        break;
+      case ':':
+        expectKey = false;
+        break;
+      default:
+        break;  // whitespace, numbers and literals
+    }
+  }
+}
+
+void PatternListParser::endOfString() {
+  bool inObject = (objectLevels >> (depth - 1)) & 1;
+  if (inObject && expectKey) {
+    nameKey = depth == 2 && strLen == 4 && memcmp(str, "name", 4) == 0;
+    return;
+  }
+  if (nameKey && depth == 2 && strLen < sizeof(str)) {
+    str[strLen] = '\0';
+    int patternNumber = patternNumberForFile(str);
+    if (patternNumber >= MIN_PATTERN_NUMBER && patternNumber <= MAX_PATTERN_NUMBER
+        && patternCount < MAX_PATTERNS) {
+      patternNumbers[patternCount++] = patternNumber;
+    }
+  }
+  nameKey = false;
+}
+
+// ============================================================================
+// PatternClient
+// ============================================================================
+
+PatternClient::PatternClient(HttpTransport& http, const PoiRegistry& registry, FileStore* cache)
+  : http(http),
+    registry(registry),
+    cache(cache),
+    live(),
+    fetched(),
+    staged(),
+    stagedReady(false),
+    currentPatternIndex(0),
+    patternsLoaded(false),
+    refreshes(0),
+    changes(0) {
+}
+
+static bool hasPattern(const PatternTable& table, int patternNumber) {
+  for (int i = 0; i < table.count; i++) {
+    if (table.numbers[i] == patternNumber) return true;
+  }
+  return false;
+}
+
+bool PatternClient::loadCached() {
+  if (!cache) return false;
+
+  uint8_t data[PATTERN_CACHE_HEADER_BYTES + MAX_PATTERNS + 4];
+  int len = cache->read(PATTERN_CACHE_PATH, data, sizeof(data));
+  if (len < 0) {
+    poiLog("No cached pattern list\n");
+    return false;
+  }
+
+  int count = len >= PATTERN_CACHE_HEADER_BYTES ? data[8] : 0;
+  if (len != PATTERN_CACHE_HEADER_BYTES + count + 4
+      || getU32(data) != PATTERN_CACHE_MAGIC
+      || getU32(data + len - 4) != fnv1a(data, len - 4)
+      || count == 0 || count > MAX_PATTERNS) {
+    poiLog("Cached pattern list is corrupt, ignoring it\n");
+    return false;
+  }
+
+  PatternTable table;
+  for (int i = 0; i < count; i++) {
+    table.numbers[i] = data[PATTERN_CACHE_HEADER_BYTES + i];
+    if (table.numbers[i] < MIN_PATTERN_NUMBER || table.numbers[i] > MAX_PATTERN_NUMBER) {
+      poiLog("Cached pattern list is corrupt, ignoring it\n");
+      return false;
+    }
+  }
+  table.count = count;
+  table.hash = getU32(data + 4);
+
+  live = table;
+  fetched = table;
+  currentPatternIndex = 0;
+  patternsLoaded = true;
+  poiLog("Loaded %d patterns from cache\n", live.count);
+  return true;
+}
+
+bool PatternClient::saveCache(const PatternTable& table) {
+  if (!cache) return false;
+
+  uint8_t data[PATTERN_CACHE_HEADER_BYTES + MAX_PATTERNS + 4];
+  putU32(data, PATTERN_CACHE_MAGIC);
+  putU32(data + 4, table.hash);
+  data[8] = (uint8_t)table.count;
+  for (int i = 0; i < table.count; i++) {
+    data[PATTERN_CACHE_HEADER_BYTES + i] = (uint8_t)table.numbers[i];
+  }
+  size_t len = PATTERN_CACHE_HEADER_BYTES + table.count;
+  putU32(data + len, fnv1a(data, len));
+
+  if (!cache->write(PATTERN_CACHE_PATH, data, len + 4)) {
+    poiLog("Failed to save pattern cache\n");
+    return false;
+  }
+  return true;
+}
+
+bool PatternClient::loadPatterns(uint32_t timeoutMs) {
+  // The loop task has not picked up the last change yet; compare against
+  // the poi again next time rather than overwrite it
+  if (stagedReady.load(std::memory_order_acquire)) {
+    return true;
+  }
+
+  poiLog("Loading patterns from servers...\n");
+  refreshes++;
+
+  bool success = false;
+
+  int serverCount = registry.count();
+  for (int i = 0; i < serverCount; i++) {
+    if (!registry.online(i)) continue;
+    const char* server = registry.host(i);
+
+    // Parsed as it arrives, nothing holds the whole listing
+    PatternListParser listing;
+    int httpCode = http.get(server, registry.port(i), "/list?dir=/", timeoutMs, &listing);
+
+    if (httpCode < 0) {
+      poiLog("Failed to connect to %s\n", server);
+      continue;
+    }
+    if (httpCode != 200) {
+      poiLog("HTTP error %d from %s\n", httpCode, server);
+      continue;
+    }
+
+    poiLog("Got file list from %s: %d files, %lu bytes\n", server, listing.entryCount(),
+           (unsigned long)listing.bytes());
+
+    if (!listing.complete()) {
+      poiLog("JSON parse error: %s\n", listing.failed() ? "malformed listing" : "truncated listing");
+      continue;
+    }
+
+    // Same listing as the table we already have
+    if (fetched.count > 0 && listing.hash() == fetched.hash) {
+      poiLog("Pattern list unchanged (%08lx)\n", (unsigned long)listing.hash());
+      success = true;
+      break;
+    }
+
+    if (listing.count() > 0) {
+      PatternTable table;
+      memcpy(table.numbers, listing.patterns(), listing.count() * sizeof(int));
+      table.count = listing.count();
+      table.hash = listing.hash();
+
+      // Diff against the previous list: other files may have changed
+      int added = 0;
+      int removed = 0;
+      for (int p = 0; p < table.count; p++) {
+        added += !hasPattern(fetched, table.numbers[p]);
+      }
+      for (int p = 0; p < fetched.count; p++) {
+        removed += !hasPattern(table, fetched.numbers[p]);
+      }
+      bool reordered = !added && !removed && memcmp(table.numbers, fetched.numbers, table.count * sizeof(int)) != 0;
+
+      bool changed = added || removed || reordered;
+      fetched = table;
+      saveCache(fetched);  // remember the new hash either way
+      success = true;
+
+      if (changed) {
+        staged = table;
+        stagedReady.store(true, std::memory_order_release);
+        poiLog("Loaded %d patterns (%d added, %d removed)\n", table.count, added, removed);
+      } else {
+        poiLog("Pattern list unchanged, other files differ (%08lx)\n", (unsigned long)table.hash);
+      }
+      break;
+    }
+  }
+
+  if (!success && fetched.count > 0) {
+    poiLog("Failed to refresh patterns, keeping %d cached\n", fetched.count);
+  } else if (!success) {
+    poiLog("Failed to load patterns from any server\n");
+  }
+
+  return success;
+}
+
+bool PatternClient::applyPending() {
+  if (!stagedReady.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  int current = live.count > 0 ? live.numbers[currentPatternIndex] : -1;
+  live = staged;
+  stagedReady.store(false, std::memory_order_release);
+
+  // Carry on from the same pattern if it is still there, wherever it moved
+  int index = -1;
+  for (int i = 0; i < live.count; i++) {
+    if (live.numbers[i] == current) index = i;
+  }
+  if (index >= 0) {
+    currentPatternIndex = index;
+  } else if (currentPatternIndex >= live.count) {
+    currentPatternIndex = 0;
+  }
+  patternsLoaded = true;
+  changes++;
+
+  poiLog("Pattern list now has %d patterns - current index: %d (pattern %d)\n",
+         live.count, currentPatternIndex, live.numbers[currentPatternIndex]);
+  return true;
+}
+
+void PatternClient::advance() {
+  if (live.count == 0) return;
+  currentPatternIndex++;
+  if (currentPatternIndex >= live.count) {
+    currentPatternIndex = 0;  // Loop back to first pattern
+  }
+}
+
+void PatternClient::select(int index) {
+  if (live.count == 0) return;
+  index %= live.count;
+  currentPatternIndex = index < 0 ? index + live.count : index;
+}
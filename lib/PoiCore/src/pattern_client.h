@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+
+#include "hal.h"
+#include "poi_registry.h"
+
+#define MAX_PATTERNS 62    // a-z, A-Z, 0-9
+#define MIN_PATTERN_NUMBER 8
+#define MAX_PATTERN_NUMBER 69
+
+#define PATTERN_CACHE_PATH "/patterns.bin"
+
+// Map a poi image file name ("a.bin", "Z.bin", "3.bin") to its pattern
+// number, or -1 if the name is not a single character .bin file
+int patternNumberForFile(const char* name);
+
+// 32-bit FNV-1a, continued from a previous value
+uint32_t fnv1a(const void* data, size_t len, uint32_t hash = 2166136261u);
+
+// Incremental scanner for the poi's /list?dir=/ response, a JSON array of
+// {"type":"file","name":"a.bin",...} objects. Only top-level "name" values
+// are looked at and only pattern file names are kept, so memory use is the
+// same however many files the poi has. Also hashes the raw body.
+class PatternListParser : public HttpBodySink {
+public:
+  PatternListParser() { reset(); }
+  void reset();
+  void write(const char* data, size_t len) override;
+
+  // The closing ] of the array was seen and nothing was malformed before it
+  bool complete() const { return state == DONE; }
+  bool failed() const { return state == FAILED; }
+
+  int count() const { return patternCount; }
+  const int* patterns() const { return patternNumbers; }
+  int entryCount() const { return entries; }     // objects in the array
+  uint32_t hash() const { return bodyHash; }
+  size_t bytes() const { return bodyBytes; }
+
+private:
+  enum State { BEFORE_ARRAY, IN_ARRAY, DONE, FAILED };
+  void endOfString();
+
+  State state;
+  uint8_t depth;          // 1 inside the array, 2 inside an entry
+  uint32_t objectLevels;  // bit n set if depth n+1 is an object
+  bool inString;
+  bool escaped;
+  bool expectKey;         // next string in the current object is a key
+  bool nameKey;           // last key at depth 2 was "name"
+  char str[8];            // current string, enough for "name" and "a.bin"
+  uint8_t strLen;         // may exceed sizeof(str) - 1, then str is truncated
+
+  int patternNumbers[MAX_PATTERNS];
+  int patternCount;
+  int entries;
+  uint32_t bodyHash;
+  size_t bodyBytes;
+};
+
+// A resolved pattern list
+struct PatternTable {
+  int numbers[MAX_PATTERNS];
+  int count;
+  uint32_t hash;  // of the listing it was built from, 0 if none
+};
+
+// Pattern list of the SmartPoi servers and the current position in it.
+// Pattern changes are sent by PatternDispatcher.
+//
+// The resolved pattern table is cached in PATTERN_CACHE_PATH together with
+// a hash of the listing it came from, so boot does not have to wait for
+// the poi: loadCached() restores the table instantly and loadPatterns()
+// only re-parses the listing when its hash changes.
+//
+// loadPatterns() blocks on the network and runs on a background task. A
+// changed list is staged there and only becomes the live table when the
+// loop task calls applyPending(), so everything else here belongs to the
+// loop task and never sees a half-written table.
+class PatternClient {
+public:
+  PatternClient(HttpTransport& http, const PoiRegistry& registry, FileStore* cache = NULL);
+
+  // Restore the pattern table saved by the last successful loadPatterns().
+  // Call before the background task starts.
+  bool loadCached();
+
+  // Background task: get list of .bin files from the first online poi that
+  // answers and map to pattern numbers. Blocks for up to timeoutMs per
+  // unreachable poi.
+  bool loadPatterns(uint32_t timeoutMs = 5000);
+
+  // Loop task: make a list staged by loadPatterns() live. The current
+  // pattern keeps its place in the show if it is still on the poi.
+  bool applyPending();
+
+  bool loaded() const { return patternsLoaded; }
+  int count() const { return live.count; }
+  int currentIndex() const { return currentPatternIndex; }
+  int currentPattern() const { return live.numbers[currentPatternIndex]; }
+  // Move to the next pattern, looping back to the first
+  void advance();
+  // Move to index, wrapping around either end of the list
+  void select(int index);
+
+  // Hash of the listing the live table was built from, 0 if none yet
+  uint32_t listingHash() const { return live.hash; }
+  uint32_t refreshCount() const { return refreshes; }  // listings fetched
+  uint32_t changeCount() const { return changes; }     // lists swapped in
+
+private:
+  bool saveCache(const PatternTable& table);
+
+  HttpTransport& http;
+  const PoiRegistry& registry;
+  FileStore* cache;
+
+  PatternTable live;     // loop task
+  PatternTable fetched;  // background task: last list seen on the poi
+  PatternTable staged;   // handed over while stagedReady is set
+  std::atomic<bool> stagedReady;
+
+  int currentPatternIndex;
+  bool patternsLoaded;
+  std::atomic<uint32_t> refreshes;
+  uint32_t changes;
+};
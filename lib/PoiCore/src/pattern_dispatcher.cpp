@@ -0,0 +1,177 @@
+#include "pattern_dispatcher.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PatternDispatcher::PatternDispatcher(Clock& clock, TcpConnection* const* connections,
+                                     const PoiRegistry& registry)
+  : clock(clock),
+    registry(registry),
+    pool(clock, connections, registry),
+    built(0),
+    patternNumber(0),
+    isPaused(false),
+    pendingPattern(-1),
+    multicast(NULL),
+    callback(NULL),
+    callbackContext(NULL) {
+  for (int i = 0; i < MAX_POI_SERVERS; i++) {
+    requests[i].waiting = false;
+  }
+}
+
+void PatternDispatcher::buildRequest(int i) {
+  Request& r = requests[i];
+  char host[POI_HOST_LEN + 6];
+  if (registry.port(i) == 80) {
+    snprintf(host, sizeof(host), "%s", registry.host(i));
+  } else {
+    snprintf(host, sizeof(host), "%s:%u", registry.host(i), registry.port(i));
+  }
+  int prefix = snprintf(r.buffer, sizeof(r.buffer), "GET /pattern?patternChooserChange=");
+  int len = snprintf(r.buffer + prefix, sizeof(r.buffer) - prefix,
+                     "00 HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "Connection: keep-alive\r\n\r\n",
+                     host);
+  r.patternOffset = (uint8_t)prefix;
+  r.length = (uint8_t)(prefix + len);
+}
+
+bool PatternDispatcher::takesMulticast(int i) const {
+  return registry.online(i) && (registry.features(i) & POI_FEATURE_UDP_SWITCH);
+}
+
+void PatternDispatcher::onComplete(DispatchCallback callback, void* context) {
+  this->callback = callback;
+  callbackContext = context;
+}
+
+bool PatternDispatcher::dispatch(int patternNumber) {
+  if (patternNumber < 0 || patternNumber > 99) return false;
+  if (isPaused) {
+    pendingPattern = patternNumber;
+    return false;
+  }
+  this->patternNumber = patternNumber;
+  uint32_t now = clock.millis();
+  bool started = false;
+
+  int count = registry.count();
+  for (; built < count; built++) {
+    buildRequest(built);
+  }
+
+  // One datagram covers every poi that understands it
+  bool multicastSent = false;
+  if (multicast) {
+    for (int i = 0; i < count; i++) {
+      if (takesMulticast(i)) {
+        multicastSent = multicast->send(patternNumber);
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    Request& r = requests[i];
+    if (r.waiting) {
+      pool.abort(i);
+      r.waiting = false;
+    }
+    if (!registry.online(i)) {
+      continue;
+    }
+    if (multicastSent && takesMulticast(i)) {
+      r.startTime = now;
+      finish(i, DISPATCH_SENT_MULTICAST);
+      started = true;
+      continue;
+    }
+
+    r.buffer[r.patternOffset] = '0' + patternNumber / 10;
+    r.buffer[r.patternOffset + 1] = '0' + patternNumber % 10;
+    r.waiting = true;
+    r.startTime = now;
+    if (!pool.request(i, r.buffer, r.length)) {
+      finish(i, -1);
+      continue;
+    }
+    started = true;
+  }
+  return started;
+}
+
+void PatternDispatcher::pause() {
+  if (isPaused) return;
+  isPaused = true;
+  for (int i = 0; i < built; i++) {
+    if (requests[i].waiting) {
+      pool.abort(i);
+      finish(i, -1);
+    }
+  }
+}
+
+void PatternDispatcher::resume() {
+  if (!isPaused) return;
+  isPaused = false;
+  // Connections from before the outage are dead
+  pool.reset();
+  if (pendingPattern >= 0) {
+    int pattern = pendingPattern;
+    pendingPattern = -1;
+    dispatch(pattern);
+  }
+}
+
+void PatternDispatcher::poll() {
+  if (isPaused) return;
+  uint32_t now = clock.millis();
+
+  if (multicast) {
+    multicast->poll();
+  }
+
+  for (int i = 0; i < built; i++) {
+    Request& r = requests[i];
+    if (!r.waiting) continue;
+
+    int status = pool.poll(i);
+    if (status != 0) {
+      finish(i, status);
+    } else if (now - r.startTime > DISPATCH_TIMEOUT_MS) {
+      pool.abort(i);
+      finish(i, -1);
+    }
+  }
+
+  pool.maintain();
+}
+
+bool PatternDispatcher::busy() const {
+  for (int i = 0; i < built; i++) {
+    if (requests[i].waiting) return true;
+  }
+  return false;
+}
+
+void PatternDispatcher::finish(int i, int httpStatus) {
+  Request& r = requests[i];
+  r.waiting = false;
+  uint32_t elapsed = clock.millis() - r.startTime;
+
+  if (httpStatus == DISPATCH_SENT_MULTICAST) {
+    poiLog("Server %s: Pattern %d sent by multicast\n", registry.host(i), patternNumber);
+  } else if (httpStatus == 200) {
+    poiLog("Server %s: Pattern %d set successfully (%lu ms)\n", registry.host(i), patternNumber, (unsigned long)elapsed);
+  } else if (httpStatus == 400) {
+    poiLog("Server %s: Invalid pattern %d\n", registry.host(i), patternNumber);
+  } else {
+    poiLog("Server %s: HTTP error %d\n", registry.host(i), httpStatus);
+  }
+
+  if (callback) {
+    callback(callbackContext, i, patternNumber, httpStatus, elapsed);
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "connection_pool.h"
+#include "multicast_switcher.h"
+
+#define DISPATCH_TIMEOUT_MS 1000
+#define DISPATCH_REQUEST_SIZE 112
+#define DISPATCH_SENT_MULTICAST 0  // httpStatus of poi switched by datagram
+
+// Called once per server when its /pattern request finishes. httpStatus is
+// the HTTP status code, DISPATCH_SENT_MULTICAST if the poi was sent the
+// switch datagram instead (nothing comes back), or negative if the server
+// could not be reached or timed out.
+typedef void (*DispatchCallback)(void* context, int server, int patternNumber,
+                                 int httpStatus, uint32_t elapsedMs);
+
+// Sends /pattern?patternChooserChange=N to every online poi in the registry
+// at once over the persistent connections of a ConnectionPool. dispatch()
+// returns immediately; poll() collects responses, enforces the per-server
+// timeout and keeps idle connections warm. Server indexes are registry
+// indexes, so poi discovered later simply join the next dispatch.
+//
+// With a MulticastSwitcher set, poi that advertise POI_FEATURE_UDP_SWITCH
+// get one multicast datagram instead of a request; the rest, and all of
+// them if the datagram cannot be sent, still go over HTTP.
+//
+// While the network is down the dispatcher is paused: nothing is sent and
+// nothing reconnects, and the last pattern asked for goes out on resume().
+class PatternDispatcher {
+public:
+  PatternDispatcher(Clock& clock, TcpConnection* const* connections, const PoiRegistry& registry);
+
+  void onComplete(DispatchCallback callback, void* context);
+  void setMulticast(MulticastSwitcher* switcher) { multicast = switcher; }
+
+  // Fire the request to all servers. A dispatch still in flight is abandoned.
+  // While paused, only remembers the pattern and returns false.
+  bool dispatch(int patternNumber);
+  // Call regularly from the main loop
+  void poll();
+
+  // Network down: fail the requests in flight and stop reconnecting
+  void pause();
+  // Network back: reconnect now and send what was asked for meanwhile
+  void resume();
+  bool paused() const { return isPaused; }
+
+  bool busy() const;
+  int serverCount() const { return registry.count(); }
+  // Poi the next dispatch goes to
+  int targetCount() const { return registry.onlineCount(); }
+  const char* server(int i) const { return registry.host(i); }
+  const ConnectionPool& connectionPool() const { return pool; }
+
+private:
+  struct Request {
+    bool waiting;
+    uint32_t startTime;
+    // Pre-built "GET /pattern?patternChooserChange=NN HTTP/1.1 ..." with
+    // the two pattern digits patched in place for each dispatch
+    char buffer[DISPATCH_REQUEST_SIZE];
+    uint8_t length;
+    uint8_t patternOffset;
+  };
+
+  void buildRequest(int i);
+  void finish(int i, int httpStatus);
+  bool takesMulticast(int i) const;
+
+  Clock& clock;
+  const PoiRegistry& registry;
+  ConnectionPool pool;
+  int built;  // requests[0..built) are ready
+  int patternNumber;
+  bool isPaused;
+  int pendingPattern;  // asked for while paused, -1 if none
+  Request requests[MAX_POI_SERVERS];
+  MulticastSwitcher* multicast;
+
+  DispatchCallback callback;
+  void* callbackContext;
+};
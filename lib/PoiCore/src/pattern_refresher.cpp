@@ -0,0 +1,29 @@
+#include "pattern_refresher.h"
+
+PatternRefresher::PatternRefresher(PatternClient& patterns, Clock& clock, uint32_t intervalMs)
+  : patterns(patterns),
+    clock(clock),
+    intervalMs(intervalMs),
+    lastRefresh(0),
+    wasDeferred(false),
+    deferred(0),
+    quiet(false) {
+}
+
+bool PatternRefresher::poll() {
+  uint32_t now = clock.millis();
+  if (now - lastRefresh < intervalMs) {
+    return false;
+  }
+  if (!quiet.load(std::memory_order_acquire)) {
+    // Count each postponed refresh once, however often it is polled
+    if (!wasDeferred) deferred++;
+    wasDeferred = true;
+    return false;
+  }
+
+  wasDeferred = false;
+  patterns.loadPatterns(PATTERN_REFRESH_TIMEOUT_MS);
+  lastRefresh = clock.millis();
+  return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+#include "hal.h"
+#include "pattern_client.h"
+
+#define PATTERN_REFRESH_INTERVAL_MS 60000  // re-fetch the listing this often
+#define PATTERN_REFRESH_TIMEOUT_MS 2000    // per server; boot uses the full 5 s
+
+// Periodic background re-fetch of the poi file listing, so images uploaded
+// after boot show up without a restart. poll() runs on a low priority task
+// and blocks while fetching; the loop task says through setQuiet() when a
+// fetch may talk to the poi without getting in the way of a pattern change.
+class PatternRefresher {
+public:
+  PatternRefresher(PatternClient& patterns, Clock& clock,
+                   uint32_t intervalMs = PATTERN_REFRESH_INTERVAL_MS);
+
+  // Loop task: true while no dispatch is in flight and none is imminent
+  void setQuiet(bool quiet) { this->quiet.store(quiet, std::memory_order_release); }
+
+  // Background task: fetch the listing if one is due and the loop is
+  // quiet. Returns true if a fetch ran.
+  bool poll();
+
+  uint32_t deferredCount() const { return deferred; }  // due but not quiet
+
+private:
+  PatternClient& patterns;
+  Clock& clock;
+  uint32_t intervalMs;
+  uint32_t lastRefresh;
+  bool wasDeferred;
+  uint32_t deferred;
+  std::atomic<bool> quiet;
+};
@@ -0,0 +1,85 @@
+#include "poi_discovery.h"
+
+#include <string.h>
+
+static const uint8_t DISCOVERY_MAGIC[4] = {'S', 'P', 'O', 'I'};
+
+size_t encodeDiscoveryProbe(uint8_t* data) {
+  memcpy(data, DISCOVERY_MAGIC, 4);
+  data[4] = DISCOVERY_PROBE;
+  data[5] = DISCOVERY_VERSION;
+  return DISCOVERY_PROBE_SIZE;
+}
+
+size_t encodeDiscoveryReply(uint8_t* data, uint16_t httpPort, uint8_t features) {
+  memcpy(data, DISCOVERY_MAGIC, 4);
+  data[4] = DISCOVERY_REPLY;
+  data[5] = DISCOVERY_VERSION;
+  data[6] = (uint8_t)httpPort;
+  data[7] = (uint8_t)(httpPort >> 8);
+  data[8] = features;
+  return DISCOVERY_REPLY_SIZE;
+}
+
+bool isDiscoveryProbe(const uint8_t* data, size_t len) {
+  return len >= DISCOVERY_PROBE_SIZE && memcmp(data, DISCOVERY_MAGIC, 4) == 0
+      && data[4] == DISCOVERY_PROBE;
+}
+
+uint16_t decodeDiscoveryReply(const uint8_t* data, size_t len, uint8_t* features) {
+  // Newer versions may append fields
+  if (len < DISCOVERY_REPLY_MIN_SIZE || memcmp(data, DISCOVERY_MAGIC, 4) != 0
+      || data[4] != DISCOVERY_REPLY) {
+    return 0;
+  }
+  if (features) {
+    *features = len >= DISCOVERY_REPLY_SIZE ? data[8] : 0;
+  }
+  return (uint16_t)(data[6] | (data[7] << 8));
+}
+
+PoiDiscovery::PoiDiscovery(UdpSocket& socket, Clock& clock, PoiRegistry& registry,
+                           const char* probeAddress, uint32_t intervalMs)
+  : socket(socket),
+    clock(clock),
+    registry(registry),
+    probeAddress(probeAddress),
+    intervalMs(intervalMs),
+    started(false),
+    lastProbe(0),
+    probes(0),
+    replies(0) {
+}
+
+bool PoiDiscovery::begin() {
+  started = socket.begin(0);
+  if (!started) {
+    poiLog("Discovery socket failed to open\n");
+  }
+  return started;
+}
+
+void PoiDiscovery::poll() {
+  if (!started) return;
+  uint32_t now = clock.millis();
+
+  if (probes == 0 || now - lastProbe >= intervalMs) {
+    uint8_t probe[DISCOVERY_PROBE_SIZE];
+    socket.sendTo(probeAddress, DISCOVERY_PORT, probe, encodeDiscoveryProbe(probe));
+    lastProbe = now;
+    probes++;
+  }
+
+  uint8_t data[32];
+  char from[POI_HOST_LEN];
+  size_t len;
+  while ((len = socket.receive(data, sizeof(data), from, NULL)) > 0) {
+    uint8_t features;
+    uint16_t httpPort = decodeDiscoveryReply(data, len, &features);
+    if (httpPort == 0) continue;
+    replies++;
+    registry.seen(from, httpPort, now, features);
+  }
+
+  registry.expire(now, DISCOVERY_MISSED_PROBES * intervalMs);
+}
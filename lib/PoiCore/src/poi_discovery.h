@@ -0,0 +1,55 @@
+#pragma once
+
+#include "hal.h"
+#include "poi_registry.h"
+
+#define DISCOVERY_PORT 4210
+#define DISCOVERY_INTERVAL_MS 5000  // probe this often
+#define DISCOVERY_MISSED_PROBES 3   // offline after this many unanswered probes
+#define DISCOVERY_BROADCAST "255.255.255.255"
+
+// Discovery datagrams, all little-endian:
+//   probe  "SPOI" 0x01 version                  controller -> broadcast
+//   reply  "SPOI" 0x02 version httpPort(u16) features(u8)
+//                                               poi -> controller, unicast
+// features are POI_FEATURE_* bits; replies from poi that predate them
+// end after httpPort.
+#define DISCOVERY_VERSION 1
+#define DISCOVERY_PROBE 0x01
+#define DISCOVERY_REPLY 0x02
+#define DISCOVERY_PROBE_SIZE 6
+#define DISCOVERY_REPLY_SIZE 9
+#define DISCOVERY_REPLY_MIN_SIZE 8
+
+size_t encodeDiscoveryProbe(uint8_t* data);
+size_t encodeDiscoveryReply(uint8_t* data, uint16_t httpPort, uint8_t features = 0);
+bool isDiscoveryProbe(const uint8_t* data, size_t len);
+// Returns the advertised HTTP port, 0 if data is not a reply
+uint16_t decodeDiscoveryReply(const uint8_t* data, size_t len, uint8_t* features = NULL);
+
+// Finds poi on the local network by broadcasting a probe every
+// DISCOVERY_INTERVAL_MS and feeding the replies into a PoiRegistry.
+// poll() never blocks and is called from the main loop.
+class PoiDiscovery {
+public:
+  PoiDiscovery(UdpSocket& socket, Clock& clock, PoiRegistry& registry,
+               const char* probeAddress = DISCOVERY_BROADCAST,
+               uint32_t intervalMs = DISCOVERY_INTERVAL_MS);
+
+  bool begin();
+  void poll();
+
+  uint32_t probeCount() const { return probes; }
+  uint32_t replyCount() const { return replies; }
+
+private:
+  UdpSocket& socket;
+  Clock& clock;
+  PoiRegistry& registry;
+  const char* probeAddress;
+  uint32_t intervalMs;
+  bool started;
+  uint32_t lastProbe;
+  uint32_t probes;
+  uint32_t replies;
+};
@@ -0,0 +1,82 @@
+#include "poi_registry.h"
+
+#include <string.h>
+
+int PoiRegistry::find(const char* host, uint16_t port) const {
+  int n = count();
+  for (int i = 0; i < n; i++) {
+    if (entries[i].port == port && strcmp(entries[i].host, host) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int PoiRegistry::add(const char* host, uint16_t port, bool pinned, uint32_t now) {
+  int n = count();
+  if (n >= MAX_POI_SERVERS) {
+    poiLog("Poi registry full, ignoring %s\n", host);
+    return -1;
+  }
+  Entry& e = entries[n];
+  strncpy(e.host, host, POI_HOST_LEN - 1);
+  e.host[POI_HOST_LEN - 1] = '\0';
+  e.port = port;
+  e.pinned = pinned;
+  e.lastSeen = now;
+  e.online.store(true, std::memory_order_relaxed);
+  e.features.store(0, std::memory_order_relaxed);
+  // Publish only once the entry is complete
+  entryCount.store(n + 1, std::memory_order_release);
+  return n;
+}
+
+int PoiRegistry::addStatic(const char* host, uint16_t port) {
+  int i = find(host, port);
+  if (i >= 0) {
+    entries[i].pinned = true;
+    return i;
+  }
+  return add(host, port, true, 0);
+}
+
+int PoiRegistry::seen(const char* host, uint16_t port, uint32_t now, uint8_t features) {
+  int i = find(host, port);
+  if (i < 0) {
+    i = add(host, port, false, now);
+    if (i >= 0) {
+      entries[i].features.store(features, std::memory_order_relaxed);
+      poiLog("Discovered poi %s:%u\n", host, port);
+    }
+    return i;
+  }
+  Entry& e = entries[i];
+  e.lastSeen = now;
+  e.features.store(features, std::memory_order_relaxed);
+  if (!e.online.load(std::memory_order_relaxed)) {
+    e.online.store(true, std::memory_order_relaxed);
+    poiLog("Poi %s:%u is back\n", host, port);
+  }
+  return i;
+}
+
+void PoiRegistry::expire(uint32_t now, uint32_t maxAgeMs) {
+  int n = count();
+  for (int i = 0; i < n; i++) {
+    Entry& e = entries[i];
+    if (e.pinned || !e.online.load(std::memory_order_relaxed) || now - e.lastSeen <= maxAgeMs) {
+      continue;
+    }
+    e.online.store(false, std::memory_order_relaxed);
+    poiLog("Poi %s:%u stopped answering\n", e.host, e.port);
+  }
+}
+
+int PoiRegistry::onlineCount() const {
+  int n = count();
+  int online = 0;
+  for (int i = 0; i < n; i++) {
+    online += this->online(i);
+  }
+  return online;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+
+#include "hal.h"
+
+#define MAX_POI_SERVERS 8
+#define POI_HOST_LEN 16  // dotted IPv4 address and terminator
+
+// What a poi advertises in its discovery reply
+#define POI_FEATURE_UDP_SWITCH 0x01  // applies multicast switch commands
+#define POI_FEATURE_CLOCK_SYNC 0x02  // answers ClockSync pings, honours switch times
+
+// The poi this controller drives. Configured poi are always online;
+// discovered ones (see PoiDiscovery) go offline when they stop answering
+// and come back when they answer again.
+//
+// Entries are only ever appended and keep their index for the whole
+// session, so ConnectionPool, PatternDispatcher and LatencyTracker can
+// index their own per-poi state by it. Written by the loop task; other
+// tasks may read count(), host() and online().
+class PoiRegistry {
+public:
+  PoiRegistry() : entryCount(0) {}
+
+  // A configured poi, e.g. from secrets.h. Returns its index, -1 if full.
+  int addStatic(const char* host, uint16_t port = 80);
+
+  // A poi answered discovery: add it, or refresh it and bring it back
+  // online. Returns its index, -1 if the registry is full.
+  int seen(const char* host, uint16_t port, uint32_t now, uint8_t features = 0);
+
+  // Take discovered poi not seen for maxAgeMs offline
+  void expire(uint32_t now, uint32_t maxAgeMs);
+
+  int count() const { return entryCount.load(std::memory_order_acquire); }
+  int onlineCount() const;
+  const char* host(int i) const { return entries[i].host; }
+  uint16_t port(int i) const { return entries[i].port; }
+  bool online(int i) const { return entries[i].online.load(std::memory_order_relaxed); }
+  bool discovered(int i) const { return !entries[i].pinned; }
+  uint32_t lastSeen(int i) const { return entries[i].lastSeen; }
+  // POI_FEATURE_* bits from the last discovery reply; 0 until one arrives
+  uint8_t features(int i) const { return entries[i].features.load(std::memory_order_relaxed); }
+
+  int find(const char* host, uint16_t port) const;
+
+private:
+  struct Entry {
+    char host[POI_HOST_LEN];
+    uint16_t port;
+    bool pinned;  // configured, never expires
+    uint32_t lastSeen;
+    std::atomic<bool> online;
+    std::atomic<uint8_t> features;
+  };
+
+  int add(const char* host, uint16_t port, bool pinned, uint32_t now);
+
+  Entry entries[MAX_POI_SERVERS];
+  std::atomic<int> entryCount;
+};
@@ -0,0 +1,125 @@
+#include "power_manager.h"
+
+#include <string.h>
+
+PowerManager::PowerManager(ImuSource& imu, PowerControl& control, Clock& clock, const PowerConfig& config)
+  : imu(imu),
+    control(control),
+    clock(clock),
+    config(config),
+    current(POWER_ACTIVE),
+    since(0),
+    stillFrom(0),
+    wakes(0),
+    changes(0),
+    radioAwake(false),
+    target(POWER_ACTIVE),
+    sensorLevel(POWER_ACTIVE),
+    woke(false),
+    sleepUnsupported(false) {
+  memset(timeIn, 0, sizeof(timeIn));
+}
+
+const char* PowerManager::levelName(PowerLevel level) {
+  switch (level) {
+    case POWER_ACTIVE: return "active";
+    case POWER_IDLE: return "idle";
+    case POWER_SLEEP: return "sleep";
+    default: return "unknown";
+  }
+}
+
+uint32_t PowerManager::loopDelayMs() const {
+  switch (current) {
+    case POWER_IDLE: return 20;
+    case POWER_SLEEP: return 50;
+    default: return 10;
+  }
+}
+
+uint32_t PowerManager::timeAt(PowerLevel level) const {
+  uint32_t total = timeIn[level];
+  if (level == current) {
+    total += clock.millis() - since;
+  }
+  return total;
+}
+
+void PowerManager::update(uint32_t lastMovement, bool busy) {
+  if (busy != radioAwake) {
+    radioAwake = busy;
+    control.setRadioAwake(busy);
+  }
+  if (!config.enabled) {
+    return;
+  }
+  uint32_t now = clock.millis();
+  if (woke.exchange(false)) {
+    // The detector has not seen this movement yet; count from the wake
+    wakes++;
+    stillFrom = now;
+  }
+  if ((int32_t)(lastMovement - stillFrom) > 0) {
+    stillFrom = lastMovement;
+  }
+
+  uint32_t still = now - stillFrom;
+  PowerLevel level = POWER_ACTIVE;
+  if (!busy && still >= config.sleepAfterMs && sleepSupported()) {
+    level = POWER_SLEEP;
+  } else if (!busy && still >= config.idleAfterMs) {
+    level = POWER_IDLE;
+  }
+  if (level != current) {
+    setLevel(level, now);
+  }
+}
+
+void PowerManager::setLevel(PowerLevel level, uint32_t now) {
+  timeIn[current] += now - since;
+  since = now;
+  current = level;
+  changes++;
+  control.setLevel(level);
+  target.store(level, std::memory_order_release);
+}
+
+uint32_t PowerManager::sensorPoll() {
+  PowerLevel want = target.load(std::memory_order_acquire);
+  PowerLevel have = sensorLevel.load(std::memory_order_relaxed);
+
+  if (want != have) {
+    if (want == POWER_SLEEP) {
+      if (imu.enableMotionWake(config.wakeThresholdMg)) {
+        have = POWER_SLEEP;
+      } else {
+        // Without a motion interrupt nothing could wake us: stay at the
+        // reduced rate, and the loop stops asking for sleep
+        sleepUnsupported.store(true, std::memory_order_relaxed);
+        imu.setSampleRate(config.idleRateHz);
+        have = POWER_IDLE;
+      }
+    } else if (want == POWER_IDLE) {
+      imu.setSampleRate(config.idleRateHz);
+      have = POWER_IDLE;
+    } else {
+      imu.begin();
+      have = POWER_ACTIVE;
+    }
+    sensorLevel.store(have, std::memory_order_relaxed);
+  }
+
+  if (have == POWER_SLEEP) {
+    if (!imu.motionWakePending()) {
+      return POWER_SLEEP_POLL_MS;
+    }
+    // Back to full rate straight away; the loop catches up through woke
+    imu.begin();
+    have = POWER_ACTIVE;
+    sensorLevel.store(have, std::memory_order_relaxed);
+    PowerLevel sleeping = POWER_SLEEP;
+    target.compare_exchange_strong(sleeping, POWER_ACTIVE);
+    woke.store(true, std::memory_order_release);
+  }
+  return have == POWER_IDLE ? 1000 / config.idleRateHz : config.activePeriodMs;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+
+#include "hal.h"
+
+#define POWER_IDLE_AFTER_MS 20000    // without movement: lower sample rate, modem sleep
+#define POWER_SLEEP_AFTER_MS 120000  // without movement: sensor watches for motion, light sleep
+#define POWER_IDLE_RATE_HZ 25        // still fast enough to see a spin start within 40 ms
+#define POWER_WAKE_THRESHOLD_MG 80
+#define POWER_SLEEP_POLL_MS 200      // motion interrupt check when the INT pin is not wired
+
+struct PowerConfig {
+  bool enabled = true;
+  uint32_t idleAfterMs = POWER_IDLE_AFTER_MS;
+  uint32_t sleepAfterMs = POWER_SLEEP_AFTER_MS;
+  uint16_t idleRateHz = POWER_IDLE_RATE_HZ;
+  uint16_t wakeThresholdMg = POWER_WAKE_THRESHOLD_MG;
+  uint32_t activePeriodMs = 5;  // sensor task period at full rate
+};
+
+// Steps the CPU, radio and sensor down while the poi are not moving and
+// back up as soon as they are.
+//
+// The loop task calls update() with the detector's last movement time.
+// After idleAfterMs without movement the sensor drops to idleRateHz and
+// the platform to POWER_IDLE; after sleepAfterMs the gyro is switched off
+// and the sensor's motion interrupt wakes everything back to full rate.
+// Movement the detector sees at the reduced rate goes straight back to
+// POWER_ACTIVE. While a pattern change is in flight the level is
+// POWER_ACTIVE and the radio stays out of power save.
+//
+// The sensor is only touched from the sensor task, in sensorPoll(); the
+// level reaches it through an atomic.
+class PowerManager {
+public:
+  PowerManager(ImuSource& imu, PowerControl& control, Clock& clock,
+               const PowerConfig& config = PowerConfig());
+
+  // Loop task
+  void update(uint32_t lastMovement, bool busy);
+  PowerLevel level() const { return current; }
+  static const char* levelName(PowerLevel level);
+  // How long to delay() at the end of loop() at this level
+  uint32_t loopDelayMs() const;
+
+  // Sensor task: bring the sensor to the current level and check the
+  // motion interrupt. Returns how long to wait before the next call;
+  // samples are read only while sampling().
+  uint32_t sensorPoll();
+  bool sampling() const { return sensorLevel.load(std::memory_order_relaxed) != POWER_SLEEP; }
+
+  // Milliseconds spent at each level since construction, up to now
+  uint32_t timeAt(PowerLevel level) const;
+  uint32_t wakeCount() const { return wakes; }
+  uint32_t changeCount() const { return changes; }
+  bool sleepSupported() const { return !sleepUnsupported.load(std::memory_order_relaxed); }
+
+private:
+  void setLevel(PowerLevel level, uint32_t now);
+
+  ImuSource& imu;
+  PowerControl& control;
+  Clock& clock;
+  PowerConfig config;
+
+  PowerLevel current;
+  uint32_t since;       // current level entered
+  uint32_t stillFrom;   // the later of the last movement and the last wake
+  uint32_t timeIn[POWER_LEVELS];
+  uint32_t wakes;
+  uint32_t changes;
+  bool radioAwake;
+
+  // Shared with the sensor task
+  std::atomic<PowerLevel> target;       // loop -> sensor
+  std::atomic<PowerLevel> sensorLevel;  // what the sensor is set up for
+  std::atomic<bool> woke;               // sensor -> loop: motion interrupt
+  std::atomic<bool> sleepUnsupported;   // no motion wake, POWER_IDLE is as low as it goes
+};
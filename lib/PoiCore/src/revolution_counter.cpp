@@ -0,0 +1,106 @@
+#include "revolution_counter.h"
+
+RevolutionCounter::RevolutionCounter()
+  : callback(NULL),
+    callbackContext(NULL),
+    gateRaw((int32_t)(REVOLUTION_GATE_DPS * GYRO_LSB_PER_DPS)),
+    angle(0),
+    magnitude(0),
+    lastSample(0),
+    sampled(false),
+    lastTurning(0),
+    turning(false),
+    turnFrom(0),
+    lastDirection(0),
+    smoothed(0),
+    period(0),
+    count(0),
+    spinMs(0),
+    wasRotating(false),
+    unsaved(false) {
+}
+
+void RevolutionCounter::onRevolution(RevolutionCallback callback, void* context) {
+  this->callback = callback;
+  callbackContext = context;
+}
+
+void RevolutionCounter::restore(const SpinTotals& totals) {
+  lifetime.revolutions = totals.revolutions + count;
+  lifetime.spinMs = totals.spinMs + spinMs;
+}
+
+void RevolutionCounter::update(int32_t speed, uint32_t now, bool rotating) {
+  int32_t dt = sampled ? (int32_t)(now - lastSample) : 0;
+  if (dt > REVOLUTION_MAX_STEP_MS) dt = REVOLUTION_MAX_STEP_MS;
+  lastSample = now;
+  sampled = true;
+  magnitude = speed < 0 ? -speed : speed;
+
+  if (rotating) {
+    spinMs += dt;
+    lifetime.spinMs += dt;
+  } else if (wasRotating) {
+    unsaved = true;
+  }
+  wasRotating = rotating;
+
+  if (magnitude > gateRaw) {
+    if (!turning) {
+      turning = true;
+      turnFrom = now;
+    }
+    lastTurning = now;
+    angle += speed * dt;
+    if (angle >= REVOLUTION_LSB_MS) {
+      angle -= REVOLUTION_LSB_MS;
+      revolution(now, 1);
+    } else if (angle <= -REVOLUTION_LSB_MS) {
+      angle += REVOLUTION_LSB_MS;
+      revolution(now, -1);
+    }
+  } else if (turning && now - lastTurning > REVOLUTION_IDLE_MS) {
+    turning = false;
+    angle = 0;
+    lastDirection = 0;
+    smoothed = 0;
+  }
+}
+
+void RevolutionCounter::revolution(uint32_t now, int8_t direction) {
+  period = now - turnFrom;
+  turnFrom = now;
+  count++;
+  lifetime.revolutions++;
+  // The first turn of a run includes the wind-up, and one after a
+  // reversal part of the turn back; smoothing starts over from the next
+  if (direction != lastDirection) {
+    smoothed = 0;
+  } else if (period > 0) {
+    uint32_t rpm = 600000 / period;
+    if (rpm > 0xFFFF) rpm = 0xFFFF;
+    if (smoothed == 0) {
+      smoothed = (uint16_t)rpm;
+    } else {
+      smoothed = (uint16_t)((int32_t)smoothed + ((int32_t)rpm - (int32_t)smoothed) / REVOLUTION_SMOOTHING);
+    }
+  }
+  lastDirection = direction;
+  if (callback) {
+    callback(callbackContext, now, period, direction);
+  }
+}
+
+uint16_t RevolutionCounter::rpmTenths() const {
+  // RPM * 10 = deg/s / 6 * 10 = LSB * 10 / (GYRO_LSB_PER_DPS * 6)
+  if (!turning) return 0;
+  return (uint16_t)(magnitude * 100 / 984);
+}
+
+bool RevolutionCounter::takeUnsaved() {
+  if (!unsaved) {
+    return false;
+  }
+  unsaved = false;
+  return true;
+}
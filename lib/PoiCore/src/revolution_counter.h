@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+#define REVOLUTION_GATE_DPS 20.0f      // slower than this is a hand, not a turn
+#define REVOLUTION_IDLE_MS 2000        // a partial turn is forgotten after this long below the gate
+#define REVOLUTION_MAX_STEP_MS 100     // longer gaps between samples are treated as this
+#define REVOLUTION_SMOOTHING 4         // smoothed RPM moves 1/4 of the way per revolution
+// One turn as the integral of raw speed over milliseconds: 360 deg * LSB/deg/s * 1000
+#define REVOLUTION_LSB_MS ((int32_t)(360.0f * GYRO_LSB_PER_DPS * 1000.0f + 0.5f))
+
+// Lifetime rotation counts, kept in the config store
+struct SpinTotals {
+  uint32_t revolutions = 0;
+  uint32_t spinMs = 0;  // time the detector saw rotation
+};
+
+// Called for each whole turn; periodMs is the time since the previous
+// turn, or since the poi started turning for the first one. direction is
+// the sign of the rotation speed.
+typedef void (*RevolutionCallback)(void* context, uint32_t now, uint32_t periodMs, int8_t direction);
+
+// Counts revolutions by integrating the rotation speed of the chosen axis.
+//
+// Speed above REVOLUTION_GATE_DPS is summed into a signed angle; every
+// REVOLUTION_LSB_MS of it is one revolution, so a reversal mid-turn
+// unwinds instead of counting twice. Instantaneous RPM comes straight
+// from the latest speed, smoothed RPM from the revolution periods.
+//
+// update() is constant time and integer only: an add and a compare per
+// sample, a division per revolution. Loop task only; readers on other
+// tasks may see values one sample old, as with LatencyTracker.
+class RevolutionCounter {
+public:
+  RevolutionCounter();
+
+  void onRevolution(RevolutionCallback callback, void* context);
+  // Lifetime totals from an earlier boot
+  void restore(const SpinTotals& totals);
+
+  // Bias-corrected rotation speed in raw LSB; rotating as the detector says
+  void update(int32_t speed, uint32_t now, bool rotating);
+
+  // RPM * 10
+  uint16_t rpmTenths() const;
+  uint16_t smoothedRpmTenths() const { return smoothed; }
+  uint32_t lastPeriodMs() const { return period; }
+  // Since boot
+  uint32_t revolutions() const { return count; }
+  uint32_t spinTimeMs() const { return spinMs; }
+  // Including the ones from restore()
+  const SpinTotals& totals() const { return lifetime; }
+  // A spin ended since the last call, so the totals are worth saving
+  bool takeUnsaved();
+
+private:
+  void revolution(uint32_t now, int8_t direction);
+
+  RevolutionCallback callback;
+  void* callbackContext;
+  int32_t gateRaw;
+
+  int32_t angle;          // raw LSB * ms into the current turn
+  int32_t magnitude;      // |speed| of the latest sample
+  uint32_t lastSample;
+  bool sampled;
+  uint32_t lastTurning;   // last sample above the gate
+  bool turning;           // angle is counting
+  uint32_t turnFrom;      // previous revolution, or when turning began
+  int8_t lastDirection;   // of the previous revolution this run, 0 if none
+
+  uint16_t smoothed;
+  uint32_t period;
+  uint32_t count;
+  uint32_t spinMs;
+  bool wasRotating;
+  bool unsaved;
+  SpinTotals lifetime;
+};
@@ -0,0 +1,16 @@
+#include "sample_pipe.h"
+
+size_t SamplePipe::pump() {
+  ImuSample batch[16];
+  size_t total = 0;
+  size_t n;
+  do {
+    n = sensor.readBatch(batch, 16);
+    for (size_t i = 0; i < n; i++) {
+      ring.push(batch[i]);
+    }
+    total += n;
+  } while (n == 16);
+  produced.store(produced.load(std::memory_order_relaxed) + total, std::memory_order_relaxed);
+  return total;
+}
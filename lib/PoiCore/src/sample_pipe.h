@@ -0,0 +1,33 @@
+#pragma once
+
+#include "hal.h"
+#include "spsc_ring.h"
+
+#define SAMPLE_PIPE_CAPACITY 512  // ~0.5 s of gyro samples at 1 kHz
+
+// Decouples sampling from detection and networking. The sensor task calls
+// pump() to move samples from the IMU into a lock-free ring; the main loop
+// reads them back through the ImuSource interface, so a blocking HTTP
+// request no longer stops sampling.
+class SamplePipe : public ImuSource {
+public:
+  explicit SamplePipe(ImuSource& sensor) : sensor(sensor), produced(0) {}
+
+  // Producer side (sensor task): returns the number of samples read
+  size_t pump();
+
+  // Consumer side (main loop)
+  bool begin() override { return true; }  // the sensor is started by its owner
+  bool read(ImuSample& sample) override { return ring.pop(&sample, 1) == 1; }
+  size_t readBatch(ImuSample* samples, size_t max) override { return ring.pop(samples, max); }
+
+  uint32_t sampleCount() const { return produced.load(std::memory_order_relaxed); }
+  uint32_t overrunCount() const { return ring.overrunCount(); }
+  uint32_t overflowCount() const override { return sensor.overflowCount(); }
+  size_t backlog() const { return ring.size(); }
+
+private:
+  ImuSource& sensor;
+  SpscRing<ImuSample, SAMPLE_PIPE_CAPACITY> ring;
+  std::atomic<uint32_t> produced;
+};
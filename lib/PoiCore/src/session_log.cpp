@@ -0,0 +1,311 @@
+#include "session_log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "crc.h"
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+
+size_t encodeLogRecord(uint8_t* data, const LogRecord& record) {
+  put32(data, record.timestamp);
+  put16(data + 4, record.session);
+  data[6] = record.type;
+  data[7] = record.arg8;
+  put32(data + 8, (uint32_t)record.value);
+  put16(data + 12, record.arg16);
+  put16(data + 14, crc16(data, 14));
+  return SESSION_LOG_RECORD_SIZE;
+}
+
+bool decodeLogRecord(const uint8_t* data, LogRecord& record) {
+  if (get16(data + 14) != crc16(data, 14)) {
+    return false;
+  }
+  record.timestamp = get32(data);
+  record.session = get16(data + 4);
+  record.type = data[6];
+  record.arg8 = data[7];
+  record.value = (int32_t)get32(data + 8);
+  record.arg16 = get16(data + 12);
+  return true;
+}
+
+const char* logRecordTypeName(uint8_t type) {
+  switch (type) {
+    case LOG_SESSION_START: return "session_start";
+    case LOG_STALL_START: return "stall_start";
+    case LOG_STALL_END: return "stall_end";
+    case LOG_PATTERN_SENT: return "pattern_sent";
+    case LOG_SERVER_LATENCY: return "server_latency";
+    case LOG_PEAK_RPM: return "peak_rpm";
+    case LOG_GESTURE: return "gesture";
+    default: return "unknown";
+  }
+}
+
+size_t formatLogRecordCsv(char* out, size_t max, const LogRecord& record) {
+  int len = snprintf(out, max, "%u,%lu,%s,%u,%ld,%u\n", record.session, (unsigned long)record.timestamp,
+                     logRecordTypeName(record.type), record.arg8, (long)record.value, record.arg16);
+  return len < 0 ? 0 : ((size_t)len < max ? (size_t)len : max - 1);
+}
+
+void sessionLogPath(char* out, size_t max, int segment) {
+  snprintf(out, max, "/session%d.log", segment);
+}
+
+// Sequence number of a segment, 0 if it is missing or its header is bad
+static uint32_t readSegmentSeq(FileStore& store, int segment) {
+  char path[24];
+  uint8_t header[SESSION_LOG_RECORD_SIZE];
+  sessionLogPath(path, sizeof(path), segment);
+  if (store.readAt(path, 0, header, sizeof(header)) != (int)sizeof(header)
+      || memcmp(header, "PLOG", 4) != 0 || header[4] != SESSION_LOG_VERSION
+      || get16(header + 14) != crc16(header, 14)) {
+    return 0;
+  }
+  return get32(header + 8);
+}
+
+// ============================================================================
+// SessionLog
+// ============================================================================
+
+SessionLog::SessionLog(FileStore& store, Clock& clock, uint32_t segmentBytes)
+  : store(store),
+    clock(clock),
+    segmentBytes(segmentBytes),
+    currentSession(0),
+    segment(0),
+    segmentSeq(0),
+    segmentSize(0),
+    waitingSince(0),
+    written(0),
+    appends(0) {
+}
+
+bool SessionLog::startSegment(int segment, uint32_t seq) {
+  char path[24];
+  uint8_t header[SESSION_LOG_RECORD_SIZE] = {'P', 'L', 'O', 'G', SESSION_LOG_VERSION};
+  put32(header + 8, seq);
+  put16(header + 14, crc16(header, 14));
+  sessionLogPath(path, sizeof(path), segment);
+  // Replacing the file is what recycles the oldest segment
+  if (!store.write(path, header, sizeof(header))) {
+    poiLog("Session log: cannot start %s\n", path);
+    return false;
+  }
+  this->segment = segment;
+  segmentSeq = seq;
+  segmentSize = sizeof(header);
+  return true;
+}
+
+uint16_t SessionLog::lastSession(const uint32_t* seqs) {
+  // Newest segment first, last record first: normally one read
+  bool tried[SESSION_LOG_SEGMENTS] = {};
+  for (int n = 0; n < SESSION_LOG_SEGMENTS; n++) {
+    int newest = -1;
+    for (int i = 0; i < SESSION_LOG_SEGMENTS; i++) {
+      if (!tried[i] && seqs[i] && (newest < 0 || seqs[i] > seqs[newest])) newest = i;
+    }
+    if (newest < 0) break;
+    tried[newest] = true;
+
+    char path[24];
+    sessionLogPath(path, sizeof(path), newest);
+    int32_t size = store.size(path);
+    for (int32_t offset = (size / SESSION_LOG_RECORD_SIZE - 1) * SESSION_LOG_RECORD_SIZE;
+         offset >= SESSION_LOG_RECORD_SIZE; offset -= SESSION_LOG_RECORD_SIZE) {
+      uint8_t data[SESSION_LOG_RECORD_SIZE];
+      LogRecord record;
+      if (store.readAt(path, offset, data, sizeof(data)) == (int)sizeof(data) && decodeLogRecord(data, record)) {
+        return record.session;
+      }
+    }
+  }
+  return 0;
+}
+
+bool SessionLog::begin() {
+  uint32_t seqs[SESSION_LOG_SEGMENTS];
+  int newest = -1;
+  for (int i = 0; i < SESSION_LOG_SEGMENTS; i++) {
+    seqs[i] = readSegmentSeq(store, i);
+    if (seqs[i] && (newest < 0 || seqs[i] > seqs[newest])) newest = i;
+  }
+
+  currentSession = lastSession(seqs) + 1;
+  if (currentSession == SESSION_LOG_ALL_SESSIONS) currentSession = 1;
+
+  bool ok;
+  if (newest < 0) {
+    ok = startSegment(0, 1);
+  } else {
+    char path[24];
+    sessionLogPath(path, sizeof(path), newest);
+    segment = newest;
+    segmentSeq = seqs[newest];
+    segmentSize = (uint32_t)store.size(path);
+    ok = true;
+    // A reset mid-append leaves a partial record; pad it out so the
+    // following records stay aligned. The padding fails its CRC.
+    uint32_t partial = segmentSize % SESSION_LOG_RECORD_SIZE;
+    if (partial) {
+      uint8_t pad[SESSION_LOG_RECORD_SIZE];
+      memset(pad, 0xFF, sizeof(pad));
+      ok = store.append(path, pad, SESSION_LOG_RECORD_SIZE - partial);
+      segmentSize += SESSION_LOG_RECORD_SIZE - partial;
+    }
+  }
+  record(LOG_SESSION_START, clock.millis(), 0, 0);
+  poiLog("Session log: session %u, segment %d at %lu bytes\n", currentSession, segment,
+         (unsigned long)segmentSize);
+  return ok;
+}
+
+bool SessionLog::record(uint8_t type, uint32_t timestamp, uint8_t arg8, int32_t value, uint16_t arg16) {
+  LogRecord r;
+  r.timestamp = timestamp;
+  r.session = currentSession;
+  r.type = type;
+  r.arg8 = arg8;
+  r.value = value;
+  r.arg16 = arg16;
+  return queue.push(r);
+}
+
+void SessionLog::flush(bool force) {
+  size_t queued = queue.size();
+  if (queued == 0) return;
+
+  uint32_t now = clock.millis();
+  if (waitingSince == 0) waitingSince = now ? now : 1;
+  if (!force && queued * SESSION_LOG_RECORD_SIZE < SESSION_LOG_FLUSH_BYTES
+      && now - waitingSince < SESSION_LOG_FLUSH_INTERVAL_MS) {
+    return;
+  }
+  waitingSince = 0;
+
+  char path[24];
+  sessionLogPath(path, sizeof(path), segment);
+  uint8_t buffer[SESSION_LOG_FLUSH_BYTES];
+  size_t used = 0;
+  LogRecord records[SESSION_LOG_FLUSH_BYTES / SESSION_LOG_RECORD_SIZE];
+  size_t n;
+  while ((n = queue.pop(records, sizeof(records) / sizeof(records[0]))) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      if (segmentSize + used + SESSION_LOG_RECORD_SIZE > segmentBytes) {
+        // Segment full: finish it, then recycle the oldest
+        if (used > 0) {
+          store.append(path, buffer, used);
+          appends++;
+          segmentSize += used;
+          used = 0;
+        }
+        startSegment((segment + 1) % SESSION_LOG_SEGMENTS, segmentSeq + 1);
+        sessionLogPath(path, sizeof(path), segment);
+      }
+      used += encodeLogRecord(buffer + used, records[i]);
+      written++;
+      if (used == sizeof(buffer)) {
+        store.append(path, buffer, used);
+        appends++;
+        segmentSize += used;
+        used = 0;
+      }
+    }
+  }
+  if (used > 0) {
+    store.append(path, buffer, used);
+    appends++;
+    segmentSize += used;
+  }
+}
+
+// ============================================================================
+// SessionLogReader
+// ============================================================================
+
+SessionLogReader::SessionLogReader(FileStore& store, uint16_t session, uint32_t from, uint32_t to)
+  : store(store),
+    session(session),
+    from(from),
+    to(to),
+    segmentCount(0),
+    position(0),
+    offset(SESSION_LOG_RECORD_SIZE),
+    length(0),
+    used(0),
+    corrupt(0) {
+  uint32_t seqs[SESSION_LOG_SEGMENTS];
+  for (int i = 0; i < SESSION_LOG_SEGMENTS; i++) {
+    seqs[i] = readSegmentSeq(store, i);
+    if (seqs[i] == 0) continue;
+    // Insertion sort by sequence, oldest first
+    int j = segmentCount++;
+    while (j > 0 && seqs[order[j - 1]] > seqs[i]) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+}
+
+bool SessionLogReader::refill() {
+  while (position < segmentCount) {
+    char path[24];
+    sessionLogPath(path, sizeof(path), order[position]);
+    int n = store.readAt(path, offset, buffer, sizeof(buffer));
+    n -= n % SESSION_LOG_RECORD_SIZE;  // a partial record is still being written
+    if (n > 0) {
+      offset += n;
+      length = n;
+      used = 0;
+      return true;
+    }
+    position++;
+    offset = SESSION_LOG_RECORD_SIZE;
+  }
+  return false;
+}
+
+bool SessionLogReader::next(LogRecord& record) {
+  for (;;) {
+    if (used >= length && !refill()) {
+      return false;
+    }
+    const uint8_t* data = buffer + used;
+    used += SESSION_LOG_RECORD_SIZE;
+    if (!decodeLogRecord(data, record)) {
+      corrupt++;
+      continue;
+    }
+    if ((session == SESSION_LOG_ALL_SESSIONS || record.session == session)
+        && record.timestamp >= from && record.timestamp <= to) {
+      return true;
+    }
+  }
+}
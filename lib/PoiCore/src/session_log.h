@@ -0,0 +1,122 @@
+#pragma once
+
+#include "hal.h"
+#include "spsc_ring.h"
+
+#define SESSION_LOG_SEGMENTS 4
+#define SESSION_LOG_SEGMENT_BYTES 32768      // 2047 records after the header
+#define SESSION_LOG_FLUSH_BYTES 512          // append 32 records at a time
+#define SESSION_LOG_FLUSH_INTERVAL_MS 30000  // or after this long with fewer queued
+#define SESSION_LOG_QUEUE 128                // records between the loop and the writer
+#define SESSION_LOG_RECORD_SIZE 16
+#define SESSION_LOG_ALL_SESSIONS 0           // reader session filter
+
+// Record, little-endian, 16 bytes:
+//   timestamp(u32 millis) session(u16) type(u8) arg8(u8) value(i32) arg16(u16) crc16(u16)
+// The CRC covers the first 14 bytes. A segment file starts with a
+// 16-byte header in the same layout slot:
+//   'P' 'L' 'O' 'G' version 0 0 0 seq(u32) 0 0 crc16(u16)
+// and the segment with the highest seq is the one being appended to.
+#define SESSION_LOG_VERSION 1
+
+enum LogRecordType : uint8_t {
+  LOG_SESSION_START = 1,   // boot
+  LOG_STALL_START = 2,     // at the stop; arg8 1 if predicted, value = ms until confirmed
+  LOG_STALL_END = 3,       // rotation resumed; value = stall length in ms
+  LOG_PATTERN_SENT = 4,    // arg8 = pattern, value = pattern index, arg16 = poi targeted
+  LOG_SERVER_LATENCY = 5,  // arg8 = poi index, value = ms, arg16 = HTTP status (int16)
+  LOG_PEAK_RPM = 6,        // end of a spin; value = peak RPM * 10
+  LOG_GESTURE = 7,         // arg8 = Gesture, value = GestureAction taken
+};
+
+struct LogRecord {
+  uint32_t timestamp;
+  uint16_t session;
+  uint8_t type;
+  uint8_t arg8;
+  int32_t value;
+  uint16_t arg16;
+};
+
+size_t encodeLogRecord(uint8_t* data, const LogRecord& record);
+// False if the CRC does not match
+bool decodeLogRecord(const uint8_t* data, LogRecord& record);
+const char* logRecordTypeName(uint8_t type);
+// One CSV line "session,timestamp,type,arg8,value,arg16\n"; returns its length
+size_t formatLogRecordCsv(char* out, size_t max, const LogRecord& record);
+// Path of segment i
+void sessionLogPath(char* out, size_t max, int segment);
+
+// Append-only log of what happened during a performance, kept in a ring
+// of SESSION_LOG_SEGMENTS files. Only whole segments are ever replaced,
+// oldest first, so flash wear spreads over all of them and a segment is
+// written front to back once per lap of the ring.
+//
+// record() is called from the loop task and only queues; flush() runs on
+// a low priority writer task and appends SESSION_LOG_FLUSH_BYTES at a
+// time, so flash writes are few and never on the sensor or loop path.
+// Records still queued are lost on reset.
+class SessionLog {
+public:
+  SessionLog(FileStore& store, Clock& clock, uint32_t segmentBytes = SESSION_LOG_SEGMENT_BYTES);
+
+  // Find the newest segment and the last session, then start the next
+  // session. Call once, before the writer task starts.
+  bool begin();
+
+  // Loop task. Never blocks; a full queue drops the record.
+  bool record(uint8_t type, uint32_t timestamp, uint8_t arg8, int32_t value, uint16_t arg16 = 0);
+
+  // Writer task: append what is queued once enough piled up, or it waited
+  // long enough, or force is set
+  void flush(bool force = false);
+
+  uint16_t session() const { return currentSession; }
+  uint32_t recordCount() const { return written; }
+  uint32_t droppedCount() const { return queue.overrunCount(); }
+  uint32_t appendCount() const { return appends; }
+
+private:
+  bool startSegment(int segment, uint32_t seq);
+  uint16_t lastSession(const uint32_t* seqs);
+
+  FileStore& store;
+  Clock& clock;
+  uint32_t segmentBytes;
+  SpscRing<LogRecord, SESSION_LOG_QUEUE> queue;
+  uint16_t currentSession;
+  int segment;           // being appended to
+  uint32_t segmentSeq;
+  uint32_t segmentSize;
+  uint32_t waitingSince; // when the writer first saw records queued, 0 if none
+  uint32_t written;
+  uint32_t appends;
+};
+
+// Reads records back oldest first, across segments, keeping only one
+// session (or SESSION_LOG_ALL_SESSIONS) and timestamps in [from, to].
+// Holds one small buffer, never a whole segment, and may run on another
+// task than the writer. Records with a bad CRC (a torn write) are skipped.
+class SessionLogReader {
+public:
+  SessionLogReader(FileStore& store, uint16_t session, uint32_t from, uint32_t to);
+
+  bool next(LogRecord& record);
+  uint32_t corruptCount() const { return corrupt; }
+
+private:
+  bool refill();
+
+  FileStore& store;
+  uint16_t session;
+  uint32_t from;
+  uint32_t to;
+  int order[SESSION_LOG_SEGMENTS];  // segments oldest first
+  int segmentCount;
+  int position;                     // index into order
+  uint32_t offset;                  // next read in the current segment
+  uint8_t buffer[SESSION_LOG_RECORD_SIZE * 16];
+  size_t length;
+  size_t used;
+  uint32_t corrupt;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring buffer. push() may only be
+// called from one task and pop() from one other task. When the ring is full
+// new items are dropped and counted as overruns, so the producer never waits.
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() : head(0), tail(0), overruns(0) {}
+
+  // Producer side
+  bool push(const T& item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) {
+      // Single writer, so load+store instead of a read-modify-write
+      overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    items[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side: copy out up to max items, oldest first
+  size_t pop(T* out, size_t max) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t available = head.load(std::memory_order_acquire) - t;
+    size_t n = available < max ? available : max;
+    for (size_t i = 0; i < n; i++) {
+      out[i] = items[(t + i) & (N - 1)];
+    }
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  // Safe from either side, but only a snapshot
+  size_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  uint32_t overrunCount() const { return overruns.load(std::memory_order_relaxed); }
+  static constexpr uint32_t capacity() { return N; }
+
+private:
+  T items[N];
+  std::atomic<uint32_t> head;  // written by the producer
+  std::atomic<uint32_t> tail;  // written by the consumer
+  std::atomic<uint32_t> overruns;
+};
@@ -0,0 +1,109 @@
+#include "stall_detector.h"
+
+#include "hal.h"
+
+#define SPEED_TAU_MS 15   // smoothing of |speed|
+#define SLOPE_TAU_MS 30   // smoothing of its derivative
+#define DECEL_TAU_MS 400  // how long a deceleration is remembered
+#define MAX_STEP_MS 100   // longer gaps between samples are treated as this
+
+// Exponential moving average step with time constant tau for a gap of dt
+static inline int32_t ema(int32_t value, int32_t target, int32_t dt, int32_t tau) {
+  return value + (int32_t)((int64_t)(target - value) * dt / (tau + dt));
+}
+
+static inline int32_t min256(int32_t v) {
+  return v < 0 ? 0 : (v > 256 ? 256 : v);
+}
+
+StallDetector::StallDetector(const StallDetectorConfig& config)
+  : rotating(false),
+    predictedStall(false),
+    lastMovement(0),
+    stoppedAt(0),
+    aboveSince(0),
+    lastSample(0),
+    smoothSpeed(0),
+    slope(0),
+    peakDecel(0),
+    confidence(0) {
+  configure(config);
+}
+
+void StallDetector::configure(const StallDetectorConfig& config) {
+  this->config = config;
+  startRaw = (int32_t)(config.gyroThreshold * GYRO_LSB_PER_DPS);
+  stopRaw = (int32_t)(config.stopThreshold * GYRO_LSB_PER_DPS);
+  if (stopRaw < 1) stopRaw = 1;
+  decelRaw = (int32_t)(config.decelReference * GYRO_LSB_PER_DPS / 256);
+  if (decelRaw < 4) decelRaw = 4;
+  confidenceQ8 = (uint16_t)(config.confidence * 256);
+}
+
+bool StallDetector::update(int32_t rotationSpeed, uint32_t now) {
+  int32_t speed = rotationSpeed < 0 ? -rotationSpeed : rotationSpeed;
+  bool started = false;
+
+  // Movement detection with debounce
+  if (speed > startRaw) {
+    lastMovement = now;
+    if (aboveSince == 0) aboveSince = now ? now : 1;
+    if (!rotating && now - aboveSince >= config.startHoldMs) {
+      rotating = true;
+      predictedStall = false;
+      started = true;
+    }
+  } else {
+    aboveSince = 0;
+    if (speed < stopRaw && rotating) {
+      rotating = false;
+      stoppedAt = now;
+    }
+  }
+
+  if (config.predictive) {
+    updateConfidence(speed, now);
+    if (!rotating && !predictedStall && confidence >= confidenceQ8) {
+      predictedStall = true;
+    }
+  }
+  return started;
+}
+
+void StallDetector::updateConfidence(int32_t speed, uint32_t now) {
+  int32_t dt = lastSample ? (int32_t)(now - lastSample) : 0;
+  lastSample = now;
+  if (dt <= 0) {
+    smoothSpeed = speed << 4;
+    return;
+  }
+  if (dt > MAX_STEP_MS) dt = MAX_STEP_MS;
+
+  int32_t previous = smoothSpeed;
+  smoothSpeed = ema(smoothSpeed, speed << 4, dt, SPEED_TAU_MS);
+  int32_t rawSlope = ((smoothSpeed - previous) * 1000 / dt) >> 4;  // LSB/s
+  slope = ema(slope, rawSlope, dt, SLOPE_TAU_MS);
+
+  peakDecel = ema(peakDecel, 0, dt, DECEL_TAU_MS);
+  if (-slope > peakDecel) peakDecel = -slope;
+
+  if (rotating) {
+    confidence = 0;
+    return;
+  }
+
+  uint32_t below = now - stoppedAt;
+  if (below > config.settleMs) below = config.settleMs;
+  int32_t absSlope = slope < 0 ? -slope : slope;
+  int32_t time = config.settleMs ? min256((int32_t)(below * 256 / config.settleMs)) : 256;
+  int32_t level = 256 - min256((smoothSpeed >> 4) * 256 / stopRaw);
+  int32_t decel = min256(peakDecel / decelRaw);
+  int32_t settled = 256 - min256(absSlope * 4 / decelRaw);
+  // time * (0.4 level + 0.3 decel + 0.3 settled), all Q8
+  confidence = (uint16_t)((time * (102 * level + 77 * decel + 77 * settled)) >> 16);
+}
+
+bool StallDetector::isStill(uint32_t now) const {
+  if (rotating) return false;
+  return predictedStall || now - lastMovement > config.stillTimeoutMs;
+}
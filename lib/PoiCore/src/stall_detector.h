@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+struct StallDetectorConfig {
+  float gyroThreshold = 200.0f;     // deg/s: rotation starts above this
+  float stopThreshold = 100.0f;     // deg/s: rotation stops below this (hysteresis)
+  uint32_t startHoldMs = 30;        // must stay above gyroThreshold this long to count as rotation
+  uint32_t stillTimeoutMs = 2000;   // stall confirmed after this long without movement
+  bool predictive = false;          // allow confirming a stall before stillTimeoutMs
+  float confidence = 0.8f;          // 0..1, early confirmation threshold
+  uint32_t settleMs = 250;          // time below stopThreshold for full confidence
+  float decelReference = 2000.0f;   // deg/s^2 of deceleration that counts as a deliberate stop
+  bool autoCalibrate = true;        // learn gyro bias and thresholds, see GyroCalibrator
+};
+
+// Rotation start/stop and stall detection on the speed of the chosen axis.
+//
+// Rotation starts once the speed stays above gyroThreshold for startHoldMs
+// and stops when it falls below stopThreshold. A stall is confirmed either
+// after stillTimeoutMs without movement, or - in predictive mode - as soon
+// as the stall confidence reaches config.confidence. Confidence grows with
+// the time spent below stopThreshold and is weighted by how close to zero
+// the speed is, how hard the poi decelerated into the stop and whether the
+// speed has settled (not picking up again).
+//
+// The per-sample path is integer only (the ESP32-C3 has no FPU): speeds are
+// raw gyro LSB and the thresholds are scaled once in configure().
+class StallDetector {
+public:
+  explicit StallDetector(const StallDetectorConfig& config = StallDetectorConfig());
+
+  void configure(const StallDetectorConfig& config);
+  const StallDetectorConfig& settings() const { return config; }
+
+  // Feed one raw rotation speed sample (GYRO_LSB_PER_DPS per deg/s).
+  // Returns true when rotation (re)starts, which is when the next pattern
+  // gets queued.
+  bool update(int32_t rotationSpeed, uint32_t now);
+
+  bool isRotating() const { return rotating; }
+  bool isStill(uint32_t now) const;
+  // true if the current stall was confirmed early by the predictor
+  bool confirmedEarly() const { return predictedStall; }
+  float stallConfidence() const { return confidence / 256.0f; }
+  uint16_t stallConfidenceQ8() const { return confidence; }  // 0..256
+  uint32_t lastMovementTime() const { return lastMovement; }
+  // When rotation last fell below stopThreshold
+  uint32_t stopTime() const { return stoppedAt; }
+
+private:
+  void updateConfidence(int32_t speed, uint32_t now);
+
+  StallDetectorConfig config;
+  int32_t startRaw;         // gyroThreshold in LSB
+  int32_t stopRaw;          // stopThreshold in LSB
+  int32_t decelRaw;         // decelReference in LSB/s, divided by 256
+  uint16_t confidenceQ8;    // config.confidence * 256
+
+  bool rotating;
+  bool predictedStall;
+  uint32_t lastMovement;
+  uint32_t stoppedAt;
+  uint32_t aboveSince;  // start of the current run above gyroThreshold, 0 if none
+  uint32_t lastSample;
+
+  // Predictor state
+  int32_t smoothSpeed;  // |speed| in LSB * 16
+  int32_t slope;        // LSB/s
+  int32_t peakDecel;    // strongest recent deceleration in LSB/s, decays over time
+  uint16_t confidence;  // 0..256
+};
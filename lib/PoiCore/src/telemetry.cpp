@@ -0,0 +1,64 @@
+#include "telemetry.h"
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+TelemetryStream::TelemetryStream(TelemetrySink& sink, int decimation)
+  : sink(sink),
+    decimation(decimation > 0 ? decimation : 1),
+    streaming(false),
+    seq(0),
+    dropped(0) {
+  reset();
+}
+
+void TelemetryStream::reset() {
+  sumX = sumY = sumZ = 0;
+  windowCount = 0;
+  points = 0;
+}
+
+void TelemetryStream::poll() {
+  bool active = sink.active();
+  if (active && !streaming) {
+    reset();
+  }
+  streaming = active;
+}
+
+void TelemetryStream::addPoint(uint32_t timestamp, uint8_t state, uint8_t confidence) {
+  uint8_t* p = frame + TELEMETRY_HEADER_SIZE + points * TELEMETRY_POINT_SIZE;
+  put16(p, (uint16_t)(int16_t)(sumX / decimation));
+  put16(p + 2, (uint16_t)(int16_t)(sumY / decimation));
+  put16(p + 4, (uint16_t)(int16_t)(sumZ / decimation));
+  p[6] = state;
+  p[7] = confidence;
+  sumX = sumY = sumZ = 0;
+  windowCount = 0;
+
+  if (points == 0) {
+    put32(frame + 8, timestamp);
+  }
+  if (++points < TELEMETRY_POINTS_PER_FRAME) return;
+
+  frame[0] = 'T';
+  frame[1] = 'M';
+  frame[2] = TELEMETRY_VERSION;
+  frame[3] = TELEMETRY_POINTS_PER_FRAME;
+  put16(frame + 4, ++seq);
+  put16(frame + 6, dropped);
+  put32(frame + 12, timestamp);
+  if (!sink.trySend(frame, sizeof(frame))) {
+    dropped++;
+  }
+  points = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "hal.h"
+
+#define TELEMETRY_RATE_HZ 100       // points per second after downsampling
+#define TELEMETRY_POINTS_PER_FRAME 25
+
+// Binary frame, little-endian:
+//   header 'T' 'M' version points(u8) seq(u16) dropped(u16)
+//          firstTimestamp(u32) lastTimestamp(u32)
+//   points gyroX gyroY gyroZ (i16, raw LSB averaged over the window)
+//          state(u8, TELEMETRY_*) confidence(u8, stall confidence 0..255)
+// seq counts frames built, so a gap means frames were dropped; dropped is
+// the running total.
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_SIZE 16
+#define TELEMETRY_POINT_SIZE 8
+#define TELEMETRY_FRAME_SIZE (TELEMETRY_HEADER_SIZE + TELEMETRY_POINTS_PER_FRAME * TELEMETRY_POINT_SIZE)
+
+#define TELEMETRY_ROTATING 0x01
+#define TELEMETRY_STILL 0x02       // stall confirmed
+#define TELEMETRY_PREDICTED 0x04   // ... early, by the predictor
+
+// Downsamples the gyro stream and the detector state to
+// TELEMETRY_RATE_HZ and hands frames to a TelemetrySink. Frames the sink
+// cannot take are dropped, so a slow client never holds up the loop.
+// Fed from the loop task, after the samples left the sensor task.
+class TelemetryStream {
+public:
+  // decimation: sensor samples averaged into one point
+  TelemetryStream(TelemetrySink& sink, int decimation);
+
+  // Someone is listening; add() is a no-op otherwise
+  bool active() const { return streaming; }
+  // Per sample
+  void add(const ImuSample& sample, uint8_t state, uint8_t confidence) {
+    if (!streaming) return;
+    sumX += sample.gyroX;
+    sumY += sample.gyroY;
+    sumZ += sample.gyroZ;
+    if (++windowCount == decimation) {
+      addPoint(sample.timestamp, state, confidence);
+    }
+  }
+  // Once per loop: notice clients coming and going
+  void poll();
+
+  uint32_t frameCount() const { return seq; }
+  uint32_t droppedCount() const { return dropped; }
+
+private:
+  void addPoint(uint32_t timestamp, uint8_t state, uint8_t confidence);
+  void reset();
+
+  TelemetrySink& sink;
+  int decimation;
+  bool streaming;
+  int32_t sumX, sumY, sumZ;
+  int windowCount;
+  int points;
+  uint16_t seq;
+  uint16_t dropped;
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+};
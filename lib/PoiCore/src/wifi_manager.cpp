@@ -0,0 +1,277 @@
+#include "wifi_manager.h"
+
+#include <string.h>
+
+WifiManager::WifiManager(WifiDriver& driver, Clock& clock, WiFiSettings& settings,
+                         const char* fallbackSsid, const char* fallbackPassword)
+  : driver(driver),
+    clock(clock),
+    settings(settings),
+    fallbackSsid(fallbackSsid),
+    fallbackPassword(fallbackPassword),
+    state(WIFI_IDLE),
+    restartRequested(false),
+    current(CONFIG_NO_NETWORK),
+    deadline(0),
+    backoffMs(WIFI_BACKOFF_MIN_MS),
+    promoteAt(0),
+    candidateCount(0),
+    nextCandidate(0),
+    lastChanged(false),
+    up(false),
+    connects(0),
+    disconnects(0),
+    failedRounds(0),
+    scans(0),
+    callback(NULL),
+    callbackContext(NULL) {
+  memset(failures, 0, sizeof(failures));
+}
+
+void WifiManager::onChange(WifiChangeCallback callback, void* context) {
+  this->callback = callback;
+  callbackContext = context;
+}
+
+const char* WifiManager::stateName(WifiState state) {
+  switch (state) {
+    case WIFI_IDLE: return "idle";
+    case WIFI_FAST_CONNECT: return "fast connect";
+    case WIFI_SCANNING: return "scanning";
+    case WIFI_CONNECTING: return "connecting";
+    case WIFI_CONNECTED: return "connected";
+    case WIFI_PROMOTE_SCAN: return "connected, scanning";
+    case WIFI_BACKOFF: return "backoff";
+    default: return "unknown";
+  }
+}
+
+bool WifiManager::takeLastChanged() {
+  bool changed = lastChanged;
+  lastChanged = false;
+  return changed;
+}
+
+const char* WifiManager::ssid(int network) const {
+  return network == CONFIG_FALLBACK_NETWORK ? fallbackSsid : settings.networks[network].ssid;
+}
+
+const char* WifiManager::password(int network) const {
+  return network == CONFIG_FALLBACK_NETWORK ? fallbackPassword : settings.networks[network].password;
+}
+
+bool WifiManager::usable(int network) const {
+  if (network == CONFIG_FALLBACK_NETWORK) {
+    return settings.fallbackEnabled && fallbackSsid && fallbackSsid[0];
+  }
+  return network >= 0 && network < CONFIG_NETWORKS && settings.networks[network].enabled
+      && settings.networks[network].ssid[0];
+}
+
+void WifiManager::begin() {
+  startRound();
+}
+
+void WifiManager::startRound() {
+  // Same access point as last time: no scan, and no DHCP either if the
+  // lease may be reused
+  const WiFiLastConnection& last = settings.last;
+  if (usable(last.network) && last.channel > 0 && failures[last.network] < WIFI_DEMOTE_FAILURES) {
+    current = last.network;
+    poiLog("WiFi: joining %s on channel %u\n", ssid(current), last.channel);
+    driver.connect(ssid(current), password(current), last.bssid, last.channel,
+                   settings.reuseLease ? &last : NULL);
+    state = WIFI_FAST_CONNECT;
+    deadline = clock.millis() + WIFI_FAST_CONNECT_MS;
+    return;
+  }
+  startScan(WIFI_SCANNING);
+}
+
+void WifiManager::startScan(WifiState scanState) {
+  scans++;
+  state = scanState;
+  deadline = clock.millis() + WIFI_SCAN_TIMEOUT_MS;
+  if (!driver.startScan()) {
+    deadline = clock.millis();  // handled as a scan that found nothing
+  }
+}
+
+void WifiManager::pickCandidates(bool savedOnly) {
+  WifiScanResult results[WIFI_SCAN_RESULTS];
+  int found = driver.scanResults(results, WIFI_SCAN_RESULTS);
+
+  // Strongest access point of each usable network
+  candidateCount = 0;
+  for (int network = 0; network <= CONFIG_FALLBACK_NETWORK; network++) {
+    if ((savedOnly && network == CONFIG_FALLBACK_NETWORK) || !usable(network)) continue;
+    int best = -1;
+    for (int i = 0; i < found; i++) {
+      if (strcmp(results[i].ssid, ssid(network)) == 0 && (best < 0 || results[i].rssi > results[best].rssi)) {
+        best = i;
+      }
+    }
+    if (best < 0) continue;
+    Candidate& c = candidates[candidateCount++];
+    c.network = network;
+    memcpy(c.bssid, results[best].bssid, sizeof(c.bssid));
+    c.channel = results[best].channel;
+    c.rssi = results[best].rssi;
+  }
+
+  // Saved networks strongest first, demoted ones after them, fallback last
+  for (int i = 1; i < candidateCount; i++) {
+    Candidate c = candidates[i];
+    int rank = c.network == CONFIG_FALLBACK_NETWORK ? 2 : failures[c.network] >= WIFI_DEMOTE_FAILURES;
+    int j = i;
+    for (; j > 0; j--) {
+      const Candidate& prev = candidates[j - 1];
+      int prevRank = prev.network == CONFIG_FALLBACK_NETWORK ? 2 : failures[prev.network] >= WIFI_DEMOTE_FAILURES;
+      if (prevRank < rank || (prevRank == rank && prev.rssi >= c.rssi)) break;
+      candidates[j] = prev;
+    }
+    candidates[j] = c;
+  }
+  nextCandidate = 0;
+}
+
+void WifiManager::connectNext() {
+  uint32_t now = clock.millis();
+  if (nextCandidate >= candidateCount) {
+    // Nothing joined this round
+    failedRounds++;
+    current = CONFIG_NO_NETWORK;
+    state = WIFI_BACKOFF;
+    deadline = now + backoffMs;
+    poiLog("WiFi: no network joined, retrying in %lu s\n", (unsigned long)(backoffMs / 1000));
+    backoffMs = backoffMs * 2 < WIFI_BACKOFF_MAX_MS ? backoffMs * 2 : WIFI_BACKOFF_MAX_MS;
+    return;
+  }
+  const Candidate& c = candidates[nextCandidate++];
+  current = c.network;
+  poiLog("WiFi: joining %s on channel %u (%d dBm)\n", ssid(current), c.channel, c.rssi);
+  driver.connect(ssid(current), password(current), c.bssid, c.channel, NULL);
+  state = WIFI_CONNECTING;
+  deadline = now + WIFI_CONNECT_MS;
+}
+
+void WifiManager::attemptFailed() {
+  if (failures[current] < 255) failures[current]++;
+  driver.disconnect();
+  if (state == WIFI_FAST_CONNECT) {
+    startScan(WIFI_SCANNING);
+  } else {
+    connectNext();
+  }
+}
+
+void WifiManager::joined() {
+  uint32_t now = clock.millis();
+  WiFiLastConnection last;
+  memset(&last, 0, sizeof(last));
+  driver.connection(last);
+  last.network = current;
+  if (memcmp(&last, &settings.last, sizeof(last)) != 0) {
+    settings.last = last;
+    lastChanged = true;
+  }
+  settings.currentNetwork = current;
+  failures[current] = 0;
+  backoffMs = WIFI_BACKOFF_MIN_MS;
+  connects++;
+  state = WIFI_CONNECTED;
+  promoteAt = now + WIFI_PROMOTE_INTERVAL_MS;
+  poiLog("WiFi: connected to %s\n", ssid(current));
+  setConnected(true);
+}
+
+void WifiManager::lost() {
+  disconnects++;
+  poiLog("WiFi: lost %s\n", ssid(current));
+  if (failures[current] < 255) failures[current]++;
+  setConnected(false);
+  // settings.last is this access point: try it again once before scanning
+  startRound();
+}
+
+void WifiManager::setConnected(bool connected) {
+  if (connected == up) return;
+  up = connected;
+  if (callback) {
+    callback(callbackContext, connected);
+  }
+}
+
+void WifiManager::poll() {
+  uint8_t events = driver.takeEvents();
+  uint32_t now = clock.millis();
+  bool expired = (int32_t)(now - deadline) >= 0;
+
+  if (restartRequested) {
+    restartRequested = false;
+    driver.disconnect();
+    setConnected(false);
+    memset(failures, 0, sizeof(failures));
+    backoffMs = WIFI_BACKOFF_MIN_MS;
+    startRound();
+    return;
+  }
+
+  switch (state) {
+    case WIFI_IDLE:
+      break;
+
+    case WIFI_FAST_CONNECT:
+    case WIFI_CONNECTING:
+      if (events & POI_WIFI_CONNECTED) {
+        joined();
+      } else if ((events & POI_WIFI_DISCONNECTED) || expired) {
+        attemptFailed();
+      }
+      break;
+
+    case WIFI_SCANNING:
+      if (events & POI_WIFI_SCAN_DONE) {
+        pickCandidates(false);
+        connectNext();
+      } else if (expired) {
+        candidateCount = nextCandidate = 0;
+        connectNext();
+      }
+      break;
+
+    case WIFI_CONNECTED:
+      if (events & POI_WIFI_DISCONNECTED) {
+        lost();
+      } else if (current == CONFIG_FALLBACK_NETWORK && (int32_t)(now - promoteAt) >= 0) {
+        startScan(WIFI_PROMOTE_SCAN);
+      }
+      break;
+
+    case WIFI_PROMOTE_SCAN:
+      if (events & POI_WIFI_DISCONNECTED) {
+        lost();
+      } else if (events & POI_WIFI_SCAN_DONE) {
+        pickCandidates(true);
+        if (candidateCount > 0) {
+          poiLog("WiFi: %s is in range, leaving the fallback\n", ssid(candidates[0].network));
+          driver.disconnect();
+          setConnected(false);
+          connectNext();
+        } else {
+          state = WIFI_CONNECTED;
+          promoteAt = now + WIFI_PROMOTE_INTERVAL_MS;
+        }
+      } else if (expired) {
+        state = WIFI_CONNECTED;
+        promoteAt = now + WIFI_PROMOTE_INTERVAL_MS;
+      }
+      break;
+
+    case WIFI_BACKOFF:
+      if (expired) {
+        startRound();
+      }
+      break;
+  }
+}
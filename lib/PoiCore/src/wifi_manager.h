@@ -0,0 +1,115 @@
+#pragma once
+
+#include "config_store.h"
+#include "hal.h"
+
+#define WIFI_FAST_CONNECT_MS 1500       // straight to the cached access point
+#define WIFI_CONNECT_MS 10000           // to one a scan just found
+#define WIFI_SCAN_TIMEOUT_MS 5000
+#define WIFI_BACKOFF_MIN_MS 1000        // first retry after a round where nothing joined
+#define WIFI_BACKOFF_MAX_MS 30000
+#define WIFI_DEMOTE_FAILURES 2          // failures in a row before a network goes to the back
+#define WIFI_PROMOTE_INTERVAL_MS 60000  // on the fallback, look for a saved network this often
+#define WIFI_SCAN_RESULTS 20
+
+enum WifiState : uint8_t {
+  WIFI_IDLE,
+  WIFI_FAST_CONNECT,  // joining the cached access point
+  WIFI_SCANNING,
+  WIFI_CONNECTING,    // joining the scan's candidates in turn
+  WIFI_CONNECTED,
+  WIFI_PROMOTE_SCAN,  // connected to the fallback, looking for a saved network
+  WIFI_BACKOFF,       // nothing joined, waiting before the next round
+};
+
+// Called on the main loop when the connection comes up or goes down
+typedef void (*WifiChangeCallback)(void* context, bool connected);
+
+// Non-blocking station connection manager, driven by WifiDriver events
+// and polled from the main loop.
+//
+// A round starts with the access point in settings.last if there is one,
+// then falls back to one scan and the saved networks that are in range,
+// strongest first, with the secrets.h fallback last. A network that
+// failed WIFI_DEMOTE_FAILURES times in a row is tried after the others
+// until it works again. When a round joins nothing, the next one starts
+// after a backoff that doubles up to WIFI_BACKOFF_MAX_MS.
+//
+// A lost connection retries the same access point once, then starts a
+// round. While on the fallback, a scan every WIFI_PROMOTE_INTERVAL_MS
+// moves back to a saved network as soon as one is in range.
+class WifiManager {
+public:
+  WifiManager(WifiDriver& driver, Clock& clock, WiFiSettings& settings,
+              const char* fallbackSsid, const char* fallbackPassword);
+
+  void onChange(WifiChangeCallback callback, void* context);
+  void begin();
+  // Start over with the current settings at the next poll(); safe to call
+  // from another task, e.g. a web handler that just saved new settings
+  void restart() { restartRequested = true; }
+  void poll();
+
+  bool connected() const { return state == WIFI_CONNECTED || state == WIFI_PROMOTE_SCAN; }
+  WifiState currentState() const { return state; }
+  static const char* stateName(WifiState state);
+  // Network joined or being joined, CONFIG_NO_NETWORK if none
+  int network() const { return current; }
+  // Has settings.last changed since the last call? It then needs saving.
+  bool takeLastChanged();
+
+  bool everConnected() const { return connects > 0; }
+  uint32_t connectCount() const { return connects; }
+  uint32_t disconnectCount() const { return disconnects; }
+  uint32_t failedRoundCount() const { return failedRounds; }
+  uint32_t scanCount() const { return scans; }
+
+private:
+  struct Candidate {
+    uint8_t network;
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+  };
+
+  const char* ssid(int network) const;
+  const char* password(int network) const;
+  bool usable(int network) const;
+
+  void startRound();
+  void startScan(WifiState scanState);
+  // Fill candidates from the scan; saved networks only if savedOnly
+  void pickCandidates(bool savedOnly);
+  void connectNext();
+  void attemptFailed();
+  void joined();
+  void lost();
+  void setConnected(bool up);
+
+  WifiDriver& driver;
+  Clock& clock;
+  WiFiSettings& settings;
+  const char* fallbackSsid;
+  const char* fallbackPassword;
+
+  volatile WifiState state;
+  volatile bool restartRequested;
+  uint8_t current;
+  uint32_t deadline;
+  uint32_t backoffMs;
+  uint32_t promoteAt;
+  Candidate candidates[CONFIG_NETWORKS + 1];
+  int candidateCount;
+  int nextCandidate;
+  uint8_t failures[CONFIG_NETWORKS + 1];
+  bool lastChanged;
+  bool up;
+
+  uint32_t connects;
+  uint32_t disconnects;
+  uint32_t failedRounds;
+  uint32_t scans;
+
+  WifiChangeCallback callback;
+  void* callbackContext;
+};
@@ -0,0 +1,65 @@
+# Build step (PlatformIO extra_scripts = pre:...): gzips the pages in data/
+# into src/web_assets.cpp as const arrays, so the web server sends them
+# straight from flash with Content-Encoding: gzip and an ETag. The output
+# is only rewritten when a page changes, so unchanged pages do not force a
+# rebuild. Also runs standalone: python scripts/embed_web_assets.py
+
+import gzip
+import hashlib
+import os
+
+ASSETS = [
+    # (file in data/, URL path, content type)
+    ("index.html", "/index.html", "text/html"),
+    ("wifi_config.html", "/wifi_config.html", "text/html"),
+]
+
+HEADER = """// Generated by scripts/embed_web_assets.py from data/, do not edit.
+
+#include "web_assets.h"
+
+"""
+
+
+def symbol(name):
+    return "asset_" + "".join(c if c.isalnum() else "_" for c in name)
+
+
+def embed(project_dir):
+    out = [HEADER]
+    table = []
+    for name, path, content_type in ASSETS:
+        with open(os.path.join(project_dir, "data", name), "rb") as f:
+            raw = f.read()
+        # mtime=0 keeps the output, and so the ETag, stable across builds
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha1(packed).hexdigest()[:16]
+        out.append("// %s: %d bytes, %d gzipped\n" % (name, len(raw), len(packed)))
+        out.append("static const uint8_t %s[] = {\n" % symbol(name))
+        for i in range(0, len(packed), 16):
+            out.append("  " + ", ".join("0x%02x" % b for b in packed[i:i + 16]) + ",\n")
+        out.append("};\n\n")
+        table.append('  {"%s", "%s", %s, sizeof(%s), "%s"},\n'
+                     % (path, content_type, symbol(name), symbol(name), etag.replace('"', '\\"')))
+        print("Embedding data/%s: %d -> %d bytes" % (name, len(raw), len(packed)))
+
+    out.append("const WebAsset webAssets[] = {\n")
+    out.extend(table)
+    out.append("};\n\n")
+    out.append("const size_t webAssetCount = sizeof(webAssets) / sizeof(webAssets[0]);\n")
+    source = "".join(out)
+
+    target = os.path.join(project_dir, "src", "web_assets.cpp")
+    if os.path.exists(target):
+        with open(target) as f:
+            if f.read() == source:
+                return
+    with open(target, "w") as f:
+        f.write(source)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    embed(env["PROJECT_DIR"])  # noqa: F821
+except NameError:
+    embed(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,474 @@
+#include "hal_esp32.h"
+
+#include <stdarg.h>
+#include <HTTPClient.h>
+#include <LittleFS.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+void poiLog(const char* fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  Serial.print(buf);
+}
+
+// ============================================================================
+// I2C
+// ============================================================================
+
+void WireI2cBus::begin(uint32_t clockHz) {
+  wire.begin();
+  wire.setClock(clockHz);
+}
+
+bool WireI2cBus::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.write(value);
+  return wire.endTransmission() == 0;
+}
+
+bool WireI2cBus::readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t len) {
+  wire.beginTransmission(address);
+  wire.write(reg);
+  if (wire.endTransmission(false) != 0) {  // repeated start
+    return false;
+  }
+  if (wire.requestFrom((uint16_t)address, len) != len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    data[i] = wire.read();
+  }
+  return true;
+}
+
+// ============================================================================
+// Status LED
+// ============================================================================
+
+void GpioLed::begin() {
+  pinMode(pin, OUTPUT);
+  set(false);
+}
+
+void GpioLed::set(bool on) {
+  digitalWrite(pin, on != activeLow ? HIGH : LOW);
+}
+
+// ============================================================================
+// Async TCP
+// ============================================================================
+
+AsyncTcpConnection::AsyncTcpConnection()
+  : tcpState(TCP_IDLE),
+    overflowed(false),
+    mux(portMUX_INITIALIZER_UNLOCKED),
+    pendingLen(0) {
+  client.onConnect(handleConnect, this);
+  client.onData(handleData, this);
+  client.onDisconnect(handleDisconnect, this);
+  client.onError(handleError, this);
+}
+
+bool AsyncTcpConnection::connect(const char* host, uint16_t port) {
+  // Drop anything left over from the previous connection
+  char discard[64];
+  while (rx.pop(discard, sizeof(discard)) > 0) {
+  }
+  overflowed = false;
+  pendingLen = 0;
+  tcpState = TCP_CONNECTING;
+  if (!client.connect(host, port)) {
+    tcpState = TCP_CLOSED;
+    return false;
+  }
+  return true;
+}
+
+bool AsyncTcpConnection::send(const char* data, size_t len) {
+  bool sendNow = false;
+  taskENTER_CRITICAL(&mux);
+  if (tcpState == TCP_CONNECTED) {
+    sendNow = true;
+  } else if (tcpState == TCP_CONNECTING && pendingLen + len <= sizeof(pending)) {
+    memcpy(pending + pendingLen, data, len);
+    pendingLen += len;
+  } else {
+    taskEXIT_CRITICAL(&mux);
+    return false;
+  }
+  taskEXIT_CRITICAL(&mux);
+
+  if (sendNow) {
+    return client.write(data, len) == len;
+  }
+  return true;
+}
+
+size_t AsyncTcpConnection::receive(char* data, size_t max) {
+  if (overflowed) {
+    // Never hand the parser a response with a hole in it. The connection
+    // is closed, so ConnectionPool fails the request (retrying it once on
+    // a fresh connection if this one was reused) rather than waiting for
+    // the dispatch timeout
+    char discard[64];
+    while (rx.pop(discard, sizeof(discard)) > 0) {
+    }
+    return 0;
+  }
+  return rx.pop(data, max);
+}
+
+void AsyncTcpConnection::close() {
+  if (tcpState == TCP_CONNECTING || tcpState == TCP_CONNECTED) {
+    client.close(true);
+  }
+  tcpState = TCP_CLOSED;
+}
+
+void AsyncTcpConnection::handleConnect(void* arg, AsyncClient* client) {
+  AsyncTcpConnection* self = (AsyncTcpConnection*)arg;
+  char data[sizeof(self->pending)];
+  size_t len;
+  taskENTER_CRITICAL(&self->mux);
+  self->tcpState = TCP_CONNECTED;
+  len = self->pendingLen;
+  memcpy(data, self->pending, len);
+  self->pendingLen = 0;
+  taskEXIT_CRITICAL(&self->mux);
+
+  if (len > 0) {
+    client->write(data, len);
+  }
+}
+
+void AsyncTcpConnection::handleData(void* arg, AsyncClient* client, void* data, size_t len) {
+  AsyncTcpConnection* self = (AsyncTcpConnection*)arg;
+  if (self->overflowed) {
+    return;
+  }
+  const char* bytes = (const char*)data;
+  for (size_t i = 0; i < len; i++) {
+    if (!self->rx.push(bytes[i])) {
+      // The loop has not kept up or the response is bigger than rx
+      self->overflowed = true;
+      self->tcpState = TCP_CLOSED;
+      client->close(true);
+      poiLog("TCP receive buffer full, %u bytes dropped - connection closed\n", (unsigned)(len - i));
+      return;
+    }
+  }
+}
+
+void AsyncTcpConnection::handleDisconnect(void* arg, AsyncClient* client) {
+  ((AsyncTcpConnection*)arg)->tcpState = TCP_CLOSED;
+}
+
+void AsyncTcpConnection::handleError(void* arg, AsyncClient* client, int8_t error) {
+  ((AsyncTcpConnection*)arg)->tcpState = TCP_CLOSED;
+}
+
+// ============================================================================
+// HTTP
+// ============================================================================
+
+// Stream adapter that hands HTTPClient output to an HttpBodySink
+class SinkStream : public Stream {
+public:
+  explicit SinkStream(HttpBodySink* sink) : sink(sink) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    if (sink) sink->write((const char*)data, len);
+    return len;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+
+private:
+  HttpBodySink* sink;
+};
+
+WiFiClient& Esp32HttpTransport::clientFor(const char* host) {
+  for (CachedClient& c : clients) {
+    if (c.host && strcmp(c.host, host) == 0) {
+      return c.client;
+    }
+  }
+  // Evict round-robin
+  CachedClient& c = clients[nextSlot];
+  nextSlot = (nextSlot + 1) % 4;
+  c.client.stop();
+  c.host = host;
+  return c.client;
+}
+
+int Esp32HttpTransport::get(const char* host, uint16_t port, const char* path, uint32_t timeoutMs,
+                            HttpBodySink* body) {
+  HTTPClient http;
+  http.setReuse(true);  // HTTP/1.1 keep-alive, end() leaves the socket open
+
+  if (!http.begin(clientFor(host), host, port, path)) {
+    return -1;
+  }
+  http.setTimeout(timeoutMs);
+  int httpCode = http.GET();
+
+  if (httpCode > 0) {
+    // Always drain the body so the connection can be reused. writeToStream()
+    // handles chunked encoding and passes the body on in small pieces.
+    SinkStream stream(body);
+    int written = http.writeToStream(&stream);
+    if (written < 0) {
+      httpCode = written;
+    }
+  }
+
+  http.end();
+  return httpCode;
+}
+
+// ============================================================================
+// UDP
+// ============================================================================
+
+bool WifiUdpSocket::sendTo(const char* host, uint16_t port, const uint8_t* data, size_t len) {
+  if (!udp.beginPacket(host, port)) {
+    return false;
+  }
+  udp.write(data, len);
+  return udp.endPacket() == 1;
+}
+
+size_t WifiUdpSocket::receive(uint8_t* data, size_t max, char* fromHost, uint16_t* fromPort) {
+  if (udp.parsePacket() <= 0) {
+    return 0;
+  }
+  IPAddress ip = udp.remoteIP();
+  snprintf(fromHost, 16, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  if (fromPort) *fromPort = udp.remotePort();
+  int len = udp.read(data, max);
+  udp.flush();  // drop whatever did not fit
+  return len > 0 ? (size_t)len : 0;
+}
+
+// ============================================================================
+// LittleFS
+// ============================================================================
+
+int LittleFsStore::read(const char* path, uint8_t* data, size_t max) {
+  if (!LittleFS.exists(path)) {
+    return -1;
+  }
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return -1;
+  }
+  int len = file.read(data, max);
+  file.close();
+  return len;
+}
+
+bool LittleFsStore::write(const char* path, const uint8_t* data, size_t len) {
+  char tmpPath[64];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+  File file = LittleFS.open(tmpPath, "w");
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write(data, len) == len;
+  file.close();
+
+  // LittleFS renames atomically, replacing any existing file
+  if (!ok || !LittleFS.rename(tmpPath, path)) {
+    LittleFS.remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+bool LittleFsStore::append(const char* path, const uint8_t* data, size_t len) {
+  File file = LittleFS.open(path, "a");
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write(data, len) == len;
+  file.close();
+  return ok;
+}
+
+int LittleFsStore::readAt(const char* path, uint32_t offset, uint8_t* data, size_t max) {
+  if (!LittleFS.exists(path)) {
+    return -1;
+  }
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return -1;
+  }
+  int len = 0;
+  if (offset < file.size() && file.seek(offset)) {
+    len = file.read(data, max);
+  }
+  file.close();
+  return len < 0 ? 0 : len;
+}
+
+int32_t LittleFsStore::size(const char* path) {
+  if (!LittleFS.exists(path)) {
+    return -1;
+  }
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return -1;
+  }
+  int32_t len = (int32_t)file.size();
+  file.close();
+  return len;
+}
+
+bool LittleFsStore::remove(const char* path) {
+  return !LittleFS.exists(path) || LittleFS.remove(path);
+}
+
+// ============================================================================
+// WiFi
+// ============================================================================
+
+#define WIFI_SCAN_CHANNEL_MS 100  // active scan dwell per channel
+
+void Esp32WifiDriver::begin() {
+  WiFi.persistent(false);        // credentials live in the config store, not NVS
+  WiFi.setAutoReconnect(false);  // WifiManager decides when and where to reconnect
+  WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+      case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        events |= POI_WIFI_CONNECTED;
+        break;
+      case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        // Leaving on purpose, through disconnect() or a new begin(), is
+        // reported as ASSOC_LEAVE and is not news to WifiManager
+        if (info.wifi_sta_disconnected.reason != WIFI_REASON_ASSOC_LEAVE) {
+          events |= POI_WIFI_DISCONNECTED;
+        }
+        break;
+      case ARDUINO_EVENT_WIFI_SCAN_DONE:
+        events |= POI_WIFI_SCAN_DONE;
+        break;
+      default:
+        break;
+    }
+  });
+}
+
+void Esp32WifiDriver::connect(const char* ssid, const char* password, const uint8_t* bssid, uint8_t channel,
+                              const WiFiLastConnection* lease) {
+  WiFi.enableSTA(true);  // keeps the captive portal AP up if it is running
+  if (lease) {
+    WiFi.config(IPAddress(lease->ip), IPAddress(lease->gateway), IPAddress(lease->subnet), IPAddress(lease->dns));
+  } else {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);  // back to DHCP
+  }
+  WiFi.begin(ssid, password, channel, bssid);
+  #if defined(C_THREE)
+    WiFi.setTxPower(WIFI_POWER_8_5dBm);  // Adjust for ESP32 C3
+  #endif
+}
+
+void Esp32WifiDriver::disconnect() {
+  WiFi.disconnect();
+}
+
+bool Esp32WifiDriver::startScan() {
+  WiFi.scanDelete();
+  return WiFi.scanNetworks(true, false, false, WIFI_SCAN_CHANNEL_MS) == WIFI_SCAN_RUNNING;
+}
+
+int Esp32WifiDriver::scanResults(WifiScanResult* results, int max) {
+  int found = WiFi.scanComplete();
+  int n = 0;
+  for (int i = 0; i < found && n < max; i++, n++) {
+    strlcpy(results[n].ssid, WiFi.SSID(i).c_str(), sizeof(results[n].ssid));
+    memcpy(results[n].bssid, WiFi.BSSID(i), sizeof(results[n].bssid));
+    results[n].channel = WiFi.channel(i);
+    results[n].rssi = WiFi.RSSI(i);
+  }
+  WiFi.scanDelete();
+  return n;
+}
+
+void Esp32WifiDriver::connection(WiFiLastConnection& last) {
+  memcpy(last.bssid, WiFi.BSSID(), sizeof(last.bssid));
+  last.channel = WiFi.channel();
+  last.ip = WiFi.localIP();
+  last.gateway = WiFi.gatewayIP();
+  last.subnet = WiFi.subnetMask();
+  last.dns = WiFi.dnsIP();
+}
+
+// ============================================================================
+// Power
+// ============================================================================
+
+void Esp32PowerControl::attachWakePin(int pin, TaskHandle_t task) {
+  pinMode(pin, INPUT);
+  attachInterruptArg(pin, wakeInterrupt, task, RISING);
+  gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_HIGH_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+}
+
+void IRAM_ATTR Esp32PowerControl::wakeInterrupt(void* task) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR((TaskHandle_t)task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void Esp32PowerControl::setRadioAwake(bool awake) {
+  radioAwake = awake;
+  applyRadio();
+}
+
+// Through the WiFi library, so it sticks across reconnects. In modem
+// sleep the access point holds frames for us until the next beacon,
+// which a pattern change waiting on the poi's answer cannot afford.
+void Esp32PowerControl::applyRadio() {
+  WiFi.setSleep(radioAwake ? WIFI_PS_NONE : level == POWER_SLEEP ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+}
+
+void Esp32PowerControl::setLevel(PowerLevel level) {
+  this->level = level;
+  applyRadio();
+#if CONFIG_PM_ENABLE
+  esp_pm_config_t pm = {};
+  pm.max_freq_mhz = level == POWER_ACTIVE ? 160 : 80;
+  pm.min_freq_mhz = level == POWER_ACTIVE ? 160 : 40;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  pm.light_sleep_enable = level == POWER_SLEEP;
+#endif
+  esp_pm_configure(&pm);
+#else
+  setCpuFrequencyMhz(level == POWER_ACTIVE ? 160 : 80);
+#endif
+}
+
+// ============================================================================
+// WebSocket telemetry
+// ============================================================================
+
+bool WebSocketSink::trySend(const uint8_t* data, size_t len) {
+  // Queueing behind a client whose queue is full would eventually get it
+  // disconnected; skip the frame for everyone instead
+  if (!socket.availableForWriteAll()) {
+    return false;
+  }
+  socket.binaryAll(data, len);
+  return true;
+}
@@ -1,14 +1,22 @@
 #include <Arduino.h>
-#include <Adafruit_MPU6050.h>
-#include <Adafruit_Sensor.h>
 #include <Wire.h>
 #include "secrets.h"
 #include "tasks.h"
+#include "hal_esp32.h"
+#include "controller.h"
+#include "mpu6050.h"
+#include "sample_pipe.h"
+#include "poi_discovery.h"
+#include "multicast_switcher.h"
+#include "clock_sync.h"
+#include "session_log.h"
+#include "wifi_manager.h"
+#include "boot_scheduler.h"
+#include "power_manager.h"
 #include <ArduinoJson.h>
 
 // ESP32-specific includes
 #include <WiFi.h>
-#include <HTTPClient.h>
 #include <esp_system.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -28,33 +36,104 @@ Ticker watchdogTicker;
   #define LED_BUILTIN 8  // Common built-in LED pin for many ESP32 boards
 #endif
 
-// MPU-6050 sensor object
-Adafruit_MPU6050 mpu;
+// HAL instances (see include/hal_esp32.h)
+ArduinoClock systemClock;
+WireI2cBus i2cBus(Wire);
+#ifdef MPU_FIFO_SAMPLE_RATE
+// Hardware FIFO burst reads at MPU_FIFO_SAMPLE_RATE Hz over 400 kHz I2C
+Mpu6050Fifo imu(i2cBus, systemClock, MPU_FIFO_SAMPLE_RATE);
+#define IMU_SAMPLE_RATE MPU_FIFO_SAMPLE_RATE
+#else
+// One 6 byte gyro register read per sensor task tick
+Mpu6050Polled imu(i2cBus, systemClock);
+#define IMU_SAMPLE_RATE 200
+#endif
+GpioLed statusLed(LED_BUILTIN, true);  // active low
+Esp32HttpTransport httpTransport;
 
-// HTTP and pattern management
-const char* serverIPs[2] = {"192.168.1.1", "192.168.1.78"};
-int patternNumbers[62]; // Max 62 patterns (0-61)
-int patternCount = 0;
-int currentPatternIndex = 0;
-bool patternsLoaded = false;
-bool patternSentForCurrentPause = false; // Track if pattern already sent for current pause
+// Samples flow from the sensor task to loop() through a lock-free ring
+SamplePipe samplePipe(imu);
 
+// Sample rate, CPU clock and radio power come down while the poi lie
+// still; define MPU_INT_PIN if the sensor's INT pin is wired
+Esp32PowerControl powerControl;
+PowerManager powerManager(imu, powerControl, systemClock);
 
+LittleFsStore flashStore;
+// WiFi settings and detector parameters, see loadConfig()
+ConfigStore configStore(flashStore);
 
-// Rotation detection
-bool is_rotating = false;
-float gyro_threshold = 200.0;  // Increased threshold to ignore tiny jiggles
-unsigned long last_movement_time = 0;  // Track last movement detection
+// Poi to drive: the configured ones plus any that answer discovery
+const char* serverIPs[2] = {"192.168.1.1", "192.168.1.78"};
+PoiRegistry poiRegistry;
+WifiUdpSocket discoverySocket;
+PoiDiscovery poiDiscovery(discoverySocket, systemClock, poiRegistry);
+
+// HTTP and pattern management; the pattern table is cached in LittleFS
+PatternClient patternClient(httpTransport, poiRegistry, &flashStore);
+PatternRefresher patternRefresher(patternClient, systemClock);
+
+// Pattern changes go to all online poi concurrently over AsyncTCP, one
+// connection per registry slot
+AsyncTcpConnection serverConnections[MAX_POI_SERVERS];
+TcpConnection* serverConnectionPtrs[MAX_POI_SERVERS];
+PatternDispatcher patternDispatcher(systemClock, serverConnectionPtrs, poiRegistry);
+
+// Poi that advertise it get pattern changes as one multicast datagram instead,
+// scheduled SWITCH_LEAD_MS ahead against each poi's measured clock offset
+// so they all switch on the same frame
+WifiUdpSocket switchSocket;
+MulticastSwitcher multicastSwitcher(switchSocket, systemClock);
+WifiUdpSocket clockSyncSocket;
+ClockSync clockSync(clockSyncSocket, systemClock, poiRegistry);
+
+// Live gyro and detector state for the status page, on ws://<ip>/telemetry
+AsyncWebSocket telemetrySocket("/telemetry");
+WebSocketSink telemetrySink(telemetrySocket);
+TelemetryStream telemetry(telemetrySink, IMU_SAMPLE_RATE / TELEMETRY_RATE_HZ);
+
+// What happened during a performance, in a ring of files on LittleFS;
+// download it from /log
+SessionLog sessionLog(flashStore, systemClock);
+
+// Pattern requested through the web server, handed over to loop()
+volatile int requestedPattern = 0;
+// ... and a calibration reset, as the calibrator belongs to the loop task
+volatile bool calibrationResetRequested = false;
+// ... and a latency reset, as the histograms are recorded there
+volatile bool latencyResetRequested = false;
+// ... and saving the config: the loop task is the only one that writes it
+volatile bool configSaveRequested = false;
+// ... and gesture settings, which the controller reads on every sample.
+// Requests merge into requestedGestures until loop() takes it; both sides
+// hold gestureMux, so two quick changes are never lost or half copied.
+GestureConfig requestedGestures;
+bool gesturesRequested = false;
+portMUX_TYPE gestureMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Rotation detection, LED and pattern dispatch
+Controller controller(samplePipe, systemClock, statusLed, patternClient, patternDispatcher,
+                      ControllerConfig{rotation_axis, debug_mode, StallDetectorConfig()});
 
 // Stability tracking
 unsigned long last_watchdog_feed = 0;
 bool mpu_initialized = false;
 
+// Start-up stages, stepped from loop() until all have finished; see setup()
+BootScheduler bootScheduler(systemClock);
+int sensorStage = -1;
+
 // FreeRTOS task handles
 TaskHandle_t elegantOTATaskHandle = NULL;
+TaskHandle_t sensorTaskHandle = NULL;
+TaskHandle_t patternRefreshTaskHandle = NULL;
+TaskHandle_t sessionLogTaskHandle = NULL;
 
 // WiFi settings
 WiFiSettings wifiSettings;
+Esp32WifiDriver wifiDriver;
+WifiManager wifiManager(wifiDriver, systemClock, wifiSettings, ssid, password);
+bool networkStarted = false;  // discovery, multicast and clock sync sockets open
 bool otaInProgress = false;
 bool captivePortalActive = false;
 
@@ -76,159 +155,159 @@ void feedWatchdog() {
 
 // Get list of .bin files from servers and map to pattern numbers
 bool loadPatterns() {
-  if (patternsLoaded) return true;
-
-  Serial.println("Loading patterns from servers...");
-
-  HTTPClient http;
-  WiFiClient client;
-  bool success = false;
-
-  // Try both servers
-  for (int i = 0; i < 2; i++) {
-    String url = "http://" + String(serverIPs[i]) + "/list?dir=/";
-
-    if (http.begin(client, url)) {
-      int httpCode = http.GET();
-
-      if (httpCode == HTTP_CODE_OK) {
-        String payload = http.getString();
-        Serial.print("Got file list from ");
-        Serial.print(serverIPs[i]);
-        Serial.print(": ");
-        Serial.println(payload);
-
-        // Parse JSON array - use DynamicJsonDocument for large response
-        DynamicJsonDocument doc(8192);  // Increased for large file list
-        DeserializationError error = deserializeJson(doc, payload);
-        
-        Serial.printf("JSON parse result: %s\n", error.c_str());
-
-        if (!error) {
-          // Clear existing patterns
-          patternCount = 0;
-
-          // Iterate through array and find .bin files
-          for (JsonObject obj : doc.as<JsonArray>()) {
-            const char* name = obj["name"];
-            if (name && strstr(name, ".bin")) {
-              // Check if it's a single character file (a.bin, b.bin, etc.)
-              if (strlen(name) == 5 && name[1] == '.') { // "a.bin" format
-                char firstChar = name[0];
-                int patternNumber = -1;
-
-                // Map character to pattern number starting at 8
-                if (firstChar >= 'a' && firstChar <= 'z') {
-                  patternNumber = 8 + (firstChar - 'a');
-                } else if (firstChar >= 'A' && firstChar <= 'Z') {
-                  patternNumber = 8 + 26 + (firstChar - 'A');
-                } else if (firstChar >= '0' && firstChar <= '9') {
-                  patternNumber = 8 + 52 + (firstChar - '0');
-                }
-
-                if (patternNumber >= 8 && patternNumber <= 69) { // 8-69 range
-                  patternNumbers[patternCount++] = patternNumber;
-                  Serial.printf("Mapped %s -> pattern %d\n", name, patternNumber);
-                }
-              }
-            }
-          }
-
-          if (patternCount > 0) {
-            success = true;
-            patternsLoaded = true;
-            Serial.printf("Loaded %d patterns\n", patternCount);
-            break;
-          }
-        } else {
-          Serial.print("JSON parse error: ");
-          Serial.println(error.c_str());
-        }
-      } else {
-        Serial.printf("HTTP error %d from %s\n", httpCode, serverIPs[i]);
-      }
-
-      http.end();
-    } else {
-      Serial.printf("Failed to connect to %s\n", serverIPs[i]);
-    }
-  }
+  return patternClient.loadPatterns();
+}
 
-  if (!success) {
-    Serial.println("Failed to load patterns from any server");
+// WiFi came up or went down (called from loop() by wifiManager)
+void wifiChanged(void* context, bool connected) {
+  if (!connected) {
+    Serial.println("WiFi lost, pattern changes paused");
+    patternDispatcher.pause();
+    return;
   }
 
-  return success;
+  Serial.print("WiFi connected! IP address: ");
+  Serial.println(WiFi.localIP());
+  if (!networkStarted) {
+    // Look for more poi on the network; replies are handled in loop()
+    poiDiscovery.begin();
+    multicastSwitcher.begin();
+    clockSync.begin();
+    networkStarted = true;
+  }
+  if (captivePortalActive) {
+    stopCaptivePortal();
+  }
+  patternDispatcher.resume();
+  if (wifiManager.takeLastChanged()) {
+    saveConfig();  // where to reconnect straight away after a reboot
+  }
 }
 
-// Send pattern request to both servers
+// Queue a pattern change for every online poi; loop() dispatches it
 void sendPatternRequest(int patternNumber) {
-  if (patternNumber < 8 || patternNumber > 69) return;
-
-  HTTPClient http;
-  WiFiClient client;
+  requestedPattern = patternNumber;
+}
 
-  for (int i = 0; i < 2; i++) {
-    String url = "http://" + String(serverIPs[i]) + "/pattern?patternChooserChange=" + String(patternNumber);
+void requestCalibrationReset() {
+  calibrationResetRequested = true;
+}
 
-    if (http.begin(client, url)) {
-      http.setTimeout(1000); // 1 second timeout
-      int httpCode = http.GET();
+void requestLatencyReset() {
+  latencyResetRequested = true;
+}
 
-      if (httpCode == HTTP_CODE_OK) {
-        String response = http.getString();
-        Serial.printf("Server %s: Pattern %d set successfully\n", serverIPs[i], patternNumber);
-      } else if (httpCode == HTTP_CODE_BAD_REQUEST) {
-        String response = http.getString();
-        Serial.printf("Server %s: Invalid pattern %d\n", serverIPs[i], patternNumber);
-      } else {
-        Serial.printf("Server %s: HTTP error %d\n", serverIPs[i], httpCode);
-      }
+void requestConfigSave() {
+  configSaveRequested = true;
+}
 
-      http.end();
+// enabled: 0, 1 or -1 to leave it; actions[g]: GESTURE_ACTIONS to leave it
+void requestGestureChange(int enabled, const uint8_t* actions) {
+  taskENTER_CRITICAL(&gestureMux);
+  if (!gesturesRequested) {
+    requestedGestures = controller.gestureSettings();
+  }
+  if (enabled >= 0) {
+    requestedGestures.enabled = enabled;
+  }
+  for (int i = GESTURE_NONE + 1; i < GESTURES; i++) {
+    if (actions[i] < GESTURE_ACTIONS) {
+      requestedGestures.actions[i] = actions[i];
     }
   }
+  gesturesRequested = true;
+  taskEXIT_CRITICAL(&gestureMux);
 }
-void setup() {
-  Serial.begin(115200);
-  Serial.println("\n\nSerial monitor started.");
 
-  // Initialize watchdog timer
-  watchdogTicker.attach(1, watchdogCallback); // Check every second
-  feedWatchdog();
+// ============================================================================
+// Boot stages
+// ============================================================================
 
-  // Initialize LittleFS
-  if (!initLittleFS()) {
-    Serial.println("Failed to initialize LittleFS");
+#define MPU_POWER_UP_MS 100     // after power on before the sensor answers
+#define MPU_BEGIN_RETRIES 4     // five attempts in all
+#define MPU_RETRY_MS 500
+
+// The sensor comes first and depends on nothing, so spins are detected
+// while flash, config and WiFi are still coming up
+BootStep bootSensor(void* context) {
+  if (!imu.begin()) {
+    return BOOT_STEP_FAILED;
   }
+  mpu_initialized = true;
+  controller.setSensorReady(true);
+  // Sample at high priority so network waits in loop() never stall it
+  xTaskCreate(
+    sensorTask,          // Task function
+    "Sensor Task",       // Name
+    4096,                // Stack size
+    NULL,                // Parameters
+    5,                   // Priority (above loop() and the web server)
+    &sensorTaskHandle    // Task handle
+  );
+  return BOOT_STEP_DONE;
+}
 
-  // Load WiFi settings from LittleFS
-  loadWiFiSettings();
+// First gyro samples through the controller: spins are being detected
+BootStep bootMotion(void* context) {
+  if (!bootScheduler.done(sensorStage)) {
+    return BOOT_STEP_FAILED;
+  }
+  return controller.samplesProcessed > 0 ? BOOT_STEP_DONE : BOOT_STEP_PENDING;
+}
 
-  // Initialize LED for status indication
-  pinMode(LED_BUILTIN, OUTPUT);
-  digitalWrite(LED_BUILTIN, HIGH); // Turn LED OFF initially (active low)
-
-  // Try to connect to WiFi using saved settings or fallback
-  if (initWiFi()) {
-    Serial.println("WiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    
-    // Load patterns from servers if WiFi is connected
-    loadPatterns();
-  } else {
-    Serial.println("WiFi connection failed, starting captive portal...");
-    // Start Access Point for configuration
-    WiFi.mode(WIFI_AP);
-    WiFi.softAPConfig(apIP, apIP, netMask);
-    WiFi.softAP("SmartPoi-Accelerometer-Config");
-    // Start DNS server for captive portal
-    dnsServer.start(DNS_PORT, "*", apIP);
-    captivePortalActive = true;
-    Serial.println("Captive portal started. Connect to SmartPoi-Accelerometer-Config AP");
+BootStep bootFlash(void* context) {
+  return initLittleFS() ? BOOT_STEP_DONE : BOOT_STEP_FAILED;
+}
+
+// WiFi settings and detector parameters; defaults if there are none
+BootStep bootConfig(void* context) {
+  loadConfig();
+  return BOOT_STEP_DONE;
+}
+
+// Start this boot's session; records are written by sessionLogTask
+BootStep bootSessionLog(void* context) {
+  if (!sessionLog.begin()) {
+    return BOOT_STEP_FAILED;
+  }
+  controller.setSessionLog(&sessionLog);
+  // Flash writes for the session log, below everything else
+  xTaskCreate(
+    sessionLogTask,      // Task function
+    "Session Log",       // Name
+    4096,                // Stack size
+    NULL,                // Parameters
+    1,                   // Priority
+    &sessionLogTaskHandle // Task handle
+  );
+  return BOOT_STEP_DONE;
+}
+
+// Patterns from the last session are usable before WiFi is up; on a
+// first boot there are none until the listing is fetched
+BootStep bootPatternCache(void* context) {
+  patternClient.loadCached();
+  return BOOT_STEP_DONE;
+}
+
+// Connect in the background; wifiChanged() starts the network side once
+// it is up, and loop() opens the captive portal if no network can be joined
+BootStep bootWifi(void* context) {
+  wifiDriver.begin();
+  wifiManager.onChange(wifiChanged, NULL);
+  wifiManager.begin();
+  return BOOT_STEP_DONE;
+}
+
+// Until the first connection, or the first round that joined nothing
+BootStep bootNetwork(void* context) {
+  if (wifiManager.connected()) {
+    return BOOT_STEP_DONE;
   }
+  return wifiManager.failedRoundCount() > 0 ? BOOT_STEP_FAILED : BOOT_STEP_PENDING;
+}
 
+BootStep bootWebServer(void* context) {
   // Create ElegantOTA task (handles both normal and captive portal modes)
   xTaskCreatePinnedToCore(
     elegantOTATask,      // Task function
@@ -239,24 +318,74 @@ void setup() {
     &elegantOTATaskHandle, // Task handle
     1                    // Core (1 = APP_CPU)
   );
+  return BOOT_STEP_DONE;
+}
+
+// Check the servers for a new pattern list once WiFi is up and every
+// minute after, without holding up boot
+BootStep bootPatternRefresh(void* context) {
+  xTaskCreate(
+    patternRefreshTask,  // Task function
+    "Pattern Refresh",   // Name
+    8192,                // Stack size
+    NULL,                // Parameters
+    1,                   // Priority
+    &patternRefreshTaskHandle // Task handle
+  );
+  return BOOT_STEP_DONE;
+}
 
-  // Initialize MPU6050
-  delay(100); // Wait for the sensor to power up
-  int retries = 5;
-  while (!mpu.begin() && retries > 0) {
-    delay(500);
-    retries--;
-    feedWatchdog();
+void printBootReport() {
+  Serial.printf("Boot finished at %u ms\n", (unsigned)bootScheduler.finishedAt());
+  for (int i = 0; i < bootScheduler.count(); i++) {
+    Serial.printf("  %-16s %-7s %6u .. %6u ms  attempts %u  longest step %u ms\n",
+                  bootScheduler.name(i), BootScheduler::stateName(bootScheduler.state(i)),
+                  (unsigned)bootScheduler.startedAt(i), (unsigned)bootScheduler.endedAt(i),
+                  bootScheduler.attempts(i), (unsigned)bootScheduler.longestStep(i));
   }
+}
 
-  if (retries == 0) {
-    mpu_initialized = false;
-  } else {
-    mpu.setAccelerometerRange(MPU6050_RANGE_8_G);
-    mpu.setGyroRange(MPU6050_RANGE_2000_DEG);
-    mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
-    mpu_initialized = true;
+void setup() {
+  Serial.begin(115200);
+  Serial.println("\n\nSerial monitor started.");
+
+  // Initialize watchdog timer
+  watchdogTicker.attach(1, watchdogCallback); // Check every second
+  feedWatchdog();
+
+  for (int i = 0; i < MAX_POI_SERVERS; i++) {
+    serverConnectionPtrs[i] = &serverConnections[i];
   }
+  for (const char* ip : serverIPs) {
+    poiRegistry.addStatic(ip);
+  }
+
+  // Initialize LED for status indication
+  statusLed.begin(); // Turn LED OFF initially
+
+  // Pattern changes wait for WiFi, see wifiChanged()
+  patternDispatcher.pause();
+  multicastSwitcher.setLeadTime(SWITCH_LEAD_MS);
+  controller.setRefresher(&patternRefresher);
+  controller.setTelemetry(&telemetry);
+  // Falls back to HTTP for everyone until multicastSwitcher.begin() succeeds
+  patternDispatcher.setMulticast(&multicastSwitcher);
+  i2cBus.begin(400000);
+
+  // Everything else starts in loop(), each stage once the ones it needs
+  // have finished; nothing here waits on the sensor, flash or WiFi
+  sensorStage = bootScheduler.add("sensor", bootSensor, NULL, 0,
+                                  MPU_POWER_UP_MS, MPU_BEGIN_RETRIES, MPU_RETRY_MS);
+  bootScheduler.add("motion", bootMotion, NULL, BOOT_AFTER(sensorStage));
+  int flash = bootScheduler.add("flash", bootFlash, NULL);
+  int config = bootScheduler.add("config", bootConfig, NULL, BOOT_AFTER(flash));
+  bootScheduler.add("session log", bootSessionLog, NULL, BOOT_AFTER(flash));
+  int cache = bootScheduler.add("pattern cache", bootPatternCache, NULL, BOOT_AFTER(flash));
+  int wifi = bootScheduler.add("wifi", bootWifi, NULL, BOOT_AFTER(config));
+  bootScheduler.add("network", bootNetwork, NULL, BOOT_AFTER(wifi));
+  bootScheduler.add("web server", bootWebServer, NULL, BOOT_AFTER(config));
+  bootScheduler.add("pattern refresh", bootPatternRefresh, NULL, BOOT_AFTER(wifi) | BOOT_AFTER(cache));
+  bootScheduler.poll();
 
   Serial.println("System initialized. LED indicates STOPPED status.");
 }
@@ -264,79 +393,61 @@ void setup() {
 void loop() {
   yield(); // Allow WiFi stack to process
   feedWatchdog();
-  
-  if (mpu_initialized) {
-    sensors_event_t a, g, temp;
-    if (mpu.getEvent(&a, &g, &temp)) {
-      yield(); // Yield after sensor read
-
-      // Direct rotation speed detection using gyro angular velocity
-      float gyroValue;
-      switch(rotation_axis) {
-        case 0: gyroValue = -g.gyro.x; break;  // Invert sign for X-axis
-        case 1: gyroValue = g.gyro.y; break;
-        case 2: gyroValue = g.gyro.z; break;
-        default: gyroValue = g.gyro.y;
-      }
-      
-      // Convert from radians to degrees per second
-      float rotation_speed = gyroValue * 57.2958;  // rad/s to deg/s
-      
-      // Movement detection with debounce
-      if (fabs(rotation_speed) > gyro_threshold) {
-        last_movement_time = millis();  // Update last movement time
-        if (!is_rotating) {
-          is_rotating = true;
-          // Reset sent flag for new pause cycle
-          patternSentForCurrentPause = false;
-          
-          // Increment pattern index when movement resumes (next pause)
-          if (patternCount > 0) {
-            currentPatternIndex++;
-            if (currentPatternIndex >= patternCount) {
-              currentPatternIndex = 0; // Loop back to first pattern
-            }
-            Serial.printf("Movement resumed - next pattern index: %d (pattern %d)\n", 
-                          currentPatternIndex, patternNumbers[currentPatternIndex]);
-          }
-        }
-      } else if (fabs(rotation_speed) < gyro_threshold / 2 && is_rotating) {
-        is_rotating = false;
-      }
-
-      if (debug_mode) {
-        char debug_data[256];
-        snprintf(debug_data, sizeof(debug_data), 
-                 "Gyro: X:%.2f Y:%.2f Z:%.2f | Rot: %d | Still: %lums", 
-                 g.gyro.x, g.gyro.y, g.gyro.z,
-                 is_rotating, millis() - last_movement_time);
-        Serial.println(debug_data);
-      }
-    }
+
+  int pattern = requestedPattern;
+  if (pattern != 0) {
+    requestedPattern = 0;
+    patternDispatcher.dispatch(pattern);
   }
 
-  // Control LED: Only turn ON after 2 seconds of stillness
-  bool is_still = false;
-  if (is_rotating) {
-    digitalWrite(LED_BUILTIN, HIGH); // LED OFF when rotating
-  } else {
-    // Check if device has been still for more than 2 seconds
-    if (millis() - last_movement_time > 2000) {
-      digitalWrite(LED_BUILTIN, LOW); // LED ON when stopped for >2s
-      is_still = true;
-    } else {
-      digitalWrite(LED_BUILTIN, HIGH); // LED OFF while waiting for stillness period
-    }
+  if (!bootScheduler.finished() && bootScheduler.poll()) {
+    printBootReport();
   }
 
-  // Send ONE pattern request per pause (when still for >2 seconds)
-  if (is_still && patternsLoaded && patternCount > 0 && !patternSentForCurrentPause) {
-    // Send current pattern to both servers
-    Serial.printf("Pause detected - sending pattern %d\n", patternNumbers[currentPatternIndex]);
-    sendPatternRequest(patternNumbers[currentPatternIndex]);
-    patternSentForCurrentPause = true;
+  wifiManager.poll();
+  if (!captivePortalActive && !wifiManager.everConnected() && wifiManager.failedRoundCount() > 0) {
+    Serial.println("WiFi connection failed, starting captive portal...");
+    startCaptivePortal();
   }
 
-  delay(50); // Significantly increased delay to reduce CPU load
+  poiDiscovery.poll();
+  clockSync.poll();
+  controller.update();
+  powerManager.update(controller.detector.lastMovementTime(), patternDispatcher.busy());
+
+  if (calibrationResetRequested) {
+    calibrationResetRequested = false;
+    controller.calibration.reset();
+    controller.configureDetector(controller.detectorSettings());
+  }
+  if (latencyResetRequested) {
+    latencyResetRequested = false;
+    controller.latency.reset();
+  }
+  taskENTER_CRITICAL(&gestureMux);
+  if (gesturesRequested) {
+    controller.configureGestures(requestedGestures);
+    gesturesRequested = false;
+    configSaveRequested = true;
+  }
+  taskEXIT_CRITICAL(&gestureMux);
+  // Settings changed from the web pages are saved straight away; learned
+  // calibration and rotation totals go to flash while the poi rest, not
+  // mid-set
+  bool save = false;
+  if (configSaveRequested) {
+    configSaveRequested = false;
+    save = true;
+  }
+  if (powerManager.level() != POWER_ACTIVE) {
+    bool learned = controller.calibration.takeUnsaved();
+    bool counted = controller.revolutions.takeUnsaved();
+    save |= learned || counted;
+  }
+  if (save) {
+    saveConfig();
+  }
+
+  delay(powerManager.loopDelayMs()); // Sampling runs in its own task and nothing here blocks
   yield(); // Final yield for good measure
-}
\ No newline at end of file
+}
@@ -0,0 +1,254 @@
+// Start-up timing: the stages main.cpp runs at boot, on fakes with the
+// time each one takes on the ESP32, once one after the other the way
+// setup() used to (blocking WiFi, listing fetch, then the sensor with
+// delay() retries) and once through BootScheduler. The poi is spinning
+// from power on; what matters is how soon the controller sees it.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "boot_scheduler.h"
+#include "commands.h"
+#include "config_store.h"
+#include "controller.h"
+#include "fakes.h"
+#include "sample_pipe.h"
+#include "session_log.h"
+#include "wifi_manager.h"
+
+#define BOOT_TICK_MS 10        // loop() period
+#define SIM_MOUNT_MS 40        // LittleFS mount
+#define SIM_CONFIG_MS 4
+#define SIM_LOG_BEGIN_MS 15    // scanning the session log segments
+#define SIM_CACHE_MS 8
+#define SIM_LISTING_MS 350     // blocking listing fetch from both poi
+#define SIM_IMU_BEGIN_MS 2     // configuring the MPU-6050 over I2C
+#define MPU_POWER_UP_MS 100    // as in main.cpp
+#define MPU_BEGIN_RETRIES 4
+#define MPU_RETRY_MS 500
+
+// Answers on the I2C bus answerMs after power on, then plays the trace
+class SlowStartImu : public ImuSource {
+public:
+  SlowStartImu(FakeClock& clock, TraceImu& trace, uint32_t answerMs)
+    : clock(clock), trace(trace), answerMs(answerMs) {}
+
+  bool begin() override {
+    clock.advance(SIM_IMU_BEGIN_MS);
+    return clock.now >= answerMs && trace.begin();
+  }
+  bool read(ImuSample& sample) override { return trace.read(sample); }
+
+private:
+  FakeClock& clock;
+  TraceImu& trace;
+  uint32_t answerMs;
+};
+
+struct BootRig {
+  explicit BootRig(uint32_t imuAnswerMs)
+    : trace(clock),
+      imu(clock, trace, imuAnswerMs),
+      pipe(imu),
+      configStore(flash),
+      sessionLog(flash, clock),
+      http(clock),
+      patterns(http, registry, &flash),
+      connections(MAX_POI_SERVERS, SimTcpConnection(clock, pois)),
+      dispatcher(clock, connectionPtrs, registry),
+      controller(pipe, clock, led, patterns, dispatcher, ControllerConfig{0, false, StallDetectorConfig()}),
+      wifi(clock),
+      manager(wifi, clock, settings, "PoiHotspot", "spinspin"),
+      scheduler(clock) {
+    for (int i = 0; i < MAX_POI_SERVERS; i++) {
+      connectionPtrs[i] = &connections[i];
+    }
+    registry.addStatic("192.168.1.1");
+    trace.addSegment(15000, 720);
+    wifi.aps = {{"Stage", "fire2024", {0x24, 0x0a, 0xc4, 0, 0, 1}, 6, -55, true}};
+
+    // What an earlier boot left in flash
+    PoiConfig config;
+    resetConfig(config);
+    strcpy(config.wifi.networks[0].ssid, "Stage");
+    strcpy(config.wifi.networks[0].password, "fire2024");
+    config.wifi.networks[0].enabled = true;
+    configStore.save(config);
+    patterns.loadPatterns();
+    clock.now = 0;
+    dispatcher.pause();
+  }
+
+  // One loop() iteration's worth of everything that runs in the background
+  void tick() {
+    clock.advance(BOOT_TICK_MS);
+    wifi.step();
+    manager.poll();
+    if (sensorReady) {
+      pipe.pump();  // the sensor task
+    }
+    controller.update();
+    if (!motionAt && controller.samplesProcessed > 0) {
+      motionAt = clock.now;
+    }
+    if (!networkAt && manager.connected()) {
+      networkAt = clock.now;
+    }
+  }
+
+  static BootStep sensor(void* context) {
+    BootRig* rig = (BootRig*)context;
+    if (!rig->imu.begin()) {
+      return BOOT_STEP_FAILED;
+    }
+    rig->sensorReady = true;
+    rig->controller.setSensorReady(true);
+    return BOOT_STEP_DONE;
+  }
+  static BootStep motion(void* context) {
+    BootRig* rig = (BootRig*)context;
+    return rig->controller.samplesProcessed > 0 ? BOOT_STEP_DONE : BOOT_STEP_PENDING;
+  }
+  static BootStep mount(void* context) {
+    ((BootRig*)context)->clock.advance(SIM_MOUNT_MS);
+    return BOOT_STEP_DONE;
+  }
+  static BootStep config(void* context) {
+    BootRig* rig = (BootRig*)context;
+    rig->clock.advance(SIM_CONFIG_MS);
+    PoiConfig config;
+    resetConfig(config);
+    rig->configStore.load(config);
+    rig->settings = config.wifi;
+    rig->controller.configureDetector(config.detector);
+    return BOOT_STEP_DONE;
+  }
+  static BootStep log(void* context) {
+    BootRig* rig = (BootRig*)context;
+    rig->clock.advance(SIM_LOG_BEGIN_MS);
+    return rig->sessionLog.begin() ? BOOT_STEP_DONE : BOOT_STEP_FAILED;
+  }
+  static BootStep cache(void* context) {
+    BootRig* rig = (BootRig*)context;
+    rig->clock.advance(SIM_CACHE_MS);
+    rig->patterns.loadCached();
+    return BOOT_STEP_DONE;
+  }
+  static BootStep startWifi(void* context) {
+    ((BootRig*)context)->manager.begin();
+    return BOOT_STEP_DONE;
+  }
+  static BootStep network(void* context) {
+    BootRig* rig = (BootRig*)context;
+    if (rig->manager.connected()) {
+      return BOOT_STEP_DONE;
+    }
+    return rig->manager.failedRoundCount() > 0 ? BOOT_STEP_FAILED : BOOT_STEP_PENDING;
+  }
+  static BootStep listing(void* context) {
+    BootRig* rig = (BootRig*)context;
+    rig->clock.advance(SIM_LISTING_MS);
+    return rig->patterns.loadPatterns() ? BOOT_STEP_DONE : BOOT_STEP_FAILED;
+  }
+
+  // setup() before the scheduler: every step to completion in turn, with
+  // nothing else running while it waits
+  void runSerial() {
+    const BootStepFunction order[] = {mount, config, log, cache, startWifi, network, listing};
+    for (BootStepFunction step : order) {
+      while (step(this) == BOOT_STEP_PENDING) {
+        tick();
+      }
+    }
+    for (int i = 0; i < MPU_POWER_UP_MS / BOOT_TICK_MS; i++) {
+      tick();
+    }
+    for (int attempt = 0; attempt <= MPU_BEGIN_RETRIES && sensor(this) != BOOT_STEP_DONE; attempt++) {
+      for (int i = 0; i < MPU_RETRY_MS / BOOT_TICK_MS; i++) {
+        tick();
+      }
+    }
+    while (!motionAt && clock.now < 10000) {
+      tick();
+    }
+  }
+
+  // The same stages and dependencies as main.cpp's setup()
+  void runScheduled() {
+    int sensorStage = scheduler.add("sensor", sensor, this, 0, MPU_POWER_UP_MS, MPU_BEGIN_RETRIES, MPU_RETRY_MS);
+    scheduler.add("motion", motion, this, BOOT_AFTER(sensorStage));
+    int flashStage = scheduler.add("flash", mount, this);
+    int configStage = scheduler.add("config", config, this, BOOT_AFTER(flashStage));
+    scheduler.add("session log", log, this, BOOT_AFTER(flashStage));
+    scheduler.add("pattern cache", cache, this, BOOT_AFTER(flashStage));
+    int wifiStage = scheduler.add("wifi", startWifi, this, BOOT_AFTER(configStage));
+    scheduler.add("network", network, this, BOOT_AFTER(wifiStage));
+    scheduler.poll();
+    while (!scheduler.finished() && clock.now < 10000) {
+      tick();
+      scheduler.poll();
+    }
+  }
+
+  void printStages() {
+    for (int i = 0; i < scheduler.count(); i++) {
+      printf("    %-14s %-7s %5u .. %5u ms  attempts %u  longest step %u ms\n", scheduler.name(i),
+             BootScheduler::stateName(scheduler.state(i)), (unsigned)scheduler.startedAt(i),
+             (unsigned)scheduler.endedAt(i), scheduler.attempts(i), (unsigned)scheduler.longestStep(i));
+    }
+  }
+
+  FakeClock clock;
+  TraceImu trace;
+  SlowStartImu imu;
+  SamplePipe pipe;
+  FakeLed led;
+  MemoryFileStore flash;
+  ConfigStore configStore;
+  SessionLog sessionLog;
+  FakeHttpTransport http;
+  PoiRegistry registry;
+  PatternClient patterns;
+  std::vector<SimPoi> pois;
+  std::vector<SimTcpConnection> connections;
+  TcpConnection* connectionPtrs[MAX_POI_SERVERS];
+  PatternDispatcher dispatcher;
+  Controller controller;
+  SimWifi wifi;
+  WiFiSettings settings;
+  WifiManager manager;
+  BootScheduler scheduler;
+  bool sensorReady = false;
+  uint32_t motionAt = 0;
+  uint32_t networkAt = 0;
+};
+
+int runBootDemo() {
+  // A sensor that answers straight away, and one that needs two retries
+  const uint32_t answerTimes[] = {20, 450};
+  bool ok = true;
+  for (uint32_t answerMs : answerTimes) {
+    BootRig serial(answerMs);
+    serial.runSerial();
+    BootRig scheduled(answerMs);
+    scheduled.runScheduled();
+
+    printf("Sensor answers %u ms after power on\n", (unsigned)answerMs);
+    printf("  serial:    spins detected at %5u ms, network at %5u ms\n",
+           (unsigned)serial.motionAt, (unsigned)serial.networkAt);
+    printf("  scheduled: spins detected at %5u ms, network at %5u ms, all stages by %u ms\n",
+           (unsigned)scheduled.motionAt, (unsigned)scheduled.networkAt, (unsigned)scheduled.scheduler.finishedAt());
+    scheduled.printStages();
+    printf("\n");
+
+    ok &= scheduled.scheduler.finished() && scheduled.motionAt > 0 && scheduled.networkAt > 0;
+    ok &= scheduled.motionAt < serial.motionAt;
+    // WiFi starts at the same point either way, give or take a tick
+    ok &= scheduled.networkAt <= serial.networkAt + BOOT_TICK_MS;
+  }
+  // A healthy sensor is live within a few hundred ms however long WiFi takes
+  BootRig quick(answerTimes[0]);
+  quick.runScheduled();
+  ok &= quick.motionAt < 300;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Host-only subcommands of the native program, see main.cpp
+
+// program eval [trace.csv ...]: stall detector latency vs. false positives
+int runDetectorEval(int argc, char** argv);
+
+// program listing: peak heap and parse time of the pattern listing
+int runListingBench();
+
+// program discover [N]: poi discovery against N stand-ins on loopback
+int runDiscoveryDemo(int argc, char** argv);
+
+// program multicast [N] [loss%]: multicast switching of N stand-ins on loopback
+int runMulticastDemo(int argc, char** argv);
+
+// program sync [N] [delay ms]: clock offsets and switch alignment of N stand-ins
+int runSyncDemo(int argc, char** argv);
+
+// program log: session log ring rotation, torn writes and range reads
+int runSessionLogDemo();
+
+// program config: config load time, damage detection and older layouts
+int runConfigBench();
+
+// program wifi: connection manager reconnecting, falling back and promoting
+int runWifiDemo();
+
+// program boot: start-up stages one after the other vs. through BootScheduler
+int runBootDemo();
+
+// program power [trace.csv ...]: time at each power level and battery life
+int runPowerModel(int argc, char** argv);
+
+// program revs: revolution count and RPM against a trace of known spins
+int runRevolutionDemo();
+
+// program gestures: gesture recognition on clips, and their actions in a show
+int runGestureDemo();
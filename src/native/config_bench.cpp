@@ -0,0 +1,126 @@
+// Config store check: boot-time load of /config.bin, every single-bit
+// flip and truncation of the file rejected, and a file from an older
+// layout loading with defaults for the fields it lacks.
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "commands.h"
+#include "config_store.h"
+#include "crc.h"
+#include "fakes.h"
+
+#define CONFIG_BENCH_ITERATIONS 20000
+#define CONFIG_V0_PAYLOAD (CONFIG_NETWORKS * 97 + 2)  // WiFi fields only
+
+static void makeConfig(PoiConfig& config) {
+  resetConfig(config);
+  strcpy(config.wifi.networks[0].ssid, "Rehearsal Room");
+  strcpy(config.wifi.networks[0].password, "fire-poi-2024");
+  config.wifi.networks[0].enabled = true;
+  strcpy(config.wifi.networks[1].ssid, "Festival Stage Left");
+  strcpy(config.wifi.networks[1].password, "correct horse battery staple");
+  config.wifi.networks[1].enabled = true;
+  config.wifi.currentNetwork = 1;
+  config.detector.gyroThreshold = 180.0f;
+  config.detector.stillTimeoutMs = 1500;
+  config.wifi.reuseLease = true;
+  config.wifi.last = {1, {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56}, 11, 0x6401a8c0, 0x0101a8c0, 0x00ffffff, 0x0101a8c0};
+  config.calibration.biasQ4 = -1234;
+  config.calibration.noise = 9;
+  config.calibration.spinRate = 9840;
+  config.calibration.spins = 42;
+  config.calibration.rests = 310;
+  config.totals.revolutions = 123456;
+  config.totals.spinMs = 7200000;
+  config.gestures.enabled = true;
+  config.gestures.actions[GESTURE_SHAKE] = GESTURE_ACTION_FIRST;
+}
+
+template <typename F> static double microsecondsPer(F load) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CONFIG_BENCH_ITERATIONS; i++) {
+    load();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  return elapsed / 1000.0 / CONFIG_BENCH_ITERATIONS;
+}
+
+static bool sameConfig(const PoiConfig& a, const PoiConfig& b) {
+  for (int i = 0; i < CONFIG_NETWORKS; i++) {
+    if (strcmp(a.wifi.networks[i].ssid, b.wifi.networks[i].ssid) != 0
+        || strcmp(a.wifi.networks[i].password, b.wifi.networks[i].password) != 0
+        || a.wifi.networks[i].enabled != b.wifi.networks[i].enabled) {
+      return false;
+    }
+  }
+  return a.wifi.fallbackEnabled == b.wifi.fallbackEnabled && a.wifi.currentNetwork == b.wifi.currentNetwork
+      && a.detector.gyroThreshold == b.detector.gyroThreshold && a.detector.stopThreshold == b.detector.stopThreshold
+      && a.detector.startHoldMs == b.detector.startHoldMs && a.detector.stillTimeoutMs == b.detector.stillTimeoutMs
+      && a.detector.predictive == b.detector.predictive && a.detector.confidence == b.detector.confidence
+      && a.detector.settleMs == b.detector.settleMs && a.detector.decelReference == b.detector.decelReference
+      && a.detector.autoCalibrate == b.detector.autoCalibrate
+      && a.wifi.reuseLease == b.wifi.reuseLease && memcmp(&a.wifi.last, &b.wifi.last, sizeof(a.wifi.last)) == 0
+      && memcmp(&a.calibration, &b.calibration, sizeof(a.calibration)) == 0
+      && a.totals.revolutions == b.totals.revolutions && a.totals.spinMs == b.totals.spinMs
+      && a.gestures.enabled == b.gestures.enabled
+      && memcmp(a.gestures.actions, b.gestures.actions, sizeof(a.gestures.actions)) == 0;
+}
+
+int runConfigBench() {
+  MemoryFileStore flash;
+  ConfigStore store(flash);
+  PoiConfig config;
+  makeConfig(config);
+
+  bool ok = store.save(config);
+  const std::vector<uint8_t> file = flash.files[CONFIG_PATH];
+
+  PoiConfig loaded;
+  double us = microsecondsPer([&] { resetConfig(loaded); store.load(loaded); });
+  ok &= sameConfig(loaded, config);
+  printf("Load: %u bytes, one read, %.2f us\n", (unsigned)file.size(), us);
+
+  // Damage anywhere must be caught, and must not touch what was loaded
+  int missed = 0;
+  for (size_t i = 0; i < file.size() * 8; i++) {
+    flash.files[CONFIG_PATH] = file;
+    flash.files[CONFIG_PATH][i / 8] ^= 1 << (i % 8);
+    PoiConfig damaged = config;
+    missed += store.load(damaged) || !sameConfig(damaged, config);
+  }
+  for (size_t len = 0; len < file.size(); len++) {
+    flash.files[CONFIG_PATH].assign(file.begin(), file.begin() + len);
+    PoiConfig damaged = config;
+    missed += store.load(damaged) || !sameConfig(damaged, config);
+  }
+  printf("Damage: %u bit flips and %u truncations, %d not caught\n",
+         (unsigned)file.size() * 8, (unsigned)file.size(), missed);
+  ok &= missed == 0;
+
+  // A file with only the WiFi fields, as an older layout would have written
+  std::vector<uint8_t> older(file.begin(), file.begin() + CONFIG_HEADER_SIZE + CONFIG_V0_PAYLOAD);
+  older[6] = (uint8_t)CONFIG_V0_PAYLOAD;
+  older[7] = (uint8_t)(CONFIG_V0_PAYLOAD >> 8);
+  uint16_t crc = crc16(older.data(), older.size());
+  older.push_back((uint8_t)crc);
+  older.push_back((uint8_t)(crc >> 8));
+  flash.files[CONFIG_PATH] = older;
+  PoiConfig expected = config;
+  expected.detector = StallDetectorConfig();
+  expected.wifi.reuseLease = false;
+  expected.wifi.last = WiFiLastConnection();
+  expected.wifi.last.network = CONFIG_NO_NETWORK;
+  expected.calibration = CalibrationState();
+  expected.totals = SpinTotals();
+  expected.gestures = GestureConfig();
+  resetConfig(loaded);
+  bool olderOk = store.load(loaded) && sameConfig(loaded, expected);
+  printf("Older layout (%u bytes): %s\n", (unsigned)older.size(),
+         olderOk ? "WiFi settings kept, defaults for the rest" : "FAILED");
+  ok &= olderOk;
+  return ok ? 0 : 1;
+}
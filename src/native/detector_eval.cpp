@@ -0,0 +1,310 @@
+// Stall detector evaluation: replays gyro traces through StallDetector with
+// different settings and reports how early stalls are confirmed and how
+// often a pause that turned out shorter than TRUE_STALL_MS was mistaken
+// for a stall. Without trace files a set of synthetic performances is used.
+// A second table compares the fixed thresholds with GyroCalibrator's,
+// learning from scratch and restored from an earlier gig, for performers
+// with different spin rates and sensors with different zero-rate offsets.
+
+#include <stdio.h>
+#include <vector>
+
+#include "commands.h"
+#include "controller.h"
+#include "fakes.h"
+#include "latency_histogram.h"
+
+#define TRUE_STALL_MS 2000  // a pause this long is a stall, whatever the detector says
+#define EVAL_MAX_FALSE_POSITIVES 2  // default settings: brief holds taken for stalls, over all performances
+
+struct EvalResult {
+  int stalls = 0;          // confirmations in pauses >= TRUE_STALL_MS
+  int early = 0;           // of those, confirmed by the predictor
+  int falsePositives = 0;  // confirmations in shorter pauses
+  LatencyHistogram latency;  // stop -> confirmation, true stalls only
+  std::vector<uint32_t> confirmed;  // when each stall was confirmed
+  std::vector<uint32_t> restarted;  // when each rotation started
+};
+
+// A real stall in a synthetic performance, from the start of the
+// slowdown to the end of the speed-up after it
+struct TrueStall {
+  uint32_t from;
+  uint32_t to;
+};
+
+// With calibration, speeds go through it and its thresholds are applied
+// between spins, as Controller does
+static void evaluate(const std::vector<ImuSample>& samples, const StallDetectorConfig& config, EvalResult& result,
+                     GyroCalibrator* calibration = NULL) {
+  StallDetector detector(calibration ? calibration->effective(config) : config);
+  bool wasStill = false;
+  bool inPause = false;
+  uint32_t pauseStop = 0;
+  uint32_t confirmLatency = 0;
+  bool confirmEarly = false;
+
+  auto closePause = [&](uint32_t end) {
+    if (end - pauseStop >= TRUE_STALL_MS) {
+      result.stalls++;
+      result.early += confirmEarly;
+      result.latency.record(confirmLatency);
+    } else {
+      result.falsePositives++;
+    }
+    inPause = false;
+  };
+
+  for (const ImuSample& s : samples) {
+    int32_t speed = axisRotationSpeed(s, 0);
+    if (calibration) {
+      speed = calibration->update(speed, s.timestamp);
+      calibration->apply(detector, config);
+    }
+    if (detector.update(speed, s.timestamp)) {
+      result.restarted.push_back(s.timestamp);
+      if (inPause) {
+        closePause(s.timestamp);
+      }
+    }
+    bool still = detector.isStill(s.timestamp);
+    // Only stalls that follow a spin count, like the controller's first pattern send
+    if (still && !wasStill && detector.stopTime() != 0) {
+      inPause = true;
+      pauseStop = detector.stopTime();
+      confirmLatency = s.timestamp - pauseStop;
+      confirmEarly = detector.confirmedEarly();
+      result.confirmed.push_back(s.timestamp);
+    }
+    wasStill = still;
+  }
+  if (inPause) {
+    closePause(samples.back().timestamp);
+  }
+}
+
+// Pseudo-random performance: spins between minDps and maxDps separated by
+// real stalls, short holds (not stalls) and direction reversals, after
+// restMs on the table. The real stalls go to stalls if given.
+static void synthesizePerformance(TraceImu& trace, uint32_t seed, uint32_t minDps = 400, uint32_t maxDps = 900,
+                                  uint32_t restMs = 1000, std::vector<TrueStall>* stalls = NULL) {
+  uint32_t state = seed;
+  auto rnd = [&](uint32_t lo, uint32_t hi) {
+    state = state * 1664525u + 1013904223u;
+    return lo + (state >> 8) % (hi - lo + 1);
+  };
+
+  trace.addSegment(restMs, 0, 1);
+  float speed = (float)rnd(minDps, maxDps);
+  for (int i = 0; i < 40; i++) {
+    trace.addWobble(rnd(2000, 6000), speed, 0.15f, 2.0f, 1);
+    float next = (float)rnd(minDps, maxDps) * (rnd(0, 1) ? 1 : -1);
+    switch (rnd(0, 2)) {
+      case 0: {  // real stall
+        uint32_t from = trace.duration();
+        trace.addRamp(rnd(150, 400), speed, 0, 1);
+        trace.addSegment(rnd(2500, 4000), (float)rnd(0, 15), 1);
+        trace.addRamp(rnd(150, 300), 0, next, 1);
+        if (stalls) {
+          stalls->push_back(TrueStall{from, trace.duration()});
+        }
+        break;
+      }
+      case 1:  // brief hold, spinning again within 2 s
+        trace.addRamp(rnd(150, 400), speed, 0, 1);
+        trace.addSegment(rnd(300, 1500), (float)rnd(0, 15), 1);
+        trace.addRamp(rnd(150, 300), 0, next, 1);
+        break;
+      default:  // reversal straight through zero
+        next = speed > 0 ? -(float)rnd(minDps, maxDps) : (float)rnd(minDps, maxDps);
+        trace.addRamp(rnd(200, 500), speed, next, 1);
+        break;
+    }
+    speed = next;
+  }
+  trace.addRamp(300, speed, 0, 1);
+  trace.addSegment(3000, 0, 1);
+}
+
+// What the MPU-6050 adds: a zero-rate offset on the rotation axis and
+// white noise of up to +/-noiseDps
+static void addSensorError(TraceImu& trace, float biasDps, float noiseDps, uint32_t seed) {
+  uint32_t state = seed;
+  int32_t noiseRaw = (int32_t)(noiseDps * GYRO_LSB_PER_DPS);
+  for (ImuSample& s : trace.samples) {
+    state = state * 1664525u + 1013904223u;
+    int32_t noise = noiseRaw ? (int32_t)((state >> 8) % (2 * noiseRaw + 1)) - noiseRaw : 0;
+    // Axis 0 is -gyroX
+    int32_t gyroX = s.gyroX - (int32_t)(biasDps * GYRO_LSB_PER_DPS) + noise;
+    s.gyroX = (int16_t)(gyroX < -32768 ? -32768 : gyroX > 32767 ? 32767 : gyroX);
+  }
+}
+
+// Real stalls the controller would act on: confirmed during the stall,
+// and the spin after it seen, so the next pattern is queued
+static int handledStalls(const EvalResult& result, const std::vector<TrueStall>& stalls) {
+  int handled = 0;
+  for (const TrueStall& stall : stalls) {
+    bool confirmed = false;
+    for (uint32_t t : result.confirmed) {
+      confirmed |= t >= stall.from && t <= stall.to;
+    }
+    bool restarted = false;
+    for (uint32_t t : result.restarted) {
+      restarted |= t > stall.from && t <= stall.to + 500;
+    }
+    handled += confirmed && restarted;
+  }
+  return handled;
+}
+
+static void printResult(const char* name, const char* mode, const EvalResult& result, int handled, int expected) {
+  char stalls[16];
+  if (expected >= 0) {
+    snprintf(stalls, sizeof(stalls), "%d/%d", handled, expected);
+  } else {
+    snprintf(stalls, sizeof(stalls), "%d", result.stalls);
+  }
+  printf("%-22s %-10s %7s %7d %9u %9u\n", name, mode, stalls, result.falsePositives,
+         (unsigned)result.latency.mean(), (unsigned)result.latency.percentile(90));
+}
+
+static void printLearned(const GyroCalibrator& calibration, const StallDetectorConfig& config) {
+  StallDetectorConfig learned = calibration.effective(config);
+  printf("%-22s %-10s bias %+.1f deg/s, noise %.1f, spin %.0f deg/s (%u spins): start %.0f, stop %.0f, decel %.0f\n",
+         "", "", calibration.biasDps(), calibration.noiseDps(), calibration.spinRateDps(),
+         (unsigned)calibration.state().spins, learned.gyroThreshold, learned.stopThreshold, learned.decelReference);
+}
+
+// Fixed thresholds against calibration on a performer's first gig
+// (learning as it goes) and on the next (restored from the first), by the
+// real stalls each one handles out of all in the gig
+static bool evaluatePerformers() {
+  struct Performer {
+    const char* name;
+    uint32_t minDps, maxDps;
+    float biasDps, noiseDps;
+  };
+  const Performer performers[] = {
+    {"fast", 700, 900, 0.0f, 0.5f},
+    {"medium", 400, 900, -3.0f, 0.5f},
+    {"slow flow", 150, 300, 0.0f, 0.5f},
+    {"slow flow, bias +12", 150, 300, 12.0f, 1.0f},
+    {"medium, bias -18", 400, 900, -18.0f, 1.0f},
+  };
+
+  printf("\n%-22s %-10s %7s %7s %9s %9s\n", "performer", "detector", "stalls", "false+", "mean ms", "p90 ms");
+  bool ok = true;
+  FakeClock clock;
+  StallDetectorConfig config;
+  for (const Performer& p : performers) {
+    TraceImu first(clock);
+    TraceImu second(clock);
+    std::vector<TrueStall> firstStalls;
+    std::vector<TrueStall> secondStalls;
+    synthesizePerformance(first, 11, p.minDps, p.maxDps, 8000, &firstStalls);
+    synthesizePerformance(second, 12, p.minDps, p.maxDps, 8000, &secondStalls);
+    addSensorError(first, p.biasDps, p.noiseDps, 21);
+    addSensorError(second, p.biasDps, p.noiseDps, 22);
+
+    EvalResult fixed;
+    evaluate(second.samples, config, fixed);
+    int fixedHandled = handledStalls(fixed, secondStalls);
+    printResult(p.name, "fixed", fixed, fixedHandled, secondStalls.size());
+
+    GyroCalibrator calibration;
+    EvalResult learning;
+    evaluate(first.samples, config, learning, &calibration);
+    printResult("", "learning", learning, handledStalls(learning, firstStalls), firstStalls.size());
+    EvalResult restored;
+    evaluate(second.samples, config, restored, &calibration);
+    int restoredHandled = handledStalls(restored, secondStalls);
+    printResult("", "restored", restored, restoredHandled, secondStalls.size());
+    printLearned(calibration, config);
+
+    // Restored calibration handles every stall, and with the default
+    // settings none of them takes brief holds for stalls
+    ok &= restoredHandled == (int)secondStalls.size() && restoredHandled >= fixedHandled;
+    ok &= fixed.falsePositives + learning.falsePositives + restored.falsePositives <= EVAL_MAX_FALSE_POSITIVES;
+  }
+  return ok;
+}
+
+// Recorded traces have no known stall count; show what each detector makes of them
+static void evaluateTraces(const std::vector<TraceImu>& traces, char** names) {
+  printf("\n%-22s %-10s %7s %7s %9s %9s\n", "trace", "detector", "stalls", "false+", "mean ms", "p90 ms");
+  StallDetectorConfig config;
+  for (size_t i = 0; i < traces.size(); i++) {
+    EvalResult fixed;
+    evaluate(traces[i].samples, config, fixed);
+    printResult(names[i], "fixed", fixed, 0, -1);
+    GyroCalibrator calibration;
+    EvalResult calibrated;
+    evaluate(traces[i].samples, config, calibrated, &calibration);
+    printResult("", "calibrated", calibrated, 0, -1);
+    printLearned(calibration, config);
+  }
+}
+
+int runDetectorEval(int argc, char** argv) {
+  bool recorded = argc > 0;
+  FakeClock clock;
+  std::vector<TraceImu> traces;
+  for (int i = 0; i < argc; i++) {
+    traces.emplace_back(clock);
+    if (!traces.back().loadCsv(argv[i])) {
+      fprintf(stderr, "Failed to read trace %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (traces.empty()) {
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+      traces.emplace_back(clock);
+      synthesizePerformance(traces.back(), seed);
+    }
+    printf("%zu synthetic performances\n", traces.size());
+  }
+
+  struct Variant {
+    const char* name;
+    bool predictive;
+    float confidence;
+  };
+  const Variant variants[] = {
+    {"timeout only", false, 0},
+    {"predictive 0.6", true, 0.6f},
+    {"predictive 0.7", true, 0.7f},
+    {"predictive 0.8", true, 0.8f},
+    {"predictive 0.9", true, 0.9f},
+  };
+
+  printf("%-16s %7s %7s %7s %9s %9s %9s\n", "detector", "stalls", "early", "false+", "mean ms", "p90 ms", "max ms");
+  for (const Variant& v : variants) {
+    StallDetectorConfig config;
+    config.predictive = v.predictive;
+    config.confidence = v.confidence;
+    EvalResult result;
+    for (const TraceImu& trace : traces) {
+      evaluate(trace.samples, config, result);
+    }
+    printf("%-16s %7d %7d %7d %9u %9u %9u\n", v.name, result.stalls, result.early, result.falsePositives,
+           (unsigned)result.latency.mean(), (unsigned)result.latency.percentile(90),
+           (unsigned)result.latency.max());
+  }
+
+  if (recorded) {
+    evaluateTraces(traces, argv);
+    return 0;
+  }
+
+  // Early confirmation sends a pattern in most brief holds as well, so it
+  // is off by default; the default settings must keep one change per pause
+  EvalResult defaults;
+  for (const TraceImu& trace : traces) {
+    evaluate(trace.samples, StallDetectorConfig(), defaults);
+  }
+  printf("Default settings: %d false+ (at most %d)\n", defaults.falsePositives, EVAL_MAX_FALSE_POSITIVES);
+  bool ok = defaults.stalls > 0 && defaults.falsePositives <= EVAL_MAX_FALSE_POSITIVES;
+  ok &= evaluatePerformers();
+  return ok ? 0 : 1;
+}
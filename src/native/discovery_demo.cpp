@@ -0,0 +1,76 @@
+// Poi discovery against real UDP sockets: stand-in responders on
+// 127.0.0.2, 127.0.0.3, ... answer the controller's broadcast probes, the
+// registry fills up, and pattern changes fan out to every poi found. One
+// stand-in then goes quiet and comes back to show expiry and rejoining.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "commands.h"
+#include "fakes.h"
+
+static void printRegistry(PoiNetworkRig& rig) {
+  uint32_t now = rig.clock.millis();
+  printf("Registry: %d poi, %d online\n", rig.registry.count(), rig.registry.onlineCount());
+  for (int i = 0; i < rig.registry.count(); i++) {
+    printf("  [%d] %-12s %-8s seen %u ms ago\n", i, rig.registry.host(i),
+           rig.registry.online(i) ? "online" : "offline", (unsigned)(now - rig.registry.lastSeen(i)));
+  }
+}
+
+// Dispatch and wait for every poi to answer
+static void dispatchAndWait(PoiNetworkRig& rig, int patternNumber) {
+  uint32_t start = rig.clock.millis();
+  rig.dispatcher.dispatch(patternNumber);
+  while (rig.dispatcher.busy()) {
+    rig.run(1);
+  }
+  printf("Pattern %d reached %d poi in %u ms\n", patternNumber, rig.dispatcher.targetCount(),
+         (unsigned)(rig.clock.millis() - start));
+}
+
+int runDiscoveryDemo(int argc, char** argv) {
+  int poiCount = argc > 0 ? atoi(argv[0]) : 6;
+  if (poiCount < 1 || poiCount > MAX_POI_SERVERS) {
+    fprintf(stderr, "Between 1 and %d poi\n", MAX_POI_SERVERS);
+    return 1;
+  }
+
+  PoiNetworkRig rig;
+  for (int i = 0; i < poiCount; i++) {
+    rig.addPoi();
+  }
+  if (!rig.begin()) {
+    return 1;
+  }
+
+  rig.run(3 * NETWORK_RIG_PROBE_INTERVAL_MS);
+  printRegistry(rig);
+  dispatchAndWait(rig, 12);
+  dispatchAndWait(rig, 13);
+
+  printf("\nStand-in %s goes quiet\n", rig.responders[0]->address.c_str());
+  rig.responders[0]->stop();
+  rig.run((DISCOVERY_MISSED_PROBES + 2) * NETWORK_RIG_PROBE_INTERVAL_MS);
+  printRegistry(rig);
+  dispatchAndWait(rig, 14);
+
+  printf("\nStand-in %s is back\n", rig.responders[0]->address.c_str());
+  rig.responders[0]->start();
+  rig.run(2 * NETWORK_RIG_PROBE_INTERVAL_MS);
+  printRegistry(rig);
+  dispatchAndWait(rig, 15);
+
+  printf("\n%u probes, %u replies\n", (unsigned)rig.discovery.probeCount(),
+         (unsigned)rig.discovery.replyCount());
+  bool ok = rig.registry.count() == poiCount && rig.registry.onlineCount() == poiCount;
+  for (const SimPoi& poi : rig.pois) {
+    printf("Poi %s:", poi.host.c_str());
+    for (const SimPoi::Switch& sw : poi.switches) {
+      printf(" %d", sw.pattern);
+    }
+    printf("\n");
+    ok &= !poi.switches.empty() && poi.switches.back().pattern == 15;
+  }
+  return ok ? 0 : 1;
+}
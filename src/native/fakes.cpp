@@ -0,0 +1,788 @@
+#include "fakes.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void poiLog(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+uint32_t SystemClock::millis() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================================
+// TraceImu
+// ============================================================================
+
+// rad/s to raw gyro LSB, saturating like the sensor
+static int16_t toRaw(float rads) {
+  float lsb = rads * 57.2958f * GYRO_LSB_PER_DPS;
+  if (lsb > 32767) return 32767;
+  if (lsb < -32768) return -32768;
+  return (int16_t)lsb;
+}
+
+const ImuSample* TraceImu::at(uint32_t t) {
+  if (samples.empty() || samples[0].timestamp > t) {
+    return NULL;
+  }
+  while (cursor + 1 < samples.size() && samples[cursor + 1].timestamp <= t) {
+    cursor++;
+  }
+  return &samples[cursor];
+}
+
+bool TraceImu::read(ImuSample& sample) {
+  uint32_t now = clock.millis();
+  const ImuSample* s = at(now);
+  if (!s) {
+    return false;
+  }
+  sample = *s;
+  sample.timestamp = now;
+  return true;
+}
+
+bool TraceImu::loadCsv(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    return false;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    unsigned long t;
+    float x, y, z;
+    if (sscanf(line, "%lu,%f,%f,%f", &t, &x, &y, &z) == 4) {
+      samples.push_back(ImuSample{(uint32_t)t, toRaw(x), toRaw(y), toRaw(z)});
+    }
+  }
+  fclose(f);
+  cursor = 0;
+  return !samples.empty();
+}
+
+void TraceImu::addSegment(uint32_t durationMs, float speedDps, uint32_t stepMs) {
+  addRamp(durationMs, speedDps, speedDps, stepMs);
+}
+
+void TraceImu::addRamp(uint32_t durationMs, float fromDps, float toDps, uint32_t stepMs) {
+  uint32_t start = samples.empty() ? 0 : samples.back().timestamp + stepMs;
+  for (uint32_t t = 0; t < durationMs; t += stepMs) {
+    float rads = (fromDps + (toDps - fromDps) * t / durationMs) / 57.2958f;
+    // A little sensor noise so the trace is not perfectly flat
+    float noise = 0.02f * sinf((start + t) * 0.37f);
+    // X-axis is sign-inverted by the controller
+    samples.push_back(ImuSample{start + t, toRaw(-(rads + noise)), toRaw(noise), toRaw(noise)});
+  }
+}
+
+void TraceImu::addWobble(uint32_t durationMs, float speedDps, float amplitude, float hz, uint32_t stepMs) {
+  uint32_t start = samples.empty() ? 0 : samples.back().timestamp + stepMs;
+  for (uint32_t t = 0; t < durationMs; t += stepMs) {
+    float dps = speedDps * (1.0f + amplitude * sinf(6.2832f * hz * t / 1000.0f));
+    float noise = 0.02f * sinf((start + t) * 0.37f);
+    samples.push_back(ImuSample{start + t, toRaw(-(dps / 57.2958f + noise)), toRaw(noise), toRaw(noise)});
+  }
+}
+
+// ============================================================================
+// SimMpu6050
+// ============================================================================
+
+static void pushBigEndian(std::deque<uint8_t>& fifo, int16_t v) {
+  fifo.push_back((uint8_t)(v >> 8));
+  fifo.push_back((uint8_t)(v & 0xFF));
+}
+
+// In cycle mode the accelerometer wakes at 5 Hz and raises the motion
+// interrupt. There is no accelerometer in a trace, so turning faster
+// than SIM_MPU_MOTION_DPS on any axis stands in for motion.
+void SimMpu6050::checkMotion() {
+  bool cycling = (regs[MPU6050_PWR_MGMT_1] & MPU6050_PWR_CYCLE) != 0;
+  uint32_t now = clock.millis();
+  if (!cycling) {
+    lastCycleMs = now;
+    return;
+  }
+  while (now - lastCycleMs >= SIM_MPU_CYCLE_MS) {
+    lastCycleMs += SIM_MPU_CYCLE_MS;
+    const ImuSample* s = trace.at(lastCycleMs);
+    if (!s || !(regs[MPU6050_INT_ENABLE] & MPU6050_INT_MOT)) continue;
+    int16_t limit = (int16_t)(SIM_MPU_MOTION_DPS * GYRO_LSB_PER_DPS);
+    if (abs(s->gyroX) > limit || abs(s->gyroY) > limit || abs(s->gyroZ) > limit) {
+      regs[MPU6050_INT_STATUS] |= MPU6050_INT_MOT;
+    }
+  }
+}
+
+void SimMpu6050::fillFifo() {
+  checkMotion();
+  if (!running) return;
+  uint32_t periodUs = 1000 * (1 + regs[MPU6050_SMPLRT_DIV]);
+  uint32_t nowUs = clock.millis() * 1000;
+  while (nowUs - lastSampleUs >= periodUs) {
+    lastSampleUs += periodUs;
+    if (fifo.size() + MPU6050_FIFO_FRAME_BYTES > MPU6050_FIFO_SIZE) {
+      regs[MPU6050_INT_STATUS] |= MPU6050_INT_FIFO_OFLOW;
+      continue;
+    }
+    const ImuSample* s = trace.at(lastSampleUs / 1000);
+    ImuSample zero = {0, 0, 0, 0};
+    if (!s) s = &zero;
+    pushBigEndian(fifo, s->gyroX);
+    pushBigEndian(fifo, s->gyroY);
+    pushBigEndian(fifo, s->gyroZ);
+  }
+}
+
+bool SimMpu6050::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  transactions++;
+  if (address != MPU6050_ADDRESS || reg >= sizeof(regs)) return false;
+  fillFifo();
+  if (reg == MPU6050_USER_CTRL && (value & MPU6050_USER_CTRL_FIFO_RST)) {
+    fifo.clear();
+    regs[MPU6050_INT_STATUS] &= ~MPU6050_INT_FIFO_OFLOW;
+    value &= ~MPU6050_USER_CTRL_FIFO_RST;
+  }
+  regs[reg] = value;
+  bool wasRunning = running;
+  running = (regs[MPU6050_USER_CTRL] & MPU6050_USER_CTRL_FIFO_EN) && regs[MPU6050_FIFO_EN] == MPU6050_FIFO_EN_GYRO
+            && !(regs[MPU6050_PWR_MGMT_2] & MPU6050_STBY_GYRO);
+  if (running && !wasRunning) {
+    lastSampleUs = clock.millis() * 1000;
+  }
+  return true;
+}
+
+bool SimMpu6050::readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t len) {
+  transactions++;
+  bytesRead += len;
+  if (address != MPU6050_ADDRESS) return false;
+  fillFifo();
+
+  if (reg == MPU6050_FIFO_R_W) {
+    for (size_t i = 0; i < len; i++) {
+      if (fifo.empty()) {
+        data[i] = 0;
+        continue;
+      }
+      data[i] = fifo.front();
+      fifo.pop_front();
+    }
+    return true;
+  }
+  // Output registers hold the latest sample
+  const ImuSample* latest = trace.at(clock.millis());
+  ImuSample zero = {0, 0, 0, 0};
+  if (!latest) latest = &zero;
+  const int16_t gyro[3] = {latest->gyroX, latest->gyroY, latest->gyroZ};
+
+  for (size_t i = 0; i < len; i++) {
+    uint8_t r = reg + i;
+    if (r >= MPU6050_GYRO_XOUT_H && r < MPU6050_GYRO_XOUT_H + 6) {
+      int16_t v = gyro[(r - MPU6050_GYRO_XOUT_H) / 2];
+      data[i] = (r - MPU6050_GYRO_XOUT_H) % 2 ? (uint8_t)(v & 0xFF) : (uint8_t)(v >> 8);
+    } else if (r == MPU6050_WHO_AM_I) {
+      data[i] = 0x68;
+    } else if (r == MPU6050_FIFO_COUNTH) {
+      data[i] = (uint8_t)(fifo.size() >> 8);
+    } else if (r == MPU6050_FIFO_COUNTH + 1) {
+      data[i] = (uint8_t)(fifo.size() & 0xFF);
+    } else if (r == MPU6050_INT_STATUS) {
+      data[i] = regs[r];
+      regs[r] &= ~(MPU6050_INT_FIFO_OFLOW | MPU6050_INT_MOT);  // cleared on read
+    } else {
+      data[i] = r < sizeof(regs) ? regs[r] : 0;
+    }
+  }
+  return true;
+}
+
+// ============================================================================
+// SimTcpConnection
+// ============================================================================
+
+bool SimTcpConnection::connect(const char* host, uint16_t port) {
+  (void)port;
+  connects++;
+  poi = NULL;
+  for (SimPoi& p : pois) {
+    if (p.host == host) poi = &p;
+  }
+  outgoing.clear();
+  response.clear();
+  tcpState = TCP_CONNECTING;
+  connectedAt = clock.millis() + (poi ? poi->connectMs : 0);
+  return true;
+}
+
+bool SimTcpConnection::send(const char* data, size_t len) {
+  if (tcpState != TCP_CONNECTING && tcpState != TCP_CONNECTED) return false;
+  outgoing.append(data, len);
+  return true;
+}
+
+void SimTcpConnection::advance() {
+  uint32_t now = clock.millis();
+  if (tcpState == TCP_CONNECTING && poi && poi->online && now >= connectedAt) {
+    tcpState = TCP_CONNECTED;
+    lastActivity = connectedAt;
+  }
+  if (tcpState != TCP_CONNECTED) return;
+  if (response.empty() && outgoing.empty() && now - lastActivity > poi->idleTimeoutMs) {
+    tcpState = TCP_CLOSED;
+    return;
+  }
+
+  // Serve each complete request in order
+  size_t end;
+  while (response.empty() && (end = outgoing.find("\r\n\r\n")) != std::string::npos) {
+    std::string request = outgoing.substr(0, end);
+    outgoing.erase(0, end + 4);
+
+    int pattern = 0;
+    size_t arg = request.find("patternChooserChange=");
+    if (arg != std::string::npos) {
+      pattern = atoi(request.c_str() + arg + 21);
+    }
+    uint32_t arrival = now > connectedAt ? now : connectedAt;
+    const char* connection = poi->keepAlive ? "keep-alive" : "close";
+    closeAfterResponse = !poi->keepAlive;
+    if (pattern >= MIN_PATTERN_NUMBER && pattern <= MAX_PATTERN_NUMBER) {
+      poi->switches.push_back(SimPoi::Switch{arrival, pattern});
+      response = std::string("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: ") + connection
+               + "\r\nContent-Length: 11\r\n\r\nPattern set";
+    } else {
+      response = std::string("HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nConnection: ") + connection
+               + "\r\nContent-Length: 15\r\n\r\nInvalid pattern";
+    }
+    responseAt = arrival + poi->responseMs;
+    lastActivity = responseAt;
+  }
+}
+
+size_t SimTcpConnection::receive(char* data, size_t max) {
+  advance();
+  if (response.empty() || clock.millis() < responseAt) return 0;
+  size_t n = response.size() < max ? response.size() : max;
+  memcpy(data, response.data(), n);
+  response.erase(0, n);
+  if (response.empty() && closeAfterResponse) {
+    tcpState = TCP_CLOSED;
+  }
+  return n;
+}
+
+void SimTcpConnection::close() {
+  tcpState = TCP_CLOSED;
+}
+
+TcpState SimTcpConnection::state() {
+  advance();
+  return tcpState;
+}
+
+// ============================================================================
+// FakeHttpTransport
+// ============================================================================
+
+int FakeHttpTransport::get(const char* host, uint16_t port, const char* path, uint32_t timeoutMs,
+                           HttpBodySink* body) {
+  (void)port;
+  (void)timeoutMs;
+  requests.push_back(Request{clock.millis(), host, path});
+
+  for (const std::string& offline : offlineHosts) {
+    if (offline == host) return -1;
+  }
+  if (strncmp(path, "/list", 5) == 0) {
+    if (body) body->write(listing.data(), listing.size());
+    return 200;
+  }
+  return 404;
+}
+
+// ============================================================================
+// MemoryFileStore
+// ============================================================================
+
+int MemoryFileStore::read(const char* path, uint8_t* data, size_t max) {
+  auto it = files.find(path);
+  if (it == files.end()) return -1;
+  size_t len = it->second.size() < max ? it->second.size() : max;
+  memcpy(data, it->second.data(), len);
+  return (int)len;
+}
+
+bool MemoryFileStore::write(const char* path, const uint8_t* data, size_t len) {
+  files[path].assign(data, data + len);
+  writes++;
+  return true;
+}
+
+bool MemoryFileStore::append(const char* path, const uint8_t* data, size_t len) {
+  files[path].insert(files[path].end(), data, data + len);
+  appends++;
+  return true;
+}
+
+int MemoryFileStore::readAt(const char* path, uint32_t offset, uint8_t* data, size_t max) {
+  auto it = files.find(path);
+  if (it == files.end()) return -1;
+  if (offset >= it->second.size()) return 0;
+  size_t len = it->second.size() - offset < max ? it->second.size() - offset : max;
+  memcpy(data, it->second.data() + offset, len);
+  return (int)len;
+}
+
+int32_t MemoryFileStore::size(const char* path) {
+  auto it = files.find(path);
+  return it == files.end() ? -1 : (int32_t)it->second.size();
+}
+
+bool MemoryFileStore::remove(const char* path) {
+  files.erase(path);
+  return true;
+}
+
+// ============================================================================
+// SimWifi
+// ============================================================================
+
+void SimWifi::connect(const char* ssid, const char* password, const uint8_t* bssid, uint8_t channel,
+                      const WiFiLastConnection* lease) {
+  joined = -1;
+  joins++;
+  joining = -1;
+  for (size_t i = 0; i < aps.size(); i++) {
+    const SimAccessPoint& ap = aps[i];
+    if (ap.up && ap.ssid == ssid && ap.password == password
+        && (!bssid || memcmp(ap.bssid, bssid, sizeof(ap.bssid)) == 0)) {
+      joining = (int)i;
+      break;
+    }
+  }
+  uint32_t ms = SIM_WIFI_FAIL_MS;
+  if (joining >= 0) {
+    ms = SIM_WIFI_ASSOC_MS + (channel == aps[joining].channel ? 0 : SIM_WIFI_SWEEP_MS)
+       + (lease ? 0 : SIM_WIFI_DHCP_MS);
+  }
+  pending = true;
+  joinAt = clock.millis() + ms;
+}
+
+void SimWifi::disconnect() {
+  joined = -1;
+  pending = false;
+}
+
+bool SimWifi::startScan() {
+  scans++;
+  scanning = true;
+  scanAt = clock.millis() + SIM_WIFI_SCAN_MS;
+  return true;
+}
+
+int SimWifi::scanResults(WifiScanResult* results, int max) {
+  int n = 0;
+  for (const SimAccessPoint& ap : aps) {
+    if (!ap.up || n == max) continue;
+    snprintf(results[n].ssid, sizeof(results[n].ssid), "%s", ap.ssid.c_str());
+    memcpy(results[n].bssid, ap.bssid, sizeof(ap.bssid));
+    results[n].channel = ap.channel;
+    results[n].rssi = ap.rssi;
+    n++;
+  }
+  return n;
+}
+
+void SimWifi::connection(WiFiLastConnection& last) {
+  if (joined < 0) return;
+  const SimAccessPoint& ap = aps[joined];
+  memcpy(last.bssid, ap.bssid, sizeof(last.bssid));
+  last.channel = ap.channel;
+  last.ip = 0x0a00a8c0 + ((uint32_t)joined << 24);  // 192.168.0.10 + joined
+  last.gateway = 0x0100a8c0;
+  last.subnet = 0x00ffffff;
+  last.dns = 0x0100a8c0;
+}
+
+uint8_t SimWifi::takeEvents() {
+  uint8_t taken = events;
+  events = 0;
+  return taken;
+}
+
+void SimWifi::step() {
+  uint32_t now = clock.millis();
+  if (pending && (int32_t)(now - joinAt) >= 0) {
+    pending = false;
+    if (joining >= 0 && aps[joining].up) {
+      joined = joining;
+      events |= POI_WIFI_CONNECTED;
+    } else {
+      events |= POI_WIFI_DISCONNECTED;
+    }
+  }
+  if (joined >= 0 && !aps[joined].up) {
+    joined = -1;
+    events |= POI_WIFI_DISCONNECTED;
+  }
+  if (scanning && (int32_t)(now - scanAt) >= 0) {
+    scanning = false;
+    events |= POI_WIFI_SCAN_DONE;
+  }
+}
+
+// ============================================================================
+// SimTelemetryClient
+// ============================================================================
+
+void SimTelemetryClient::drain() {
+  uint32_t now = clock.millis();
+  budget += (uint64_t)(now - lastDrain) * bytesPerSecond;
+  lastDrain = now;
+  while (!queue.empty() && budget >= queue.front().size() * 1000) {
+    budget -= queue.front().size() * 1000;
+    decode(queue.front());
+    queue.pop_front();
+  }
+  if (queue.empty()) {
+    budget = 0;  // an idle link does not bank bandwidth
+  }
+}
+
+bool SimTelemetryClient::trySend(const uint8_t* data, size_t len) {
+  drain();
+  if (queue.size() >= queueFrames) return false;
+  queue.emplace_back(data, data + len);
+  return true;
+}
+
+void SimTelemetryClient::decode(const std::vector<uint8_t>& frame) {
+  const uint8_t* p = frame.data();
+  if (frame.size() < TELEMETRY_HEADER_SIZE || p[0] != 'T' || p[1] != 'M' || p[2] != TELEMETRY_VERSION
+      || frame.size() != TELEMETRY_HEADER_SIZE + p[3] * (size_t)TELEMETRY_POINT_SIZE) {
+    malformed++;
+    return;
+  }
+  int seq = p[4] | (p[5] << 8);
+  uint32_t first = p[8] | (p[9] << 8) | (p[10] << 16) | ((uint32_t)p[11] << 24);
+  uint32_t last = p[12] | (p[13] << 8) | (p[14] << 16) | ((uint32_t)p[15] << 24);
+  if (lastSeq >= 0) {
+    seqGaps += (uint16_t)(seq - lastSeq - 1);
+  }
+  if ((int32_t)(last - first) < 0 || (framesDelivered > 0 && (int32_t)(first - lastTimestamp) <= 0)) {
+    malformed++;
+  }
+  lastSeq = seq;
+  lastTimestamp = last;
+  for (int i = 0; i < p[3]; i++) {
+    uint8_t state = p[TELEMETRY_HEADER_SIZE + i * TELEMETRY_POINT_SIZE + 6];
+    rotatingPoints += (state & TELEMETRY_ROTATING) != 0;
+    stillPoints += (state & TELEMETRY_STILL) != 0;
+  }
+  framesDelivered++;
+  pointsDelivered += p[3];
+  bytesDelivered += frame.size();
+}
+
+// ============================================================================
+// PosixUdpSocket
+// ============================================================================
+
+bool PosixUdpSocket::open(const char* address, uint16_t port, bool shared) {
+  close();
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) return false;
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+  if (shared) {
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr) != 1
+      || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void PosixUdpSocket::close() {
+  if (fd >= 0) ::close(fd);
+  fd = -1;
+}
+
+bool PosixUdpSocket::joinMulticast(const char* group, const char* interfaceAddress) {
+  if (fd < 0) return false;
+  ip_mreq membership = {};
+  if (inet_pton(AF_INET, group, &membership.imr_multiaddr) != 1
+      || inet_pton(AF_INET, interfaceAddress, &membership.imr_interface) != 1) {
+    return false;
+  }
+  return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == 0;
+}
+
+bool PosixUdpSocket::setMulticastInterface(const char* interfaceAddress) {
+  if (fd < 0) return false;
+  in_addr addr = {};
+  unsigned char loop = 1;
+  if (inet_pton(AF_INET, interfaceAddress, &addr) != 1) return false;
+  return setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) == 0
+      && setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == 0;
+}
+
+bool PosixUdpSocket::sendTo(const char* host, uint16_t port, const uint8_t* data, size_t len) {
+  if (fd < 0) return false;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) return false;
+  return sendto(fd, data, len, 0, (sockaddr*)&addr, sizeof(addr)) == (ssize_t)len;
+}
+
+size_t PosixUdpSocket::receive(uint8_t* data, size_t max, char* fromHost, uint16_t* fromPort) {
+  if (fd < 0) return 0;
+  sockaddr_in from = {};
+  socklen_t fromLen = sizeof(from);
+  ssize_t n = recvfrom(fd, data, max, 0, (sockaddr*)&from, &fromLen);
+  if (n <= 0) return 0;
+  inet_ntop(AF_INET, &from.sin_addr, fromHost, 16);
+  if (fromPort) *fromPort = ntohs(from.sin_port);
+  return (size_t)n;
+}
+
+// ============================================================================
+// DiscoveryResponder
+// ============================================================================
+
+bool DiscoveryResponder::start() {
+  if (!listener.open("0.0.0.0", DISCOVERY_PORT, true) || !replier.open(address.c_str(), 0, false)) {
+    return false;
+  }
+  running = true;
+  thread = std::thread(&DiscoveryResponder::run, this);
+  return true;
+}
+
+void DiscoveryResponder::stop() {
+  if (!running) return;
+  running = false;
+  thread.join();
+  listener.close();
+  replier.close();
+}
+
+void DiscoveryResponder::run() {
+  uint8_t data[64];
+  char from[16];
+  uint16_t fromPort;
+  while (running) {
+    size_t len = listener.receive(data, sizeof(data), from, &fromPort);
+    if (len == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      continue;
+    }
+    if (!isDiscoveryProbe(data, len)) continue;
+    // Reply to wherever the probe came from
+    uint8_t reply[DISCOVERY_REPLY_SIZE];
+    replier.sendTo(from, fromPort, reply, encodeDiscoveryReply(reply, httpPort, features));
+    probesAnswered++;
+  }
+}
+
+// ============================================================================
+// SwitchReceiver
+// ============================================================================
+
+static int64_t steadyMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool SwitchReceiver::start() {
+  if (!socket.open("0.0.0.0", SWITCH_PORT, true)
+      || !socket.joinMulticast(SWITCH_MULTICAST_GROUP, "127.0.0.1")
+      || (!address.empty() && !syncSocket.open(address.c_str(), CLOCK_SYNC_PORT, true))) {
+    socket.close();
+    syncSocket.close();
+    return false;
+  }
+  dedup.reset();
+  running = true;
+  thread = std::thread(&SwitchReceiver::run, this);
+  return true;
+}
+
+void SwitchReceiver::stop() {
+  if (!running) return;
+  running = false;
+  thread.join();
+  socket.close();
+  syncSocket.close();
+}
+
+std::vector<SwitchReceiver::Applied> SwitchReceiver::applied() {
+  std::lock_guard<std::mutex> guard(lock);
+  return switches;
+}
+
+int64_t SwitchReceiver::delayUs() {
+  return maxDelayMs ? rand_r(&seed) % (maxDelayMs * 1000 + 1) : 0;
+}
+
+void SwitchReceiver::deliver(const Datagram& datagram) {
+  uint32_t now = localMillis();
+  if (datagram.sync) {
+    uint8_t reply[CLOCK_SYNC_REPLY_SIZE];
+    size_t len = poiClock.answer(datagram.data.data(), datagram.data.size(), now, now, reply);
+    synced = poiClock.synced();
+    if (len > 0) {
+      outgoing.push_back({steadyMicros() + delayUs(), true, std::vector<uint8_t>(reply, reply + len),
+                          datagram.host, datagram.port});
+    }
+    return;
+  }
+
+  SwitchCommand command;
+  if (!decodeSwitchCommand(datagram.data.data(), datagram.data.size(), command)) return;
+  received++;
+  if (!dedup.accept(command)) {
+    duplicates++;
+    return;
+  }
+  // A newer command replaces one still waiting for its time
+  pending = {command.pattern, command.seq, command.timestamp, 0, 0};
+  pendingDue = poiClock.switchTime(command, now);
+  switchPending = true;
+}
+
+void SwitchReceiver::run() {
+  uint8_t data[64];
+  char from[16];
+  uint16_t fromPort;
+  while (running) {
+    size_t len;
+    while ((len = socket.receive(data, sizeof(data), from, NULL)) > 0) {
+      if ((int)(rand_r(&seed) % 100) < lossPercent) {
+        lost++;
+        continue;
+      }
+      incoming.push_back({steadyMicros() + delayUs(), false, std::vector<uint8_t>(data, data + len), from, 0});
+    }
+    while (!address.empty() && (len = syncSocket.receive(data, sizeof(data), from, &fromPort)) > 0) {
+      incoming.push_back({steadyMicros() + delayUs(), true, std::vector<uint8_t>(data, data + len), from, fromPort});
+    }
+
+    int64_t nowUs = steadyMicros();
+    for (size_t k = 0; k < incoming.size();) {
+      if (incoming[k].dueUs > nowUs) {
+        k++;
+        continue;
+      }
+      Datagram datagram = incoming[k];
+      incoming.erase(incoming.begin() + k);
+      deliver(datagram);
+    }
+    for (size_t k = 0; k < outgoing.size();) {
+      if (outgoing[k].dueUs > nowUs) {
+        k++;
+        continue;
+      }
+      syncSocket.sendTo(outgoing[k].host.c_str(), outgoing[k].port, outgoing[k].data.data(), outgoing[k].data.size());
+      outgoing.erase(outgoing.begin() + k);
+    }
+
+    if (switchPending && (int32_t)(localMillis() - pendingDue) >= 0) {
+      switchPending = false;
+      pending.appliedAt = clock.millis();
+      pending.appliedAtUs = steadyMicros();
+      std::lock_guard<std::mutex> guard(lock);
+      switches.push_back(pending);
+    }
+    // Short sleep so the measured latency is the network's, not ours
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+// ============================================================================
+// PoiNetworkRig
+// ============================================================================
+
+PoiNetworkRig::PoiNetworkRig()
+  : discovery(discoverySocket, clock, registry, "127.255.255.255", NETWORK_RIG_PROBE_INTERVAL_MS),
+    connections(MAX_POI_SERVERS, SimTcpConnection(clock, pois)),
+    dispatcher(clock, connectionPtrs, registry) {
+  for (int i = 0; i < MAX_POI_SERVERS; i++) {
+    connectionPtrs[i] = &connections[i];
+  }
+  pois.reserve(MAX_POI_SERVERS);  // connections keep pointers to their poi
+}
+
+std::string PoiNetworkRig::addPoi(uint8_t features) {
+  std::string address = "127.0.0." + std::to_string(pois.size() + 2);
+  pois.emplace_back();
+  pois.back().host = address;
+  responders.emplace_back(new DiscoveryResponder(address, 80, features));
+  return address;
+}
+
+void PoiNetworkRig::enableMulticast() {
+  switcher.reset(new MulticastSwitcher(switchSocket, clock));
+  dispatcher.setMulticast(switcher.get());
+}
+
+void PoiNetworkRig::enableClockSync(uint32_t intervalMs, uint32_t fastIntervalMs) {
+  clockSync.reset(new ClockSync(syncSocket, clock, registry, intervalMs, fastIntervalMs));
+}
+
+bool PoiNetworkRig::begin() {
+  for (auto& responder : responders) {
+    if (!responder->start()) {
+      fprintf(stderr, "Failed to start stand-in on %s:%d\n", responder->address.c_str(), DISCOVERY_PORT);
+      return false;
+    }
+  }
+  if (!discovery.begin()) {
+    return false;
+  }
+  if (switcher && (!switcher->begin() || !switchSocket.setMulticastInterface("127.0.0.1"))) {
+    return false;
+  }
+  return !clockSync || clockSync->begin();
+}
+
+void PoiNetworkRig::run(uint32_t ms) {
+  uint32_t end = clock.millis() + ms;
+  while ((int32_t)(clock.millis() - end) < 0) {
+    discovery.poll();
+    if (clockSync) {
+      clockSync->poll();
+    }
+    dispatcher.poll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock_sync.h"
+#include "config_store.h"
+#include "hal.h"
+#include "mpu6050.h"
+#include "multicast_switcher.h"
+#include "pattern_client.h"
+#include "pattern_dispatcher.h"
+#include "telemetry.h"
+#include "poi_discovery.h"
+
+// Host-side stand-ins for the HAL, used by env:native
+
+// Wall-clock milliseconds, for code that talks to real sockets
+class SystemClock : public Clock {
+public:
+  uint32_t millis() override;
+};
+
+class FakeClock : public Clock {
+public:
+  uint32_t millis() override { return now; }
+  void advance(uint32_t ms) { now += ms; }
+
+  uint32_t now = 0;
+};
+
+// Replays a recorded or synthesized gyro trace against a FakeClock.
+// read() returns the latest sample at or before the current time.
+class TraceImu : public ImuSource {
+public:
+  explicit TraceImu(Clock& clock) : clock(clock) {}
+
+  bool begin() override { return !samples.empty(); }
+  bool read(ImuSample& sample) override;
+  // Latest sample at or before time t (t must not go backwards)
+  const ImuSample* at(uint32_t t);
+
+  // CSV lines of "timestamp_ms,gyro_x,gyro_y,gyro_z" in rad/s, '#' comments allowed
+  bool loadCsv(const char* path);
+  // Append a constant-speed segment on the X axis (deg/s), sampled every stepMs
+  void addSegment(uint32_t durationMs, float speedDps, uint32_t stepMs = 10);
+  // Append a linear change of speed from fromDps to toDps
+  void addRamp(uint32_t durationMs, float fromDps, float toDps, uint32_t stepMs = 10);
+  // Append a spin with a periodic speed wobble (amplitude as a fraction of speed)
+  void addWobble(uint32_t durationMs, float speedDps, float amplitude, float hz, uint32_t stepMs = 10);
+  uint32_t duration() const { return samples.empty() ? 0 : samples.back().timestamp; }
+
+  std::vector<ImuSample> samples;
+
+private:
+  Clock& clock;
+  size_t cursor = 0;
+};
+
+#define SIM_MPU_CYCLE_MS 200     // LP_WAKE_CTRL 5 Hz
+#define SIM_MPU_MOTION_DPS 30.0f
+
+// MPU-6050 register map with a 1 KB FIFO that fills from a TraceImu at
+// the rate programmed into SMPLRT_DIV, for exercising Mpu6050Fifo. Cycle
+// mode raises the motion interrupt, see checkMotion().
+class SimMpu6050 : public I2cBus {
+public:
+  SimMpu6050(Clock& clock, TraceImu& trace) : clock(clock), trace(trace) {}
+
+  bool writeRegister(uint8_t address, uint8_t reg, uint8_t value) override;
+  bool readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t len) override;
+
+  uint32_t transactions = 0;
+  uint32_t bytesRead = 0;
+
+private:
+  void fillFifo();
+  void checkMotion();
+
+  Clock& clock;
+  TraceImu& trace;
+  uint8_t regs[128] = {};
+  std::deque<uint8_t> fifo;
+  uint32_t lastSampleUs = 0;
+  uint32_t lastCycleMs = 0;
+  bool running = false;
+};
+
+class FakeLed : public StatusLed {
+public:
+  void set(bool on) override {
+    if (on != lit) transitions++;
+    lit = on;
+  }
+
+  bool lit = false;
+  int transitions = 0;
+};
+
+// A SmartPoi web server as seen over SimTcpConnection
+struct SimPoi {
+  std::string host;
+  bool online = true;
+  uint32_t connectMs = 15;   // TCP handshake
+  uint32_t responseMs = 8;   // request arrival to response
+  bool keepAlive = true;     // otherwise close after each response
+  uint32_t idleTimeoutMs = 10000;  // drop idle connections
+
+  struct Switch {
+    uint32_t time;  // when the request arrived at the poi
+    int pattern;
+  };
+  std::vector<Switch> switches;
+};
+
+// Non-blocking TCP connection to one of a set of SimPois, driven by the
+// FakeClock. Unknown or offline hosts never answer.
+class SimTcpConnection : public TcpConnection {
+public:
+  SimTcpConnection(Clock& clock, std::vector<SimPoi>& pois) : clock(clock), pois(pois) {}
+
+  bool connect(const char* host, uint16_t port) override;
+  bool send(const char* data, size_t len) override;
+  size_t receive(char* data, size_t max) override;
+  void close() override;
+  TcpState state() override;
+
+  uint32_t connects = 0;
+
+private:
+  void advance();
+
+  Clock& clock;
+  std::vector<SimPoi>& pois;
+  SimPoi* poi = NULL;
+  TcpState tcpState = TCP_IDLE;
+  uint32_t connectedAt = 0;
+  uint32_t lastActivity = 0;
+  bool closeAfterResponse = false;
+  std::string outgoing;
+  std::string response;
+  uint32_t responseAt = 0;
+};
+
+// Answers /list with a canned listing and records every request
+class FakeHttpTransport : public HttpTransport {
+public:
+  explicit FakeHttpTransport(Clock& clock) : clock(clock) {}
+
+  int get(const char* host, uint16_t port, const char* path, uint32_t timeoutMs,
+          HttpBodySink* body) override;
+
+  struct Request {
+    uint32_t time;
+    std::string host;
+    std::string path;
+  };
+
+  std::string listing = "[{\"type\":\"file\",\"name\":\"a.bin\"},{\"type\":\"file\",\"name\":\"b.bin\"},"
+                        "{\"type\":\"file\",\"name\":\"C.bin\"},{\"type\":\"file\",\"name\":\"index.htm\"}]";
+  std::vector<std::string> offlineHosts;  // hosts that fail to connect
+  std::vector<Request> requests;
+
+private:
+  Clock& clock;
+};
+
+// A WebSocket client behind a link of bytesPerSecond, driven by the
+// FakeClock: frames queue up to queueFrames deep and drain at the link
+// rate; trySend() fails while the queue is full. Delivered frames are
+// decoded and checked.
+class SimTelemetryClient : public TelemetrySink {
+public:
+  SimTelemetryClient(Clock& clock, uint32_t bytesPerSecond, size_t queueFrames)
+    : clock(clock), bytesPerSecond(bytesPerSecond), queueFrames(queueFrames) {}
+
+  bool active() override { return connected; }
+  bool trySend(const uint8_t* data, size_t len) override;
+
+  bool connected = true;
+  int framesDelivered = 0;
+  int pointsDelivered = 0;
+  int seqGaps = 0;        // frames missing between delivered ones
+  int malformed = 0;
+  int rotatingPoints = 0;
+  int stillPoints = 0;
+  size_t bytesDelivered = 0;
+
+private:
+  void drain();
+  void decode(const std::vector<uint8_t>& frame);
+
+  Clock& clock;
+  uint32_t bytesPerSecond;
+  size_t queueFrames;
+  std::deque<std::vector<uint8_t>> queue;
+  uint32_t lastDrain = 0;
+  uint64_t budget = 0;  // bytes * 1000 the link could have sent
+  int lastSeq = -1;
+  uint32_t lastTimestamp = 0;
+};
+
+// Flash filesystem kept in memory; writes counts the number of replaced
+// files and appends the number of appends
+class MemoryFileStore : public FileStore {
+public:
+  int read(const char* path, uint8_t* data, size_t max) override;
+  bool write(const char* path, const uint8_t* data, size_t len) override;
+  bool append(const char* path, const uint8_t* data, size_t len) override;
+  int readAt(const char* path, uint32_t offset, uint8_t* data, size_t max) override;
+  int32_t size(const char* path) override;
+  bool remove(const char* path) override;
+
+  std::map<std::string, std::vector<uint8_t>> files;
+  int writes = 0;
+  int appends = 0;
+};
+
+// An access point around the controller
+struct SimAccessPoint {
+  std::string ssid;
+  std::string password;
+  uint8_t bssid[6];
+  uint8_t channel;
+  int8_t rssi;
+  bool up;
+};
+
+#define SIM_WIFI_ASSOC_MS 250   // join on a known channel
+#define SIM_WIFI_SWEEP_MS 1300  // extra to find the access point without one
+#define SIM_WIFI_DHCP_MS 600    // skipped with a lease
+#define SIM_WIFI_FAIL_MS 1000   // until a join with no such network or a wrong password gives up
+#define SIM_WIFI_SCAN_MS 1300
+
+// WifiDriver over SimAccessPoints on a FakeClock. Call step() as the
+// clock advances; it raises the events that are due, including a
+// disconnect when the joined access point goes down.
+class SimWifi : public WifiDriver {
+public:
+  explicit SimWifi(Clock& clock) : clock(clock) {}
+
+  void connect(const char* ssid, const char* password, const uint8_t* bssid, uint8_t channel,
+               const WiFiLastConnection* lease) override;
+  void disconnect() override;
+  bool startScan() override;
+  int scanResults(WifiScanResult* results, int max) override;
+  void connection(WiFiLastConnection& last) override;
+  uint8_t takeEvents() override;
+
+  void step();
+  // Index into aps, -1 if not connected
+  int joinedAp() const { return joined; }
+
+  std::vector<SimAccessPoint> aps;
+  int joins = 0;
+  int scans = 0;
+
+private:
+  Clock& clock;
+  int joined = -1;
+  int joining = -1;    // access point being joined, -1 for a join that will fail
+  bool pending = false;
+  uint32_t joinAt = 0;
+  bool scanning = false;
+  uint32_t scanAt = 0;
+  uint8_t events = 0;
+};
+
+// UdpSocket on a BSD socket, so discovery can be tried against stand-ins
+// on loopback. Broadcast to 127.255.255.255 reaches every stand-in.
+class PosixUdpSocket : public UdpSocket {
+public:
+  ~PosixUdpSocket() override { close(); }
+  bool begin(uint16_t localPort) override { return open("0.0.0.0", localPort, false); }
+  bool sendTo(const char* host, uint16_t port, const uint8_t* data, size_t len) override;
+  size_t receive(uint8_t* data, size_t max, char* fromHost, uint16_t* fromPort) override;
+
+  // Bind to a specific address; shared lets several sockets bind the same port
+  bool open(const char* address, uint16_t port, bool shared);
+  void close();
+  // Receive a multicast group's datagrams arriving on an interface
+  bool joinMulticast(const char* group, const char* interfaceAddress);
+  // Send multicast out of an interface, 127.0.0.1 to keep it on loopback
+  bool setMulticastInterface(const char* interfaceAddress);
+
+private:
+  int fd = -1;
+};
+
+// Stand-in for a poi's discovery responder: answers probes on
+// DISCOVERY_PORT from its own loopback address (127.0.0.x), on a thread
+class DiscoveryResponder {
+public:
+  DiscoveryResponder(const std::string& address, uint16_t httpPort, uint8_t features = 0)
+    : address(address), httpPort(httpPort), features(features) {}
+  ~DiscoveryResponder() { stop(); }
+
+  bool start();
+  void stop();
+
+  std::string address;
+  uint16_t httpPort;
+  uint8_t features;  // POI_FEATURE_* advertised in replies
+  std::atomic<int> probesAnswered{0};
+
+private:
+  void run();
+
+  PosixUdpSocket listener;  // shared DISCOVERY_PORT, receives the broadcast
+  PosixUdpSocket replier;   // bound to address so replies come from it
+  std::atomic<bool> running{false};
+  std::thread thread;
+};
+
+// Stand-in for a poi receiving multicast switch commands: joins
+// SWITCH_MULTICAST_GROUP on loopback, drops lossPercent of the datagrams
+// at random to mimic a busy WiFi channel and applies the rest through a
+// SwitchDeduplicator, on a thread.
+//
+// With an address set it also answers ClockSync pings there, from a
+// millis() clockOffset ahead of the controller's, and honours scheduled
+// switch times. maxDelayMs delays every datagram, either way, by a random
+// amount so that immediate switches drift apart.
+class SwitchReceiver {
+public:
+  explicit SwitchReceiver(int lossPercent = 0, unsigned seed = 1)
+    : lossPercent(lossPercent), seed(seed) {}
+  ~SwitchReceiver() { stop(); }
+
+  bool start();
+  void stop();
+
+  struct Applied {
+    int pattern;
+    uint16_t seq;
+    uint32_t sentAt;      // command timestamp, controller clock
+    uint32_t appliedAt;   // controller clock
+    int64_t appliedAtUs;  // steady_clock, for alignment between stand-ins
+  };
+  // Copy of the switches applied so far
+  std::vector<Applied> applied();
+  bool clockSynced() const { return synced; }
+
+  int lossPercent;
+  std::string address;      // empty: no clock sync
+  int32_t clockOffset = 0;
+  uint32_t maxDelayMs = 0;
+  std::atomic<int> received{0};    // datagrams that got through
+  std::atomic<int> lost{0};        // dropped on purpose
+  std::atomic<int> duplicates{0};  // repeats of a command already applied
+
+private:
+  struct Datagram {
+    int64_t dueUs;  // delivery (incoming) or send (outgoing) time
+    bool sync;
+    std::vector<uint8_t> data;
+    std::string host;
+    uint16_t port;
+  };
+
+  void run();
+  uint32_t localMillis() { return clock.millis() + (uint32_t)clockOffset; }
+  int64_t delayUs();
+  void deliver(const Datagram& datagram);
+
+  unsigned seed;
+  SystemClock clock;
+  PosixUdpSocket socket;
+  PosixUdpSocket syncSocket;
+  SwitchDeduplicator dedup;
+  PoiClock poiClock;
+  std::atomic<bool> synced{false};
+  std::vector<Datagram> incoming;
+  std::vector<Datagram> outgoing;
+  bool switchPending = false;
+  Applied pending;
+  uint32_t pendingDue = 0;  // local millis
+  std::mutex lock;
+  std::vector<Applied> switches;
+  std::atomic<bool> running{false};
+  std::thread thread;
+};
+
+#define NETWORK_RIG_PROBE_INTERVAL_MS 200  // so expiry takes well under a second
+
+// The controller's side of a poi network on loopback, shared by the
+// discovery, multicast and sync demos: discovery and the dispatcher, plus
+// the multicast switcher and clock sync once enabled. addPoi() puts a
+// stand-in on the next 127.0.0.x that answers probes with the given
+// features; its web server is simulated through SimTcpConnection.
+class PoiNetworkRig {
+public:
+  PoiNetworkRig();
+
+  // Returns the stand-in's address; call before begin()
+  std::string addPoi(uint8_t features = 0);
+  // Switch capable poi by multicast from switchSocket
+  void enableMulticast();
+  // Ping poi that advertise POI_FEATURE_CLOCK_SYNC from syncSocket
+  void enableClockSync(uint32_t intervalMs, uint32_t fastIntervalMs);
+  // Start the stand-ins, then the controller's sockets
+  bool begin();
+  // The main loop's share of the work for ms
+  void run(uint32_t ms);
+
+  SystemClock clock;
+  PosixUdpSocket discoverySocket;
+  PosixUdpSocket switchSocket;
+  PosixUdpSocket syncSocket;
+  PoiRegistry registry;
+  PoiDiscovery discovery;
+  std::unique_ptr<MulticastSwitcher> switcher;
+  std::unique_ptr<ClockSync> clockSync;
+  std::vector<SimPoi> pois;
+  std::vector<SimTcpConnection> connections;
+  TcpConnection* connectionPtrs[MAX_POI_SERVERS];
+  PatternDispatcher dispatcher;
+  std::vector<std::unique_ptr<DiscoveryResponder>> responders;
+};
@@ -0,0 +1,234 @@
+// Gesture recognition check: clips of each gesture at different speeds
+// and timings, and of ordinary moves that must not be taken for one, run
+// through GestureEngine; then a short show through the whole Controller
+// with gestures on, checking which pattern each pause sends. Reports the
+// per-sample cost as well.
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "commands.h"
+#include "controller.h"
+#include "fakes.h"
+#include "sample_pipe.h"
+
+// Half-swings of a shake: triangles of peak dps, halfMs each
+static void addShake(TraceImu& trace, int halfSwings, float peak, uint32_t halfMs) {
+  for (int i = 0; i < halfSwings; i++) {
+    float sign = i % 2 ? -1.0f : 1.0f;
+    trace.addRamp(halfMs / 2, 0, sign * peak, 1);
+    trace.addRamp(halfMs / 2, sign * peak, 0, 1);
+  }
+}
+
+static void addReversal(TraceImu& trace, float dps, uint32_t pauseMs) {
+  trace.addRamp(300, 0, dps, 1);
+  trace.addWobble(2000, dps, 0.1f, 2.0f, 1);
+  if (pauseMs) {
+    trace.addRamp(150, dps, 0, 1);
+    trace.addSegment(pauseMs, 0, 1);
+    trace.addRamp(150, 0, -dps, 1);
+  } else {
+    trace.addRamp(300, dps, -dps, 1);
+  }
+  trace.addWobble(2000, -dps, 0.1f, 2.0f, 1);
+  trace.addRamp(300, -dps, 0, 1);
+}
+
+static void addDoubleStall(TraceImu& trace, float dps, uint32_t stopMs, uint32_t spinMs) {
+  trace.addRamp(300, 0, dps, 1);
+  trace.addWobble(2000, dps, 0.1f, 2.0f, 1);
+  trace.addRamp(200, dps, 0, 1);
+  trace.addSegment(stopMs, 5, 1);
+  trace.addRamp(150, 0, dps, 1);
+  trace.addSegment(spinMs, dps, 1);
+  trace.addRamp(150, dps, 0, 1);
+}
+
+struct Clip {
+  const char* name;
+  Gesture expected;  // GESTURE_NONE: ordinary moves
+  int variants;
+  void (*build)(TraceImu& trace, int variant);
+};
+
+static const Clip clips[] = {
+  {"reversal through zero", GESTURE_REVERSAL, 4,
+   [](TraceImu& t, int v) { addReversal(t, 300.0f + 200 * v, 0); }},
+  {"reversal with a stop", GESTURE_REVERSAL, 4,
+   [](TraceImu& t, int v) { addReversal(t, -(300.0f + 200 * v), 40 + 20 * v); }},
+  {"double stall", GESTURE_DOUBLE_STALL, 4,
+   [](TraceImu& t, int v) { addDoubleStall(t, 400.0f + 150 * v, 250 + 150 * v, 300 + 100 * v); }},
+  {"shake", GESTURE_SHAKE, 4,
+   [](TraceImu& t, int v) { addShake(t, 4 + v % 2, 250.0f + 50 * v, 80 + 30 * v); }},
+  {"spin and stall", GESTURE_NONE, 3,
+   [](TraceImu& t, int v) {
+     t.addRamp(400, 0, 500.0f + 150 * v, 1);
+     t.addWobble(4000, 500.0f + 150 * v, 0.15f, 2.0f, 1);
+     t.addRamp(300, 500.0f + 150 * v, 0, 1);
+   }},
+  {"brief hold", GESTURE_NONE, 3,
+   [](TraceImu& t, int v) {
+     t.addRamp(300, 0, 700, 1);
+     t.addWobble(3000, 700, 0.1f, 2.0f, 1);
+     t.addRamp(200, 700, 0, 1);
+     t.addSegment(900 + 300 * v, 8, 1);
+     t.addRamp(200, 0, 700, 1);
+     t.addWobble(3000, 700, 0.1f, 2.0f, 1);
+     t.addRamp(200, 700, 0, 1);
+   }},
+  {"slow wobbly spin", GESTURE_NONE, 3,
+   [](TraceImu& t, int v) {
+     t.addRamp(500, 0, 180, 1);
+     t.addWobble(6000, 180, 0.3f + 0.1f * v, 1.0f, 1);
+     t.addRamp(500, 180, 0, 1);
+   }},
+  {"picked up and put down", GESTURE_NONE, 3,
+   [](TraceImu& t, int v) {
+     t.addRamp(150, 0, 200.0f + 100 * v, 1);
+     t.addRamp(250, 200.0f + 100 * v, 0, 1);
+     t.addSegment(500, 0, 1);
+   }},
+};
+
+// Counts what the engine recognizes in one clip, with rest either side
+static int recognize(const Clip& clip, int variant, Gesture& seen, double& ns, size_t& samples) {
+  FakeClock clock;
+  TraceImu trace(clock);
+  trace.addSegment(1500, 0, 1);
+  clip.build(trace, variant);
+  trace.addSegment(1500, 0, 1);
+
+  GestureEngine engine;
+  int count = 0;
+  seen = GESTURE_NONE;
+  auto start = std::chrono::steady_clock::now();
+  for (const ImuSample& s : trace.samples) {
+    Gesture g = engine.update(axisRotationSpeed(s, 0), s.timestamp);
+    if (g != GESTURE_NONE) {
+      count++;
+      seen = g;
+    }
+  }
+  ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  samples += trace.samples.size();
+  return count;
+}
+
+// A show through the controller: which pattern index each pause sends
+struct GestureRig {
+  GestureRig()
+    : trace(clock),
+      pipe(trace),
+      http(clock),
+      patterns(http, registry),
+      connections(MAX_POI_SERVERS, SimTcpConnection(clock, pois)),
+      dispatcher(clock, connectionPtrs, registry),
+      controller(pipe, clock, led, patterns, dispatcher, ControllerConfig{0, false, StallDetectorConfig()}) {
+    for (int i = 0; i < MAX_POI_SERVERS; i++) {
+      connectionPtrs[i] = &connections[i];
+    }
+    pois.resize(1);
+    pois[0].host = "192.168.1.1";
+    registry.addStatic("192.168.1.1");
+    patterns.loadPatterns();
+    GestureConfig gestures;
+    gestures.enabled = true;
+    controller.configureGestures(gestures);
+  }
+
+  // Every sample of the trace, loop() every 10 ms as in the firmware
+  void run() {
+    controller.setSensorReady(trace.begin());
+    while (clock.now <= trace.duration()) {
+      pipe.pump();
+      if (clock.now % 10 == 0) {
+        controller.update();
+      }
+      clock.advance(1);
+    }
+  }
+
+  FakeClock clock;
+  TraceImu trace;
+  SamplePipe pipe;
+  FakeLed led;
+  FakeHttpTransport http;
+  PoiRegistry registry;
+  PatternClient patterns;
+  std::vector<SimPoi> pois;
+  std::vector<SimTcpConnection> connections;
+  TcpConnection* connectionPtrs[MAX_POI_SERVERS];
+  PatternDispatcher dispatcher;
+  Controller controller;
+};
+
+static void addSpinAndStall(TraceImu& trace) {
+  trace.addRamp(300, 0, 720, 1);
+  trace.addWobble(3000, 720, 0.1f, 2.0f, 1);
+  trace.addRamp(300, 720, 0, 1);
+  trace.addSegment(3000, 0, 1);
+}
+
+static bool runShow() {
+  GestureRig rig;
+  TraceImu& t = rig.trace;
+  // Per pause, the index in the pattern list it should show
+  t.addSegment(1000, 0, 1);
+  addSpinAndStall(t);                 // 1
+  addSpinAndStall(t);                 // 2
+  addReversal(t, 720, 0);             // previous: back to 1
+  t.addSegment(3000, 0, 1);
+  addSpinAndStall(t);                 // 2
+  addDoubleStall(t, 600, 400, 500);   // first: 0 (the first stop is too short to be a pause)
+  t.addSegment(3000, 0, 1);
+  addShake(t, 4, 300, 100);           // hold: the pause after the shake keeps 0
+  t.addSegment(3000, 0, 1);
+  addSpinAndStall(t);                 // 1
+  addSpinAndStall(t);                 // 2
+  const int expected[] = {1, 2, 1, 2, 0, 0, 1, 2};
+  rig.run();
+
+  std::vector<int> sent;
+  for (const SimPoi::Switch& s : rig.pois[0].switches) {
+    sent.push_back(s.pattern);
+  }
+  printf("Show with %d patterns, gestures on: sent", rig.patterns.count());
+  for (int p : sent) printf(" %d", p);
+  printf("\n");
+  for (int g = GESTURE_NONE + 1; g < GESTURES; g++) {
+    printf("  %-12s %u\n", GestureEngine::name((Gesture)g), (unsigned)rig.controller.gestures.recognized((Gesture)g));
+  }
+
+  bool ok = sent.size() == sizeof(expected) / sizeof(expected[0]);
+  for (size_t i = 0; ok && i < sent.size(); i++) {
+    rig.patterns.select(expected[i]);
+    ok &= sent[i] == rig.patterns.currentPattern();
+  }
+  for (int g = GESTURE_NONE + 1; g < GESTURES; g++) {
+    ok &= rig.controller.gestures.recognized((Gesture)g) == 1;
+  }
+  return ok;
+}
+
+int runGestureDemo() {
+  bool ok = true;
+  double ns = 0;
+  size_t samples = 0;
+  printf("%-24s %-12s %s\n", "clip", "expected", "recognized per variant");
+  for (const Clip& clip : clips) {
+    printf("%-24s %-12s", clip.name, GestureEngine::name(clip.expected));
+    for (int v = 0; v < clip.variants; v++) {
+      Gesture seen;
+      int count = recognize(clip, v, seen, ns, samples);
+      printf(" %s", count == 0 ? "-" : GestureEngine::name(seen));
+      if (count > 1) printf("x%d", count);
+      ok &= clip.expected == GESTURE_NONE ? count == 0 : count == 1 && seen == clip.expected;
+    }
+    printf("\n");
+  }
+  printf("%.1f ns per sample\n\n", ns / samples);
+  ok &= runShow();
+  return ok ? 0 : 1;
+}
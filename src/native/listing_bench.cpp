@@ -0,0 +1,172 @@
+// Pattern listing benchmark: peak heap and parse time of the /list?dir=/
+// response, buffered into a string and deserialized into an 8 KB
+// DynamicJsonDocument (how loadPatterns() used to work) vs. streamed
+// through PatternListParser.
+//
+// Every operator new in the program is counted while this command runs,
+// and the JSON document allocates through the same counter.
+
+#include <ArduinoJson.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "commands.h"
+#include "pattern_client.h"
+
+#define LISTING_CHUNK_BYTES 1436  // one TCP segment at a time, like the WiFiClient
+
+// ============================================================================
+// Heap accounting
+// ============================================================================
+
+// Each block carries its size in front so delete can account for it
+static const size_t BLOCK_HEADER = alignof(std::max_align_t);
+static std::atomic<size_t> heapInUse(0);
+static std::atomic<size_t> heapPeak(0);
+
+static void* countedAlloc(size_t size) {
+  char* block = (char*)malloc(size + BLOCK_HEADER);
+  if (!block) throw std::bad_alloc();
+  *(size_t*)block = size;
+  size_t inUse = heapInUse += size;
+  if (inUse > heapPeak) heapPeak = inUse;
+  return block + BLOCK_HEADER;
+}
+
+static void countedFree(void* p) {
+  if (!p) return;
+  char* block = (char*)p - BLOCK_HEADER;
+  heapInUse -= *(size_t*)block;
+  free(block);
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+// ArduinoJson allocator on top of the counted heap
+struct CountedAllocator {
+  void* allocate(size_t size) { return countedAlloc(size); }
+  void deallocate(void* p) { countedFree(p); }
+  void* reallocate(void* p, size_t size) {
+    void* moved = countedAlloc(size);
+    if (p) {
+      size_t old = *(size_t*)((char*)p - BLOCK_HEADER);
+      memcpy(moved, p, old < size ? old : size);
+      countedFree(p);
+    }
+    return moved;
+  }
+};
+
+// ============================================================================
+// Listings
+// ============================================================================
+
+// A poi directory with the given number of files: single character pattern
+// images first, then the kind of long names a poi accumulates
+static std::string makeListing(int entries) {
+  static const char* chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  std::string listing = "[";
+  char entry[128];
+  for (int i = 0; i < entries; i++) {
+    if (i < MAX_PATTERNS) {
+      snprintf(entry, sizeof(entry), "%s{\"type\":\"file\",\"name\":\"%c.bin\",\"size\":%d}",
+               i ? "," : "", chars[i], 7200 + i);
+    } else {
+      snprintf(entry, sizeof(entry), "%s{\"type\":\"file\",\"name\":\"upload_%05d.bin\",\"size\":%d}",
+               i ? "," : "", i, 7200 + i);
+    }
+    listing += entry;
+  }
+  listing += "]";
+  return listing;
+}
+
+struct ParseResult {
+  int patterns = 0;
+  bool ok = false;
+  size_t peakHeap = 0;
+  double microseconds = 0;
+};
+
+// What loadPatterns() did before: whole body in a string, then an 8 KB document
+static void parseBuffered(const std::string& listing, ParseResult& result) {
+  std::string body;
+  for (size_t i = 0; i < listing.size(); i += LISTING_CHUNK_BYTES) {
+    body.append(listing, i, LISTING_CHUNK_BYTES);
+  }
+  BasicJsonDocument<CountedAllocator> doc(8192);
+  DeserializationError error = deserializeJson(doc, body);
+  result.ok = !error;
+  result.patterns = 0;
+  if (error) return;
+  for (JsonObject obj : doc.as<JsonArray>()) {
+    const char* name = obj["name"];
+    int patternNumber = patternNumberForFile(name);
+    if (patternNumber >= MIN_PATTERN_NUMBER && patternNumber <= MAX_PATTERN_NUMBER
+        && result.patterns < MAX_PATTERNS) {
+      result.patterns++;
+    }
+  }
+}
+
+static void parseStreaming(const std::string& listing, ParseResult& result) {
+  PatternListParser parser;
+  for (size_t i = 0; i < listing.size(); i += LISTING_CHUNK_BYTES) {
+    size_t len = listing.size() - i < LISTING_CHUNK_BYTES ? listing.size() - i : LISTING_CHUNK_BYTES;
+    parser.write(listing.data() + i, len);
+  }
+  result.ok = parser.complete();
+  result.patterns = parser.count();
+}
+
+static ParseResult measure(void (*parse)(const std::string&, ParseResult&), const std::string& listing) {
+  ParseResult result;
+  size_t baseline = heapInUse;
+  heapPeak = baseline;
+  parse(listing, result);
+  result.peakHeap = heapPeak - baseline;
+
+  int iterations = 2000000 / (int)listing.size() + 5;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    ParseResult scratch;
+    parse(listing, scratch);
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  result.microseconds = elapsed / 1000.0 / iterations;
+  return result;
+}
+
+int runListingBench() {
+  printf("%7s %8s   %-32s   %-32s\n", "entries", "bytes", "buffered + 8 KB JsonDocument", "streaming PatternListParser");
+  printf("%7s %8s   %10s %10s %10s   %10s %10s %10s\n", "", "",
+         "peak heap", "time us", "patterns", "peak heap", "time us", "patterns");
+
+  const int sizes[] = {50, 500, 5000};
+  bool ok = true;
+  for (int entries : sizes) {
+    std::string listing = makeListing(entries);
+    ParseResult buffered = measure(parseBuffered, listing);
+    ParseResult streaming = measure(parseStreaming, listing);
+    printf("%7d %8u   %10u %10.1f %10s   %10u %10.1f %10d\n", entries, (unsigned)listing.size(),
+           (unsigned)buffered.peakHeap, buffered.microseconds,
+           buffered.ok ? std::to_string(buffered.patterns).c_str() : "failed",
+           (unsigned)streaming.peakHeap, streaming.microseconds, streaming.patterns);
+
+    int expected = entries < MAX_PATTERNS ? entries : MAX_PATTERNS;
+    ok &= streaming.ok && streaming.patterns == expected;
+  }
+  return ok ? 0 : 1;
+}
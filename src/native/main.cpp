@@ -0,0 +1,376 @@
+// Host build of the controller (pio run -e native). Runs the stall
+// detection and pattern dispatch code against the fakes in fakes.h:
+//
+//   .pio/build/native/program              synthesized spin/stall session
+//   .pio/build/native/program trace.csv    replay a recorded gyro trace
+//   .pio/build/native/program --fifo ...   same, sampled through Mpu6050Fifo
+//                                          and a simulated register map
+//   .pio/build/native/program --offline    same, with the second poi unreachable
+//   .pio/build/native/program --close      same, with poi that close after each response
+//   .pio/build/native/program --cached     same, booting from the pattern cache with
+//                                          both poi unreachable for the listing
+//   .pio/build/native/program --upload     same, with the poi's images changed mid-session
+//   .pio/build/native/program --telemetry  same, streaming telemetry to a client on a slow link
+//   .pio/build/native/program --log        same, printing the session log read back from flash
+//   .pio/build/native/program bench        time the per-sample hot path
+//   .pio/build/native/program listing      pattern listing parse: peak heap and time
+//   .pio/build/native/program log          session log ring: rotation, torn writes, range reads
+//   .pio/build/native/program config       config load time, damaged files, older layouts
+//   .pio/build/native/program wifi         WiFi reconnects, fallback and backoff on simulated access points
+//   .pio/build/native/program boot         start-up stages serially vs. through the boot scheduler
+//   .pio/build/native/program power [trace.csv ...]
+//                                          time at each power level and battery life over a gig
+//   .pio/build/native/program gestures     gesture recognition on clips, and their actions in a show
+//   .pio/build/native/program revs         revolution count and RPM against spins of known speed
+//   .pio/build/native/program discover [N] find N stand-in poi on loopback and switch them all
+//   .pio/build/native/program multicast [N] [loss%]
+//                                          switch N stand-ins by lossy multicast, one over HTTP
+//   .pio/build/native/program sync [N] [delay ms]
+//                                          clock offsets of N stand-ins and how closely they switch
+//   .pio/build/native/program eval [trace.csv ...]
+//                                          stall detector latency vs. false positives,
+//                                          fixed vs. calibrated thresholds per performer
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include <thread>
+
+#include "commands.h"
+#include "controller.h"
+#include "fakes.h"
+#include "sample_pipe.h"
+
+static const char* serverIPs[2] = {"192.168.1.1", "192.168.1.78"};
+static const uint32_t LOOP_DELAY_MS = 10;  // matches delay(10) in loop()
+static const uint32_t SENSOR_TASK_PERIOD_MS = 5;  // matches sensorTask()
+static const uint32_t REFRESH_POLL_MS = 1000;  // matches patternRefreshTask()
+static const uint32_t REFRESH_INTERVAL_MS = 5000;  // shortened to fit a session
+static const uint32_t TELEMETRY_LINK_BYTES_PER_S = 600;  // congested: less than the stream needs
+static const size_t TELEMETRY_QUEUE_FRAMES = 4;
+
+// Everything main.cpp wires together on the ESP32, with fakes underneath
+struct Rig {
+  explicit Rig(bool fifoMode)
+    : trace(clock),
+      simMpu(clock, trace),
+      fifo(simMpu, clock, 1000),
+      pipe(fifoMode ? (ImuSource&)fifo : (ImuSource&)trace),
+      http(clock),
+      patterns(http, registry, &flash),
+      connections(MAX_POI_SERVERS, SimTcpConnection(clock, pois)),
+      dispatcher(clock, connectionPtrs, registry),
+      controller(pipe, clock, led, patterns, dispatcher, ControllerConfig{0, false, StallDetectorConfig()}),
+      refresher(patterns, clock, REFRESH_INTERVAL_MS),
+      telemetryClient(clock, TELEMETRY_LINK_BYTES_PER_S, TELEMETRY_QUEUE_FRAMES),
+      telemetry(telemetryClient, (fifoMode ? 1000 : 1000 / SENSOR_TASK_PERIOD_MS) / TELEMETRY_RATE_HZ),
+      sessionLog(flash, clock),
+      sensor(fifoMode ? (ImuSource&)fifo : (ImuSource&)trace),
+      revolutionEvents(0) {
+    for (int i = 0; i < MAX_POI_SERVERS; i++) {
+      connectionPtrs[i] = &connections[i];
+    }
+    registry.addStatic(serverIPs[0]);
+    registry.addStatic(serverIPs[1]);
+    pois.resize(2);
+    pois[0].host = serverIPs[0];
+    pois[1].host = serverIPs[1];
+    pois[1].connectMs = 25;  // the far side of the stage
+    controller.setRefresher(&refresher);
+    controller.onRevolution(revolutionCounted, this);
+  }
+
+  bool begin() {
+    patterns.loadCached();
+    patterns.loadPatterns();
+    bool ready = sensor.begin();
+    controller.setSensorReady(ready);
+    return ready;
+  }
+
+  // Interleave the sensor task, loop() and the refresh task at their
+  // firmware periods
+  void runUntil(uint32_t end) {
+    while (clock.now <= end) {
+      pipe.pump();
+      if (clock.now % LOOP_DELAY_MS == 0) {
+        controller.update();
+      }
+      if (clock.now % REFRESH_POLL_MS == 0) {
+        refresher.poll();
+        sessionLog.flush();  // the writer task shares this period on the ESP32
+      }
+      clock.advance(SENSOR_TASK_PERIOD_MS);
+    }
+  }
+
+  FakeClock clock;
+  TraceImu trace;
+  SimMpu6050 simMpu;
+  Mpu6050Fifo fifo;
+  SamplePipe pipe;
+  FakeLed led;
+  FakeHttpTransport http;
+  MemoryFileStore flash;
+  PoiRegistry registry;
+  PatternClient patterns;
+  std::vector<SimPoi> pois;
+  std::vector<SimTcpConnection> connections;
+  TcpConnection* connectionPtrs[MAX_POI_SERVERS];
+  PatternDispatcher dispatcher;
+  Controller controller;
+  PatternRefresher refresher;
+  SimTelemetryClient telemetryClient;
+  TelemetryStream telemetry;
+  SessionLog sessionLog;
+  ImuSource& sensor;
+  uint32_t revolutionEvents;
+
+  static void revolutionCounted(void* context, uint32_t now, uint32_t periodMs, int8_t direction) {
+    (void)now;
+    (void)periodMs;
+    (void)direction;
+    ((Rig*)context)->revolutionEvents++;
+  }
+};
+
+static void printHistogram(const char* name, const LatencyHistogram& h) {
+  printf("  %-28s n=%-3u min=%-5u p50<=%-5u p90<=%-5u max=%u ms\n", name, (unsigned)h.count(),
+         (unsigned)h.min(), (unsigned)h.percentile(50), (unsigned)h.percentile(90), (unsigned)h.max());
+}
+
+static void printLatency(const LatencyTracker& latency, const PatternDispatcher& dispatcher) {
+  printf("Latency:\n");
+  printHistogram("stop -> confirm", latency.stopToConfirm);
+  printHistogram("confirm -> request", latency.confirmToRequest);
+  for (int i = 0; i < latency.servers(); i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "request -> %s", dispatcher.server(i));
+    printHistogram(name, latency.requestToResponse[i]);
+    snprintf(name, sizeof(name), "stop -> %s", dispatcher.server(i));
+    printHistogram(name, latency.stopToResponse[i]);
+  }
+  printf("  failures: %u\n", (unsigned)latency.failureCount());
+}
+
+static void synthesizeSession(TraceImu& imu) {
+  imu.addSegment(3000, 0);     // on the table
+  imu.addSegment(4000, 720);   // spinning at 2 rev/s
+  imu.addSegment(3000, 20);    // stall
+  imu.addSegment(5000, -540);  // reverse spin
+  imu.addSegment(3000, 0);     // stall
+}
+
+static int runSession(const char* tracePath, bool fifoMode, bool offline, bool noKeepAlive,
+                      bool cachedBoot, bool upload, bool telemetry, bool log) {
+  Rig rig(fifoMode);
+  if (telemetry) {
+    rig.controller.setTelemetry(&rig.telemetry);
+  }
+  if (log) {
+    rig.sessionLog.begin();
+    rig.controller.setSessionLog(&rig.sessionLog);
+  }
+
+  if (tracePath) {
+    if (!rig.trace.loadCsv(tracePath)) {
+      fprintf(stderr, "Failed to read trace %s\n", tracePath);
+      return 1;
+    }
+  } else {
+    synthesizeSession(rig.trace);
+  }
+  if (offline) {
+    rig.pois[1].online = false;
+  }
+  for (SimPoi& poi : rig.pois) {
+    poi.keepAlive = !noKeepAlive;
+  }
+  if (cachedBoot) {
+    // A previous boot saved the pattern table, now the listing is unreachable
+    PatternClient previousBoot(rig.http, rig.registry, &rig.flash);
+    previousBoot.loadPatterns();
+    rig.http.offlineHosts.assign(serverIPs, serverIPs + 2);
+  }
+
+  rig.begin();
+  if (upload) {
+    // Mid-show: b.bin deleted, D.bin uploaded
+    rig.runUntil(rig.trace.duration() / 2);
+    rig.http.listing = "[{\"type\":\"file\",\"name\":\"a.bin\"},{\"type\":\"file\",\"name\":\"C.bin\"},"
+                       "{\"type\":\"file\",\"name\":\"D.bin\"},{\"type\":\"file\",\"name\":\"index.htm\"}]";
+  }
+  rig.runUntil(rig.trace.duration());
+
+  printf("\n%u ms simulated, %u samples, %u overruns, %d LED transitions\n",
+         (unsigned)rig.trace.duration(), (unsigned)rig.controller.samplesProcessed,
+         (unsigned)rig.pipe.overrunCount(), rig.led.transitions);
+  printf("Patterns: %d loaded, listing hash %08x, %d cache writes\n", rig.patterns.count(),
+         (unsigned)rig.patterns.listingHash(), rig.flash.writes);
+  printf("Refresh: %u listings fetched, %u changes applied, %u deferred for dispatch\n",
+         (unsigned)rig.patterns.refreshCount(), (unsigned)rig.patterns.changeCount(),
+         (unsigned)rig.refresher.deferredCount());
+  printf("Revolutions: %u counted, %u events\n", (unsigned)rig.controller.revolutions.revolutions(),
+         (unsigned)rig.revolutionEvents);
+  printf("Connections: %u opened, %u requests on a warm connection\n",
+         (unsigned)rig.dispatcher.connectionPool().connectCount(),
+         (unsigned)rig.dispatcher.connectionPool().reuseCount());
+  if (fifoMode) {
+    printf("FIFO: %u I2C transactions, %u bytes read, %u overflows\n",
+           (unsigned)rig.simMpu.transactions, (unsigned)rig.simMpu.bytesRead,
+           (unsigned)rig.fifo.overflowCount());
+  }
+  if (telemetry) {
+    const SimTelemetryClient& client = rig.telemetryClient;
+    printf("Telemetry: %u frames built, %u dropped at the sender; client got %d frames (%d points, "
+           "%u bytes), %d missing by seq, %d malformed; %d points rotating, %d stalled\n",
+           (unsigned)rig.telemetry.frameCount(), (unsigned)rig.telemetry.droppedCount(),
+           client.framesDelivered, client.pointsDelivered, (unsigned)client.bytesDelivered,
+           client.seqGaps, client.malformed, client.rotatingPoints, client.stillPoints);
+  }
+  if (log) {
+    rig.sessionLog.flush(true);
+    printf("Session log: %u records in %u appends, %u dropped\n", (unsigned)rig.sessionLog.recordCount(),
+           (unsigned)rig.sessionLog.appendCount(), (unsigned)rig.sessionLog.droppedCount());
+    SessionLogReader reader(rig.flash, rig.sessionLog.session(), 0, UINT32_MAX);
+    LogRecord record;
+    char line[80];
+    while (reader.next(record)) {
+      formatLogRecordCsv(line, sizeof(line), record);
+      printf("  %s", line);
+    }
+  }
+  printLatency(rig.controller.latency, rig.dispatcher);
+  for (const SimPoi& poi : rig.pois) {
+    printf("Poi %s:\n", poi.host.c_str());
+    for (const SimPoi::Switch& sw : poi.switches) {
+      printf("  %7u ms  pattern %d\n", (unsigned)sw.time, sw.pattern);
+    }
+  }
+  return 0;
+}
+
+static int runBench() {
+  Rig rig(false);
+
+  for (int i = 0; i < 100; i++) {
+    rig.trace.addSegment(4000, 720, 1);
+    rig.trace.addSegment(3000, 0, 1);
+  }
+  rig.controller.setSensorReady(rig.sensor.begin());
+
+  auto start = std::chrono::steady_clock::now();
+  uint32_t iterations = 0;
+  while (rig.clock.now <= rig.trace.duration()) {
+    rig.pipe.pump();
+    rig.controller.update();
+    rig.clock.advance(1);
+    iterations++;
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+
+  printf("%u updates, %.1f ns/update\n", (unsigned)iterations, (double)elapsed / iterations);
+
+  // Sample ring throughput with a real producer thread, as with sensorTask()
+  static SpscRing<ImuSample, SAMPLE_PIPE_CAPACITY> ring;
+  const uint32_t total = 2000000;
+  uint32_t consumed = 0;
+  bool ordered = true;
+  start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < total; i++) {
+      while (!ring.push(ImuSample{i, 0, 0, 0})) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  ImuSample batch[IMU_BATCH_SIZE];
+  while (consumed < total) {
+    size_t n = ring.pop(batch, IMU_BATCH_SIZE);
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+    for (size_t i = 0; i < n; i++) {
+      ordered &= batch[i].timestamp == consumed++;
+    }
+  }
+  producer.join();
+  elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  printf("%u samples through the ring, %.1f ns/sample, %s, %u full-ring retries\n",
+         (unsigned)total, (double)elapsed / total, ordered ? "in order" : "OUT OF ORDER",
+         (unsigned)ring.overrunCount());
+  return ordered ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    return runBench();
+  }
+  if (argc > 1 && strcmp(argv[1], "listing") == 0) {
+    return runListingBench();
+  }
+  if (argc > 1 && strcmp(argv[1], "log") == 0) {
+    return runSessionLogDemo();
+  }
+  if (argc > 1 && strcmp(argv[1], "config") == 0) {
+    return runConfigBench();
+  }
+  if (argc > 1 && strcmp(argv[1], "wifi") == 0) {
+    return runWifiDemo();
+  }
+  if (argc > 1 && strcmp(argv[1], "boot") == 0) {
+    return runBootDemo();
+  }
+  if (argc > 1 && strcmp(argv[1], "gestures") == 0) {
+    return runGestureDemo();
+  }
+  if (argc > 1 && strcmp(argv[1], "revs") == 0) {
+    return runRevolutionDemo();
+  }
+  if (argc > 1 && strcmp(argv[1], "power") == 0) {
+    return runPowerModel(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "discover") == 0) {
+    return runDiscoveryDemo(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "multicast") == 0) {
+    return runMulticastDemo(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "sync") == 0) {
+    return runSyncDemo(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "eval") == 0) {
+    return runDetectorEval(argc - 2, argv + 2);
+  }
+  bool fifoMode = false;
+  bool offline = false;
+  bool noKeepAlive = false;
+  bool cachedBoot = false;
+  bool upload = false;
+  bool telemetry = false;
+  bool log = false;
+  const char* tracePath = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--fifo") == 0) {
+      fifoMode = true;
+    } else if (strcmp(argv[i], "--offline") == 0) {
+      offline = true;
+    } else if (strcmp(argv[i], "--close") == 0) {
+      noKeepAlive = true;
+    } else if (strcmp(argv[i], "--cached") == 0) {
+      cachedBoot = true;
+    } else if (strcmp(argv[i], "--upload") == 0) {
+      upload = true;
+    } else if (strcmp(argv[i], "--telemetry") == 0) {
+      telemetry = true;
+    } else if (strcmp(argv[i], "--log") == 0) {
+      log = true;
+    } else {
+      tracePath = argv[i];
+    }
+  }
+  return runSession(tracePath, fifoMode, offline, noKeepAlive, cachedBoot, upload, telemetry, log);
+}
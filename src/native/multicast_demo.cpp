@@ -0,0 +1,97 @@
+// Multicast pattern switching against real UDP sockets: stand-in poi on
+// 127.0.0.2, 127.0.0.3, ... advertise POI_FEATURE_UDP_SWITCH in their
+// discovery replies and receive every switch as one multicast datagram
+// (plus repeats), through a lossy channel. The last stand-in is an older
+// poi without the feature and still gets its switches over HTTP.
+
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "commands.h"
+#include "fakes.h"
+
+#define DEMO_ROUNDS 30
+
+// Time the HTTP path took per poi, by registry index
+static uint32_t httpElapsed[MAX_POI_SERVERS];
+
+static void dispatchComplete(void* /*context*/, int server, int /*patternNumber*/,
+                             int httpStatus, uint32_t elapsedMs) {
+  if (httpStatus == 200) {
+    httpElapsed[server] += elapsedMs;
+  }
+}
+
+int runMulticastDemo(int argc, char** argv) {
+  int poiCount = argc > 0 ? atoi(argv[0]) : 4;
+  int lossPercent = argc > 1 ? atoi(argv[1]) : 20;
+  if (poiCount < 2 || poiCount > MAX_POI_SERVERS || lossPercent < 0 || lossPercent > 100) {
+    fprintf(stderr, "Between 2 and %d poi, loss 0-100%%\n", MAX_POI_SERVERS);
+    return 1;
+  }
+
+  PoiNetworkRig rig;
+  std::vector<std::unique_ptr<SwitchReceiver>> receivers;
+  for (int i = 0; i < poiCount; i++) {
+    bool legacy = i == poiCount - 1;
+    rig.addPoi(legacy ? 0 : POI_FEATURE_UDP_SWITCH);
+    if (!legacy) {
+      receivers.emplace_back(new SwitchReceiver(lossPercent, i + 1));
+    }
+  }
+  rig.enableMulticast();
+  rig.dispatcher.onComplete(dispatchComplete, NULL);
+  for (auto& receiver : receivers) {
+    if (!receiver->start()) {
+      fprintf(stderr, "Failed to join %s:%d on loopback\n", SWITCH_MULTICAST_GROUP, SWITCH_PORT);
+      return 1;
+    }
+  }
+  if (!rig.begin()) {
+    return 1;
+  }
+
+  rig.run(3 * NETWORK_RIG_PROBE_INTERVAL_MS);
+  printf("Registry: %d poi, %d take multicast switches\n\n", rig.registry.count(),
+         (int)receivers.size());
+
+  int lastPattern = 0;
+  for (int round = 0; round < DEMO_ROUNDS; round++) {
+    lastPattern = 10 + round;
+    rig.dispatcher.dispatch(lastPattern);
+    // Long enough for every repeat and the HTTP round trip
+    rig.run((SWITCH_REPEATS + 2) * SWITCH_REPEAT_INTERVAL_MS);
+  }
+
+  printf("\n%d switches, %u datagrams sent, %d%% loss per datagram\n", DEMO_ROUNDS,
+         (unsigned)rig.switcher->datagramCount(), lossPercent);
+  printf("%-12s %-9s %8s %6s %10s %12s\n", "poi", "path", "applied", "lost", "duplicates", "latency ms");
+  bool ok = rig.registry.count() == poiCount;
+  for (int i = 0; i < poiCount; i++) {
+    const SimPoi& poi = rig.pois[i];
+    if (i < (int)receivers.size()) {
+      SwitchReceiver& receiver = *receivers[i];
+      std::vector<SwitchReceiver::Applied> applied = receiver.applied();
+      uint32_t total = 0;
+      for (const SwitchReceiver::Applied& a : applied) {
+        total += a.appliedAt - a.sentAt;
+      }
+      printf("%-12s %-9s %5d/%-2d %6d %10d %12.2f\n", poi.host.c_str(), "multicast",
+             (int)applied.size(), DEMO_ROUNDS, receiver.lost.load(), receiver.duplicates.load(),
+             applied.empty() ? 0.0 : (double)total / applied.size());
+      // With repeats a switch is only missed if every copy is lost, and a
+      // lost first copy costs SWITCH_REPEAT_INTERVAL_MS
+      ok &= !applied.empty() && (int)applied.size() >= DEMO_ROUNDS - 1;
+    } else {
+      // Registry indexes follow discovery order
+      int server = rig.registry.find(poi.host.c_str(), 80);
+      printf("%-12s %-9s %5d/%-2d %6s %10s %12.2f\n", poi.host.c_str(), "http",
+             (int)poi.switches.size(), DEMO_ROUNDS, "-", "-",
+             poi.switches.empty() ? 0.0 : (double)httpElapsed[server] / poi.switches.size());
+      ok &= !poi.switches.empty() && poi.switches.back().pattern == lastPattern;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// Energy model: how long a gig keeps the controller at each PowerLevel,
+// and what that does to battery life. Plays a recorded trace (or a
+// synthesized gig of sets and breaks) through Mpu6050Fifo on the
+// simulated sensor, with PowerManager running the sensor and loop task
+// periods, and once more with it disabled as the baseline. Currents are
+// typical datasheet figures, so read the hours as a comparison rather
+// than a promise.
+
+#include <stdio.h>
+
+#include "commands.h"
+#include "controller.h"
+#include "fakes.h"
+#include "power_manager.h"
+#include "sample_pipe.h"
+
+// Typical supply current at each level, mA
+#define MODEL_CPU_ACTIVE_MA 28.0   // ESP32-C3 at 160 MHz, WiFi in modem sleep
+#define MODEL_CPU_IDLE_MA 18.0     // at 80 MHz
+#define MODEL_CPU_SLEEP_MA 3.0     // automatic light sleep between beacons
+#define MODEL_RADIO_AWAKE_MA 55.0  // on top, with power save off
+#define MODEL_MPU_ON_MA 3.9        // gyro and accelerometer
+#define MODEL_MPU_CYCLE_MA 0.02    // accelerometer only at 5 Hz
+#define MODEL_BATTERY_MAH 1000.0
+
+// Time spent with the radio held awake
+class ModelPowerControl : public PowerControl {
+public:
+  explicit ModelPowerControl(Clock& clock) : clock(clock) {}
+
+  void setLevel(PowerLevel level) override { (void)level; }
+  void setRadioAwake(bool awake) override {
+    uint32_t now = clock.millis();
+    if (radioAwake) awakeMs += now - awakeSince;
+    radioAwake = awake;
+    awakeSince = now;
+  }
+
+  Clock& clock;
+  bool radioAwake = false;
+  uint32_t awakeSince = 0;
+  uint32_t awakeMs = 0;
+};
+
+struct PowerRig {
+  PowerRig(const TraceImu& source, bool enabled)
+    : trace(clock),
+      simMpu(clock, trace),
+      fifo(simMpu, clock, 1000),
+      pipe(fifo),
+      http(clock),
+      patterns(http, registry),
+      connections(MAX_POI_SERVERS, SimTcpConnection(clock, pois)),
+      dispatcher(clock, connectionPtrs, registry),
+      controller(pipe, clock, led, patterns, dispatcher, ControllerConfig{0, false, StallDetectorConfig()}),
+      control(clock),
+      power(fifo, control, clock, config(enabled)) {
+    trace.samples = source.samples;
+    for (int i = 0; i < MAX_POI_SERVERS; i++) {
+      connectionPtrs[i] = &connections[i];
+    }
+    pois.resize(1);
+    pois[0].host = "192.168.1.1";
+    registry.addStatic("192.168.1.1");
+    patterns.loadPatterns();
+    controller.setSensorReady(fifo.begin());
+  }
+
+  static PowerConfig config(bool enabled) {
+    PowerConfig config;
+    config.enabled = enabled;
+    return config;
+  }
+
+  // The sensor task and loop() at the periods PowerManager gives them
+  void run() {
+    uint32_t end = trace.duration();
+    uint32_t sensorAt = 0;
+    uint32_t loopAt = 0;
+    bool rotating = false;
+    while (clock.now <= end) {
+      if (clock.now == sensorAt) {
+        uint32_t wait = power.sensorPoll();
+        if (power.sampling()) {
+          pipe.pump();
+        }
+        sensorAt += wait;
+      }
+      if (clock.now == loopAt) {
+        controller.update();
+        power.update(controller.detector.lastMovementTime(), dispatcher.busy());
+        loopAt += power.loopDelayMs();
+        if (controller.detector.isRotating() && !rotating) {
+          spinStarts.push_back(clock.now);
+        }
+        rotating = controller.detector.isRotating();
+      }
+      clock.now = sensorAt < loopAt ? sensorAt : loopAt;
+    }
+    control.setRadioAwake(false);
+  }
+
+  double averageMa() const {
+    double total = power.timeAt(POWER_ACTIVE) + power.timeAt(POWER_IDLE) + power.timeAt(POWER_SLEEP);
+    double charge = power.timeAt(POWER_ACTIVE) * (MODEL_CPU_ACTIVE_MA + MODEL_MPU_ON_MA)
+                  + power.timeAt(POWER_IDLE) * (MODEL_CPU_IDLE_MA + MODEL_MPU_ON_MA)
+                  + power.timeAt(POWER_SLEEP) * (MODEL_CPU_SLEEP_MA + MODEL_MPU_CYCLE_MA)
+                  + control.awakeMs * MODEL_RADIO_AWAKE_MA;
+    return charge / total;
+  }
+
+  FakeClock clock;
+  TraceImu trace;
+  SimMpu6050 simMpu;
+  Mpu6050Fifo fifo;
+  SamplePipe pipe;
+  FakeLed led;
+  FakeHttpTransport http;
+  PoiRegistry registry;
+  PatternClient patterns;
+  std::vector<SimPoi> pois;
+  std::vector<SimTcpConnection> connections;
+  TcpConnection* connectionPtrs[MAX_POI_SERVERS];
+  PatternDispatcher dispatcher;
+  Controller controller;
+  ModelPowerControl control;
+  PowerManager power;
+  std::vector<uint32_t> spinStarts;
+};
+
+// Three sets with stalls between spins, breaks on the table around them
+static void synthesizeGig(TraceImu& trace) {
+  trace.addSegment(5 * 60000, 0);  // set up, controller on the table
+  for (int set = 0; set < 3; set++) {
+    trace.addRamp(3000, 0, 720);   // picked up
+    for (int spin = 0; spin < 16; spin++) {
+      trace.addWobble(20000 + 2000 * (spin % 5), spin % 2 ? -540 : 720, 0.1f, 1.5f);
+      trace.addSegment(2500, 10);  // stall for the pattern change
+    }
+    trace.addSegment(15 * 60000, 0);  // break
+  }
+}
+
+static int model(const char* name, const TraceImu& trace) {
+  PowerRig managed(trace, true);
+  managed.run();
+  PowerRig baseline(trace, false);
+  baseline.run();
+
+  uint32_t total = trace.duration();
+  printf("%s: %.1f min\n", name, total / 60000.0);
+  for (int level = 0; level < POWER_LEVELS; level++) {
+    uint32_t ms = managed.power.timeAt((PowerLevel)level);
+    printf("  %-7s %7.1f s  %5.1f%%\n", PowerManager::levelName((PowerLevel)level), ms / 1000.0,
+           100.0 * ms / total);
+  }
+  printf("  radio held awake %.1f s for %d pattern changes, %u wakes from sleep\n",
+         managed.control.awakeMs / 1000.0, (int)managed.pois[0].switches.size(),
+         (unsigned)managed.power.wakeCount());
+  printf("  sensor I2C transactions %u (always active: %u)\n", (unsigned)managed.simMpu.transactions,
+         (unsigned)baseline.simMpu.transactions);
+
+  double managedMa = managed.averageMa();
+  double baselineMa = baseline.averageMa();
+  printf("  average %.1f mA, %.1f h on %.0f mAh (always active: %.1f mA, %.1f h)\n", managedMa,
+         MODEL_BATTERY_MAH / managedMa, MODEL_BATTERY_MAH, baselineMa, MODEL_BATTERY_MAH / baselineMa);
+
+  // Every spin must still be seen, and not much later than at full rate
+  bool ok = managed.spinStarts.size() == baseline.spinStarts.size()
+         && managed.pois[0].switches.size() == baseline.pois[0].switches.size();
+  uint32_t worst = 0;
+  for (size_t i = 0; ok && i < managed.spinStarts.size(); i++) {
+    uint32_t late = managed.spinStarts[i] - baseline.spinStarts[i];
+    if (late > worst) worst = late;
+  }
+  printf("  %d spins, %d pattern changes (always active: %d, %d), spin start seen up to %u ms later\n",
+         (int)managed.spinStarts.size(), (int)managed.pois[0].switches.size(),
+         (int)baseline.spinStarts.size(), (int)baseline.pois[0].switches.size(), (unsigned)worst);
+  return ok ? 0 : 1;
+}
+
+int runPowerModel(int argc, char** argv) {
+  FakeClock clock;
+  if (argc == 0) {
+    TraceImu trace(clock);
+    synthesizeGig(trace);
+    return model("synthesized gig", trace);
+  }
+  int failures = 0;
+  for (int i = 0; i < argc; i++) {
+    TraceImu trace(clock);
+    if (!trace.loadCsv(argv[i])) {
+      fprintf(stderr, "Failed to read trace %s\n", argv[i]);
+      return 1;
+    }
+    failures += model(argv[i], trace);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Revolution counter check: a performance of spins at known speeds and
+// durations, with reversals and stalls, through RevolutionCounter next to
+// the stall detector as Controller runs them. Reports revolutions and
+// smoothed RPM per spin against what the trace was built with, checks the
+// count revolution for revolution against a floating point integration of
+// the same samples, does the same again with every sample repeated as a
+// sensor at a higher rate would deliver them within one millisecond, and
+// reports the cost per sample.
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "commands.h"
+#include "controller.h"
+#include "fakes.h"
+
+#define REVOLUTION_FAST_REPEAT 8  // 8 kHz: the MPU-6050's fastest gyro rate
+
+struct Spin {
+  float dps;
+  uint32_t ms;
+};
+
+// Spins from a stall, each followed by a stall or straight into the next
+// direction. Ramps are 200 ms either side.
+static const Spin spins[] = {
+  {720, 10000},   // 120 RPM
+  {-540, 8000},   // reversal through zero
+  {900, 6000},
+  {300, 12000},   // slow flow
+  {-1080, 5000},
+};
+static const bool stallAfter[] = {false, true, true, false, true};
+
+static void synthesize(TraceImu& trace) {
+  trace.addSegment(1000, 0, 1);
+  float speed = 0;
+  for (size_t i = 0; i < sizeof(spins) / sizeof(spins[0]); i++) {
+    trace.addRamp(200, speed, spins[i].dps, 1);
+    trace.addWobble(spins[i].ms, spins[i].dps, 0.1f, 2.0f, 1);  // whole wobble periods: mean speed as given
+    speed = spins[i].dps;
+    if (stallAfter[i]) {
+      trace.addRamp(200, speed, 0, 1);
+      trace.addSegment(3000, 0, 1);
+      speed = 0;
+    }
+  }
+  trace.addRamp(200, speed, 0, 1);
+  trace.addSegment(3000, 0, 1);
+}
+
+// End of each spin's steady part, where its counts are taken
+static std::vector<uint32_t> spinEnds() {
+  std::vector<uint32_t> ends;
+  uint32_t t = 1000;
+  for (size_t i = 0; i < sizeof(spins) / sizeof(spins[0]); i++) {
+    t += 200 + spins[i].ms;
+    ends.push_back(t);
+    if (stallAfter[i]) t += 200 + 3000;
+  }
+  return ends;
+}
+
+// Revolutions per spin by integrating the samples in degrees, with the
+// counter's gate and idle reset: what the integer counter should match
+static std::vector<uint32_t> referenceCounts(const TraceImu& trace) {
+  std::vector<uint32_t> ends = spinEnds();
+  std::vector<uint32_t> counts;
+  double angle = 0;
+  uint32_t count = 0;
+  uint32_t lastTurning = 0;
+  uint32_t last = trace.samples.front().timestamp;
+  for (const ImuSample& s : trace.samples) {
+    double dps = axisRotationSpeed(s, 0) / (double)GYRO_LSB_PER_DPS;
+    if (dps > REVOLUTION_GATE_DPS || dps < -REVOLUTION_GATE_DPS) {
+      angle += dps * (s.timestamp - last) / 1000.0;
+      lastTurning = s.timestamp;
+      if (angle >= 360) {
+        angle -= 360;
+        count++;
+      } else if (angle <= -360) {
+        angle += 360;
+        count++;
+      }
+    } else if (s.timestamp - lastTurning > REVOLUTION_IDLE_MS) {
+      angle = 0;
+    }
+    last = s.timestamp;
+    if (counts.size() < ends.size() && s.timestamp == ends[counts.size()]) {
+      counts.push_back(count);
+    }
+  }
+  for (size_t i = counts.size() - 1; i > 0; i--) {
+    counts[i] -= counts[i - 1];
+  }
+  return counts;
+}
+
+struct SpinResult {
+  uint32_t revolutions;
+  uint16_t smoothedRpmTenths;
+};
+
+struct RevolutionRun {
+  std::vector<uint32_t> at;  // each revolution
+  std::vector<SpinResult> perSpin;
+  uint32_t revolutions = 0;
+  uint32_t spinMs = 0;
+  double nsPerSample = 0;
+
+  static void counted(void* context, uint32_t now, uint32_t periodMs, int8_t direction) {
+    (void)periodMs;
+    (void)direction;
+    ((RevolutionRun*)context)->at.push_back(now);
+  }
+
+  void run(const TraceImu& trace, int repeat) {
+    StallDetector detector;
+    RevolutionCounter counter;
+    counter.onRevolution(counted, this);
+
+    // Per spin: revolutions and smoothed RPM just before its end
+    std::vector<uint32_t> ends = spinEnds();
+    size_t next = 0;
+    uint32_t countAtStart = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const ImuSample& s : trace.samples) {
+      int32_t speed = axisRotationSpeed(s, 0);
+      for (int r = 0; r < repeat; r++) {
+        detector.update(speed, s.timestamp);
+        counter.update(speed, s.timestamp, detector.isRotating());
+      }
+      if (next < ends.size() && s.timestamp == ends[next]) {
+        perSpin.push_back(SpinResult{counter.revolutions() - countAtStart, counter.smoothedRpmTenths()});
+        countAtStart = counter.revolutions();
+        next++;
+      }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    nsPerSample = (double)elapsed / (trace.samples.size() * repeat);
+    revolutions = counter.revolutions();
+    spinMs = counter.spinTimeMs();
+  }
+};
+
+int runRevolutionDemo() {
+  FakeClock clock;
+  TraceImu trace(clock);
+  synthesize(trace);
+
+  RevolutionRun normal;
+  normal.run(trace, 1);
+  RevolutionRun fast;
+  fast.run(trace, REVOLUTION_FAST_REPEAT);
+
+  std::vector<uint32_t> reference = referenceCounts(trace);
+  bool ok = normal.perSpin.size() == sizeof(spins) / sizeof(spins[0]) && reference.size() == normal.perSpin.size();
+  uint32_t designedMs = 0;
+  uint32_t rampMs = 0;
+  printf("%-10s %8s %8s %8s %9s %9s\n", "spin", "revs", "float", "built", "RPM", "built");
+  for (size_t i = 0; ok && i < normal.perSpin.size(); i++) {
+    float built = (spins[i].dps < 0 ? -spins[i].dps : spins[i].dps) * spins[i].ms / 360000.0f;
+    float rpm = (spins[i].dps < 0 ? -spins[i].dps : spins[i].dps) / 6.0f;
+    const SpinResult& r = normal.perSpin[i];
+    printf("%+5.0f deg/s %8u %8u %8.1f %9.1f %9.1f\n", spins[i].dps, (unsigned)r.revolutions,
+           (unsigned)reference[i], built, r.smoothedRpmTenths / 10.0f, rpm);
+    designedMs += spins[i].ms;
+    rampMs += stallAfter[i] ? 400 : 200;
+    // Exactly the revolutions in the samples. Against the design, a spin
+    // may gain or lose one: its ramp in adds up to half a turn, and a
+    // reversal first unwinds what was left of the last turn the other way
+    // (so the -540 deg/s spin counts 11 of its 12)
+    ok &= r.revolutions == reference[i];
+    ok &= reference[i] + 1 >= (uint32_t)built && reference[i] <= (uint32_t)built + 1;
+    float error = r.smoothedRpmTenths / 10.0f - rpm;
+    ok &= (error < 0 ? -error : error) <= rpm * 0.02f;
+    ok &= fast.perSpin[i].revolutions == r.revolutions;
+  }
+  // Rotation is seen during the ramps as well, above the detector's
+  // thresholds, so spin time is the steady spins plus part of the ramps
+  printf("Total %u revolutions, rotating %.1f s: %.1f s of steady spins and %.1f s of ramps\n",
+         (unsigned)normal.revolutions, normal.spinMs / 1000.0, designedMs / 1000.0, rampMs / 1000.0);
+  ok &= normal.spinMs >= designedMs && normal.spinMs <= designedMs + rampMs;
+  printf("At %dx the sample rate: %u revolutions; detector and counter %.1f ns per sample (%.1f ns at 1 kHz)\n",
+         REVOLUTION_FAST_REPEAT, (unsigned)fast.revolutions, fast.nsPerSample, normal.nsPerSample);
+  ok &= fast.revolutions == normal.revolutions && normal.at.size() == normal.revolutions;
+  return ok ? 0 : 1;
+}
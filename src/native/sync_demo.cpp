@@ -0,0 +1,129 @@
+// Clock-synchronized switching against real UDP sockets: stand-in poi on
+// 127.0.0.2, 127.0.0.3, ... each run their own clock, offset from the
+// controller's, and every datagram between them is delayed by a random
+// amount. ClockSync estimates the offsets, then the same switches are sent
+// once on arrival and once scheduled, and the stand-ins report when they
+// actually switched.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "commands.h"
+#include "fakes.h"
+
+#define DEMO_SYNC_INTERVAL_MS 100
+#define DEMO_SYNC_FAST_INTERVAL_MS 25
+#define DEMO_ROUNDS 20
+
+// How far each stand-in's millis() is ahead of the controller's
+static const int32_t DEMO_CLOCK_OFFSETS[MAX_POI_SERVERS] = {
+  1500, -2300, 37, -9, 120000, -4000000, 613, 77777
+};
+
+// Spread between the first and last stand-in to apply each command
+// with a sequence number in (fromSeq, toSeq]
+static void printAlignment(const std::vector<std::unique_ptr<SwitchReceiver>>& receivers,
+                           const char* label, uint16_t fromSeq, uint16_t toSeq, double& maxSpread) {
+  std::map<uint16_t, std::vector<int64_t>> times;
+  for (auto& receiver : receivers) {
+    for (const SwitchReceiver::Applied& a : receiver->applied()) {
+      if ((int16_t)(a.seq - fromSeq) > 0 && (int16_t)(a.seq - toSeq) <= 0) {
+        times[a.seq].push_back(a.appliedAtUs);
+      }
+    }
+  }
+  double total = 0;
+  int complete = 0;
+  maxSpread = 0;
+  for (auto& entry : times) {
+    if (entry.second.size() != receivers.size()) continue;
+    auto range = std::minmax_element(entry.second.begin(), entry.second.end());
+    double spread = (*range.second - *range.first) / 1000.0;
+    total += spread;
+    maxSpread = std::max(maxSpread, spread);
+    complete++;
+  }
+  printf("%-24s %5d/%-2d %12.2f %12.2f\n", label, complete, (int)(toSeq - fromSeq),
+         complete ? total / complete : 0.0, maxSpread);
+}
+
+int runSyncDemo(int argc, char** argv) {
+  int poiCount = argc > 0 ? atoi(argv[0]) : 4;
+  int maxDelayMs = argc > 1 ? atoi(argv[1]) : 20;
+  if (poiCount < 2 || poiCount > MAX_POI_SERVERS || maxDelayMs < 0 || maxDelayMs > 200) {
+    fprintf(stderr, "Between 2 and %d poi, delay 0-200 ms\n", MAX_POI_SERVERS);
+    return 1;
+  }
+
+  PoiNetworkRig rig;
+  std::vector<std::unique_ptr<SwitchReceiver>> receivers;
+  for (int i = 0; i < poiCount; i++) {
+    SwitchReceiver* receiver = new SwitchReceiver(0, i + 1);
+    receiver->address = rig.addPoi(POI_FEATURE_UDP_SWITCH | POI_FEATURE_CLOCK_SYNC);
+    receiver->clockOffset = DEMO_CLOCK_OFFSETS[i];
+    receiver->maxDelayMs = maxDelayMs;
+    receivers.emplace_back(receiver);
+  }
+  rig.enableMulticast();
+  rig.enableClockSync(DEMO_SYNC_INTERVAL_MS, DEMO_SYNC_FAST_INTERVAL_MS);
+  for (auto& receiver : receivers) {
+    if (!receiver->start()) {
+      fprintf(stderr, "Failed to start stand-in on %s\n", receiver->address.c_str());
+      return 1;
+    }
+  }
+  if (!rig.begin()) {
+    return 1;
+  }
+
+  // Discovery, then a full window of sync samples for everyone
+  rig.run(3 * NETWORK_RIG_PROBE_INTERVAL_MS + (CLOCK_SYNC_SAMPLES + 2) * DEMO_SYNC_INTERVAL_MS);
+
+  printf("Clock offsets with up to %d ms random delay each way\n", maxDelayMs);
+  printf("%-12s %10s %10s %7s %11s %8s\n", "poi", "true ms", "estimate", "error", "round trip", "jitter");
+  bool ok = rig.registry.count() == poiCount;
+  for (int i = 0; i < poiCount; i++) {
+    SwitchReceiver& receiver = *receivers[i];
+    int server = rig.registry.find(receiver.address.c_str(), 80);
+    if (server < 0 || !rig.clockSync->synced(server)) {
+      printf("%-12s not synced\n", receiver.address.c_str());
+      ok = false;
+      continue;
+    }
+    printf("%-12s %10d %10d %7d %11u %8u\n", receiver.address.c_str(), (int)receiver.clockOffset,
+           (int)rig.clockSync->offset(server), (int)(rig.clockSync->offset(server) - receiver.clockOffset),
+           (unsigned)rig.clockSync->roundTrip(server), (unsigned)rig.clockSync->jitter(server));
+    ok &= receiver.clockSynced();
+  }
+
+  // Long enough for the last repeat to arrive and a scheduled switch to happen
+  uint32_t lead = maxDelayMs + SWITCH_REPEATS * SWITCH_REPEAT_INTERVAL_MS + 10;
+  uint32_t roundMs = lead + maxDelayMs + 20;
+
+  printf("\n%-24s %8s %12s %12s\n", "switch", "rounds", "mean spread", "max spread");
+  uint16_t start = rig.switcher->sequence();
+  for (int round = 0; round < DEMO_ROUNDS; round++) {
+    rig.dispatcher.dispatch(10 + round);
+    rig.run(roundMs);
+  }
+  double immediateMax;
+  printAlignment(receivers, "on arrival", start, rig.switcher->sequence(), immediateMax);
+
+  rig.switcher->setLeadTime(lead);
+  start = rig.switcher->sequence();
+  for (int round = 0; round < DEMO_ROUNDS; round++) {
+    rig.dispatcher.dispatch(40 + round);
+    rig.run(roundMs);
+  }
+  char label[32];
+  snprintf(label, sizeof(label), "scheduled, %u ms lead", (unsigned)lead);
+  double scheduledMax;
+  printAlignment(receivers, label, start, rig.switcher->sequence(), scheduledMax);
+
+  ok &= scheduledMax < 10.0;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+// WiFi connection manager against simulated access points: a reboot at a
+// known venue, the stage access point dropping out mid-show, falling back
+// to the phone hotspot and moving back once the stage network returns,
+// a full outage with backoff, and new settings applied without blocking.
+// A poi behind the same network shows the dispatcher pausing and sending
+// the pattern asked for during an outage once it is back.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "commands.h"
+#include "fakes.h"
+#include "pattern_dispatcher.h"
+#include "wifi_manager.h"
+
+#define DEMO_TICK_MS 10
+
+struct WifiDemoRig {
+  WifiDemoRig()
+    : wifi(clock),
+      manager(wifi, clock, settings, "PoiHotspot", "spinspin"),
+      connections(MAX_POI_SERVERS, SimTcpConnection(clock, pois)),
+      dispatcher(clock, connectionPtrs, registry) {
+    for (int i = 0; i < MAX_POI_SERVERS; i++) {
+      connectionPtrs[i] = &connections[i];
+    }
+    pois.resize(1);
+    pois[0].host = "192.168.1.1";
+    registry.addStatic("192.168.1.1");
+
+    wifi.aps = {
+      {"Stage", "fire2024", {0x24, 0x0a, 0xc4, 0, 0, 1}, 6, -55, true},
+      {"Stage", "fire2024", {0x24, 0x0a, 0xc4, 0, 0, 2}, 11, -72, true},
+      {"Backstage", "props", {0x24, 0x0a, 0xc4, 0, 0, 3}, 1, -64, true},
+      {"PoiHotspot", "spinspin", {0x3c, 0x22, 0xfb, 0, 0, 4}, 3, -60, true},
+    };
+
+    PoiConfig config;
+    resetConfig(config);
+    settings = config.wifi;
+    strcpy(settings.networks[0].ssid, "Stage");
+    strcpy(settings.networks[0].password, "fire2024");
+    settings.networks[0].enabled = true;
+    strcpy(settings.networks[1].ssid, "Backstage");
+    strcpy(settings.networks[1].password, "props");
+    settings.networks[1].enabled = true;
+    settings.reuseLease = true;
+
+    manager.onChange(changed, this);
+  }
+
+  static void changed(void* context, bool connected) {
+    WifiDemoRig* rig = (WifiDemoRig*)context;
+    rig->pois[0].online = connected;
+    if (connected) {
+      rig->dispatcher.resume();
+    } else {
+      rig->dispatcher.pause();
+      rig->downAt = rig->clock.now;
+    }
+    int network = rig->manager.network();
+    printf("%7.2f s  %s", rig->clock.now / 1000.0, connected ? "up  " : "down");
+    if (connected) {
+      printf("  %s via %s ch %d", network == CONFIG_FALLBACK_NETWORK ? "fallback" : rig->settings.networks[network].ssid,
+             rig->wifi.aps[rig->wifi.joinedAp()].ssid.c_str(), rig->wifi.aps[rig->wifi.joinedAp()].channel);
+      if (rig->downAt) {
+        printf(", %u ms without network", (unsigned)(rig->clock.now - rig->downAt));
+      }
+    }
+    printf("\n");
+  }
+
+  void run(uint32_t ms) {
+    uint32_t end = clock.now + ms;
+    while (clock.now < end) {
+      clock.advance(DEMO_TICK_MS);
+      wifi.step();
+      manager.poll();
+      dispatcher.poll();
+    }
+  }
+
+  void setAp(int ap, bool up) {
+    wifi.aps[ap].up = up;
+    printf("%7.2f s  access point %s ch %d %s\n", clock.now / 1000.0, wifi.aps[ap].ssid.c_str(),
+           wifi.aps[ap].channel, up ? "back" : "gone");
+  }
+
+  FakeClock clock;
+  SimWifi wifi;
+  WiFiSettings settings;
+  WifiManager manager;
+  std::vector<SimPoi> pois;
+  PoiRegistry registry;
+  std::vector<SimTcpConnection> connections;
+  TcpConnection* connectionPtrs[MAX_POI_SERVERS];
+  PatternDispatcher dispatcher;
+  uint32_t downAt = 0;
+};
+
+int runWifiDemo() {
+  WifiDemoRig rig;
+  bool ok = true;
+
+  // Rebooting at a venue the controller has been at before
+  printf("Cold boot, nothing cached:\n");
+  rig.manager.begin();
+  rig.run(5000);
+  printf("\nReboot with the access point and lease cached:\n");
+  {
+    WifiDemoRig second;
+    second.settings.last = rig.settings.last;
+    second.manager.begin();
+    second.run(2000);
+    ok &= second.manager.connected() && second.manager.connectCount() == 1;
+  }
+
+  printf("\nShow:\n");
+  rig.setAp(0, false);
+  rig.run(200);
+  ok &= rig.dispatcher.paused() && !rig.dispatcher.dispatch(20);
+  printf("%7.2f s  pattern 20 asked for while down\n", rig.clock.now / 1000.0);
+  rig.run(10000);
+  // Stage failed twice in a row (the drop, then the quick retry), so
+  // Backstage goes first even though Stage's other access point is up
+  ok &= rig.manager.network() == 1;
+  ok &= !rig.pois[0].switches.empty() && rig.pois[0].switches.back().pattern == 20;
+
+  rig.setAp(1, false);
+  rig.setAp(2, false);
+  rig.run(20000);
+  ok &= rig.manager.network() == CONFIG_FALLBACK_NETWORK;
+
+  rig.setAp(0, true);
+  rig.run(WIFI_PROMOTE_INTERVAL_MS);
+  ok &= rig.manager.network() == 0 && rig.wifi.joinedAp() == 0;
+
+  printf("\nEverything off for 40 s:\n");
+  for (int i = 0; i < 4; i++) rig.wifi.aps[i].up = false;
+  rig.run(40000);
+  uint32_t rounds = rig.manager.failedRoundCount();
+  printf("%7.2f s  %u rounds without a network, %s\n", rig.clock.now / 1000.0, (unsigned)rounds,
+         WifiManager::stateName(rig.manager.currentState()));
+  for (int i = 0; i < 4; i++) rig.wifi.aps[i].up = true;
+  rig.run(40000);
+  ok &= rig.manager.connected();
+
+  printf("\nSettings saved from the web page:\n");
+  rig.settings.networks[1].enabled = false;
+  rig.manager.restart();
+  rig.run(5000);
+  ok &= rig.manager.connected();
+
+  printf("\n%u connects, %u disconnects, %d joins tried, %d scans\n", (unsigned)rig.manager.connectCount(),
+         (unsigned)rig.manager.disconnectCount(), rig.wifi.joins, rig.wifi.scans);
+  return ok ? 0 : 1;
+}
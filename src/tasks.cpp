@@ -1,5 +1,4 @@
 #include <Arduino.h>
-#include <Adafruit_MPU6050.h>
 #include "tasks.h"
 #include <WiFi.h>
 #include <LittleFS.h>
@@ -7,6 +6,20 @@
 #include <ElegantOTA.h>
 #include <DNSServer.h>
 #include <ArduinoJson.h>
+#include "hal_esp32.h"
+#include "sample_pipe.h"
+#include "pattern_client.h"
+#include "pattern_refresher.h"
+#include "pattern_dispatcher.h"
+#include "poi_discovery.h"
+#include "clock_sync.h"
+#include "controller.h"
+#include "wifi_manager.h"
+#include "session_log.h"
+#include "boot_scheduler.h"
+#include "power_manager.h"
+#include "web_assets.h"
+#include <memory>
 
 // Global variables (defined in main.cpp)
 extern AsyncWebServer server;
@@ -15,22 +28,32 @@ extern DNSServer dnsServer;
 extern const char* ssid;
 extern const char* password;
 
-extern const char* serverIPs[2];
-extern int patternNumbers[62];
-extern int patternCount;
-extern int currentPatternIndex;
-extern bool patternsLoaded;
-
-extern bool is_rotating;
-extern float gyro_threshold;
-extern unsigned long last_movement_time;
-extern unsigned long last_watchdog_feed;
-extern bool mpu_initialized;
-extern Adafruit_MPU6050 mpu;
+extern SamplePipe samplePipe;
+extern PatternClient patternClient;
+extern PatternRefresher patternRefresher;
+extern PatternDispatcher patternDispatcher;
+extern PoiRegistry poiRegistry;
+extern PoiDiscovery poiDiscovery;
+extern MulticastSwitcher multicastSwitcher;
+extern ClockSync clockSync;
+extern AsyncWebSocket telemetrySocket;
+extern TelemetryStream telemetry;
+extern LittleFsStore flashStore;
+extern ConfigStore configStore;
+extern SessionLog sessionLog;
+extern Controller controller;
+extern WifiManager wifiManager;
+extern BootScheduler bootScheduler;
+extern Esp32PowerControl powerControl;
+extern PowerManager powerManager;
 
 extern void feedWatchdog();
 extern bool loadPatterns();
 extern void sendPatternRequest(int patternNumber);
+extern void requestCalibrationReset();
+extern void requestLatencyReset();
+extern void requestConfigSave();
+extern void requestGestureChange(int enabled, const uint8_t* actions);
 
 // DNS server IP (captive portal)
 const byte DNS_PORT = 53;
@@ -67,96 +90,82 @@ bool initLittleFS() {
   return true;
 }
 
-String readFile(const char* path) {
-  Serial.printf("Reading file: %s\n", path);
-  File file = LittleFS.open(path, "r");
-  if (!file) {
-    Serial.println("Failed to open file for reading");
-    return String();
-  }
-  String content;
-  while (file.available()) {
-    content += (char)file.read();
-  }
-  file.close();
-  return content;
-}
-
-bool writeFile(const char* path, const String& content) {
-  Serial.printf("Writing file: %s\n", path);
-  File file = LittleFS.open(path, "w");
-  if (!file) {
-    Serial.println("Failed to open file for writing");
-    return false;
-  }
-  if (file.print(content)) {
-    file.close();
-    Serial.println("File written successfully");
-    return true;
-  }
-  Serial.println("Write failed");
-  file.close();
-  return false;
-}
-
 // ============================================================================
 // WiFi Settings Management
 // ============================================================================
 
-bool loadWiFiSettings() {
-  String jsonStr = readFile("/settings.txt");
-  if (jsonStr.length() == 0) {
-    Serial.println("No WiFi settings found, using defaults");
-    resetWiFiSettings();
+#define LEGACY_SETTINGS_PATH "/settings.txt"
+
+// Settings as earlier firmware kept them, JSON in /settings.txt. Read once
+// on the first boot without /config.bin, then deleted.
+bool migrateJsonSettings(PoiConfig& config) {
+  char json[1024];
+  int len = flashStore.read(LEGACY_SETTINGS_PATH, (uint8_t*)json, sizeof(json));
+  if (len <= 0) {
     return false;
   }
 
   DynamicJsonDocument doc(1024);
-  DeserializationError error = deserializeJson(doc, jsonStr);
+  DeserializationError error = deserializeJson(doc, json, len);
   if (error) {
-    Serial.printf("Failed to parse WiFi settings: %s\n", error.c_str());
-    resetWiFiSettings();
+    Serial.printf("Failed to parse %s: %s\n", LEGACY_SETTINGS_PATH, error.c_str());
     return false;
   }
 
   JsonArray networks = doc["networks"];
-  if (networks.size() > 0) {
-    for (int i = 0; i < 3 && i < networks.size(); i++) {
-      JsonObject net = networks[i];
-      strncpy(wifiSettings.networks[i].ssid, net["ssid"] | "", sizeof(wifiSettings.networks[i].ssid) - 1);
-      strncpy(wifiSettings.networks[i].password, net["password"] | "", sizeof(wifiSettings.networks[i].password) - 1);
-      wifiSettings.networks[i].enabled = net["enabled"] | false;
-    }
+  for (int i = 0; i < CONFIG_NETWORKS && i < (int)networks.size(); i++) {
+    JsonObject net = networks[i];
+    WiFiConfig& wifi = config.wifi.networks[i];
+    strncpy(wifi.ssid, net["ssid"] | "", sizeof(wifi.ssid) - 1);
+    strncpy(wifi.password, net["password"] | "", sizeof(wifi.password) - 1);
+    wifi.enabled = net["enabled"] | false;
   }
-
-  wifiSettings.fallbackEnabled = doc["fallbackEnabled"] | true;
-  wifiSettings.currentNetwork = doc["currentNetwork"] | 0;
-
-  Serial.println("WiFi settings loaded from LittleFS");
+  config.wifi.fallbackEnabled = doc["fallbackEnabled"] | true;
+  config.wifi.currentNetwork = doc["currentNetwork"] | 0;
   return true;
 }
 
-void saveWiFiSettings() {
-  DynamicJsonDocument doc(1024);
-  JsonArray networks = doc.createNestedArray("networks");
-
-  for (int i = 0; i < 3; i++) {
-    JsonObject net = networks.createNestedObject();
-    net["ssid"] = wifiSettings.networks[i].ssid;
-    net["password"] = wifiSettings.networks[i].password;
-    net["enabled"] = wifiSettings.networks[i].enabled;
+// WiFi settings and detector parameters from /config.bin, migrating the
+// old JSON settings if that is all there is
+bool loadConfig() {
+  PoiConfig config;
+  resetConfig(config);
+  config.detector = controller.detectorSettings();
+
+  bool loaded = configStore.load(config);
+  if (!loaded && migrateJsonSettings(config)) {
+    if (configStore.save(config)) {
+      flashStore.remove(LEGACY_SETTINGS_PATH);
+      Serial.println("Settings migrated from " LEGACY_SETTINGS_PATH);
+    }
+    loaded = true;
   }
 
-  doc["fallbackEnabled"] = wifiSettings.fallbackEnabled;
-  doc["currentNetwork"] = wifiSettings.currentNetwork;
-
-  String jsonStr;
-  serializeJson(doc, jsonStr);
+  wifiSettings = config.wifi;
+  controller.calibration.restore(config.calibration);
+  controller.revolutions.restore(config.totals);
+  controller.configureGestures(config.gestures);
+  controller.configureDetector(config.detector);
+  if (!loaded) {
+    Serial.println("No config found, using defaults");
+    saveConfig();
+    return false;
+  }
+  Serial.println("Config loaded from LittleFS");
+  return true;
+}
 
-  if (writeFile("/settings.txt", jsonStr)) {
-    Serial.println("WiFi settings saved to LittleFS");
+void saveConfig() {
+  PoiConfig config;
+  config.wifi = wifiSettings;
+  config.detector = controller.detectorSettings();
+  config.calibration = controller.calibration.state();
+  config.totals = controller.revolutions.totals();
+  config.gestures = controller.gestureSettings();
+  if (configStore.save(config)) {
+    Serial.println("Config saved to LittleFS");
   } else {
-    Serial.println("Failed to save WiFi settings");
+    Serial.println("Failed to save config");
   }
 }
 
@@ -171,315 +180,172 @@ void resetWiFiSettings() {
   wifiSettings.fallbackEnabled = true;  // Use secrets.h fallback
   wifiSettings.currentNetwork = 0;
 
-  saveWiFiSettings();
+  requestConfigSave();
 }
 
 // ============================================================================
-// WiFi Connection Management
+// Captive Portal
 // ============================================================================
 
-bool connectToWiFi(const char* ssid, const char* password) {
-  if (strlen(ssid) == 0) {
-    return false;
-  }
+// Configuration AP for when no saved network can be joined. The station
+// side stays on, so WifiManager keeps trying in the background.
+void startCaptivePortal() {
+  WiFi.mode(WIFI_AP_STA);
+  WiFi.softAPConfig(apIP, apIP, netMask);
+  WiFi.softAP("SmartPoi-Accelerometer-Config");
+  dnsServer.start(DNS_PORT, "*", apIP);
+  captivePortalActive = true;
+  Serial.println("Captive portal started. Connect to SmartPoi-Accelerometer-Config AP");
+}
 
-  Serial.printf("Connecting to WiFi: %s\n", ssid);
-  WiFi.begin(ssid, password);
+void stopCaptivePortal() {
+  captivePortalActive = false;
+  dnsServer.stop();
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  Serial.println("Captive portal stopped");
+}
 
-  unsigned long startTime = millis();
-  while (WiFi.status() != WL_CONNECTED && millis() - startTime < 20000) {
-    delay(500);
-    Serial.print(".");
-    feedWatchdog();
-  }
+// ============================================================================
+// Sensor Task
+// ============================================================================
 
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.printf("\nConnected to WiFi! IP: %s\n", WiFi.localIP().toString().c_str());
-    #if defined(C_THREE)
-      WiFi.setTxPower(WIFI_POWER_8_5dBm);  // Adjust for ESP32 C3
-      Serial.println("WiFi power adjusted for ESP32 C3");
-    #endif
-    return true;
+// Moves gyro samples into samplePipe; loop() consumes them. The period is
+// powerManager's: 5 ms, stretched while the poi lie still.
+void sensorTask(void *parameter) {
+  Serial.println("Sensor task started");
+#ifdef MPU_INT_PIN
+  powerControl.attachWakePin(MPU_INT_PIN, xTaskGetCurrentTaskHandle());
+#endif
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    uint32_t waitMs = powerManager.sensorPoll();
+    if (powerManager.sampling()) {
+      samplePipe.pump();
+      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(waitMs));
+    } else {
+      // Gyro off: until the motion interrupt, or the next look at its status
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+      lastWake = xTaskGetTickCount();
+    }
   }
-
-  Serial.println("\nWiFi connection failed");
-  return false;
 }
 
-bool initWiFi() {
-  // First try saved networks in order
-  for (int i = 0; i < 3; i++) {
-    if (wifiSettings.networks[i].enabled && strlen(wifiSettings.networks[i].ssid) > 0) {
-      if (connectToWiFi(wifiSettings.networks[i].ssid, wifiSettings.networks[i].password)) {
-        wifiSettings.currentNetwork = i;
-        return true;
-      }
-    }
-  }
+// ============================================================================
+// Pattern Refresh Task
+// ============================================================================
+
+#define PATTERN_REFRESH_POLL_MS 1000
 
-  // Fallback to secrets.h if enabled
-  if (wifiSettings.fallbackEnabled) {
-    if (connectToWiFi(ssid, password)) {
-      wifiSettings.currentNetwork = 3; // Special index for fallback
-      return true;
+// Fetches the listing once WiFi first comes up, then whenever patternRefresher says a
+// refresh is due and loop() is not dispatching. Until the first fetch
+// finishes loop() runs on the table restored from LittleFS, so a slow or
+// missing poi never delays the first pattern change.
+void patternRefreshTask(void *parameter) {
+  while (!wifiManager.connected()) {
+    vTaskDelay(pdMS_TO_TICKS(PATTERN_REFRESH_POLL_MS));
+  }
+  loadPatterns();
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(PATTERN_REFRESH_POLL_MS));
+    if (wifiManager.connected()) {
+      patternRefresher.poll();
     }
   }
+}
 
-  // All attempts failed
-  return false;
+// ============================================================================
+// Session Log Task
+// ============================================================================
+
+#define SESSION_LOG_POLL_MS 1000
+
+// Appends queued session log records to flash. A flash write can stall
+// for tens of milliseconds; here that only delays this task, and the
+// sensor task above it keeps sampling.
+void sessionLogTask(void *parameter) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(SESSION_LOG_POLL_MS));
+    sessionLog.flush();
+  }
 }
 
 // ============================================================================
 // ElegantOTA Task (combines web server and OTA)
 // ============================================================================
 
-// HTML for WiFi configuration page
-String getWiFiConfigHTML() {
-  String html = R"rawliteral(
-<!DOCTYPE html>
-<html lang="en">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>ESP32 WiFi Configuration</title>
-    <style>
-        body {
-            font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, Oxygen, Ubuntu, sans-serif;
-            max-width: 600px;
-            margin: 0 auto;
-            padding: 20px;
-            background: #f5f5f5;
-        }
-        .card {
-            background: white;
-            border-radius: 10px;
-            padding: 25px;
-            margin-bottom: 20px;
-            box-shadow: 0 2px 10px rgba(0,0,0,0.1);
-        }
-        h1 {
-            color: #333;
-            margin-bottom: 25px;
-            text-align: center;
-        }
-        .form-group {
-            margin-bottom: 20px;
-        }
-        label {
-            display: block;
-            margin-bottom: 5px;
-            font-weight: 600;
-            color: #555;
-        }
-        input[type="text"], input[type="password"] {
-            width: 100%;
-            padding: 12px;
-            border: 1px solid #ddd;
-            border-radius: 6px;
-            font-size: 16px;
-            box-sizing: border-box;
-        }
-        .checkbox-group {
-            display: flex;
-            align-items: center;
-            margin-bottom: 15px;
-        }
-        .checkbox-group input {
-            margin-right: 10px;
-        }
-        .button-group {
-            display: flex;
-            gap: 10px;
-            margin-top: 25px;
-        }
-        button {
-            flex: 1;
-            padding: 14px;
-            border: none;
-            border-radius: 6px;
-            font-size: 16px;
-            font-weight: 600;
-            cursor: pointer;
-            transition: background 0.2s;
-        }
-        .btn-primary {
-            background: #007bff;
-            color: white;
-        }
-        .btn-primary:hover {
-            background: #0056b3;
-        }
-        .btn-secondary {
-            background: #6c757d;
-            color: white;
-        }
-        .btn-secondary:hover {
-            background: #545b62;
-        }
-        .status {
-            padding: 15px;
-            border-radius: 6px;
-            margin-bottom: 20px;
-            display: none;
-        }
-        .status.success {
-            background: #d4edda;
-            color: #155724;
-            display: block;
-        }
-        .status.error {
-            background: #f8d7da;
-            color: #721c24;
-            display: block;
-        }
-        .network-group {
-            margin-bottom: 30px;
-            padding: 20px;
-            background: #f8f9fa;
-            border-radius: 6px;
-        }
-        .network-group h3 {
-            margin-top: 0;
-            color: #333;
-        }
-    </style>
-</head>
-<body>
-    <div class="card">
-        <h1>ESP32 WiFi Configuration</h1>
-        <div id="status" class="status"></div>
-        <form id="wifiForm">
-            <div class="form-group">
-                <label>Fallback WiFi (from secrets.h)</label>
-                <div class="checkbox-group">
-                    <input type="checkbox" id="fallbackEnabled" name="fallbackEnabled" checked>
-                    <label for="fallbackEnabled">Use fallback WiFi when no saved networks work</label>
-                </div>
-            </div>
-            <div id="networkConfigs"></div>
-            <div class="button-group">
-                <button type="button" class="btn-secondary" onclick="resetSettings()">Reset</button>
-                <button type="submit" class="btn-primary">Save & Reconnect</button>
-            </div>
-        </form>
-    </div>
-    <script>
-        const networks = [
-            {ssid: "", password: "", enabled: false},
-            {ssid: "", password: "", enabled: false},
-            {ssid: "", password: "", enabled: false}
-        ];
-        
-        function showStatus(message, isError = false) {
-            const statusEl = document.getElementById('status');
-            statusEl.textContent = message;
-            statusEl.className = 'status ' + (isError ? 'error' : 'success');
-        }
-        
-        function renderNetworkConfigs() {
-            const container = document.getElementById('networkConfigs');
-            container.innerHTML = '';
-            networks.forEach((network, index) => {
-                container.innerHTML += `
-                    <div class="network-group">
-                        <h3>WiFi Network ${index + 1}</h3>
-                        <div class="form-group">
-                            <div class="checkbox-group">
-                                <input type="checkbox" id="enabled${index}" ${network.enabled ? 'checked' : ''}>
-                                <label for="enabled${index}">Enable this network</label>
-                            </div>
-                        </div>
-                        <div class="form-group">
-                            <label for="ssid${index}">SSID</label>
-                            <input type="text" id="ssid${index}" value="${network.ssid}" placeholder="WiFi network name">
-                        </div>
-                        <div class="form-group">
-                            <label for="password${index}">Password</label>
-                            <input type="password" id="password${index}" value="${network.password}" placeholder="WiFi password">
-                        </div>
-                    </div>
-                `;
-            });
-        }
-        
-        function loadCurrentSettings() {
-            fetch('/info')
-                .then(r => r.json())
-                .then(data => {
-                    if (data.networks) {
-                        networks.forEach((_, i) => {
-                            if (data.networks[i]) {
-                                networks[i] = data.networks[i];
-                            }
-                        });
-                    }
-                    if (data.fallbackEnabled !== undefined) {
-                        document.getElementById('fallbackEnabled').checked = data.fallbackEnabled;
-                    }
-                    renderNetworkConfigs();
-                })
-                .catch(e => {
-                    console.error('Error:', e);
-                    renderNetworkConfigs();
-                });
-        }
-        
-        function resetSettings() {
-            if (confirm('Reset all WiFi settings to defaults?')) {
-                fetch('/reset', { method: 'POST' })
-                    .then(r => r.json())
-                    .then(data => {
-                        if (data.success) {
-                            loadCurrentSettings();
-                            showStatus('Settings reset to defaults');
-                        } else {
-                            showStatus('Failed to reset settings', true);
-                        }
-                    })
-                    .catch(e => {
-                        console.error('Error:', e);
-                        showStatus('Failed to reset settings', true);
-                    });
-            }
-        }
-        
-        document.getElementById('wifiForm').addEventListener('submit', function(e) {
-            e.preventDefault();
-            const formData = new FormData();
-            formData.append('fallbackEnabled', document.getElementById('fallbackEnabled').checked ? '1' : '0');
-            networks.forEach((_, i) => {
-                const enabled = document.getElementById('enabled' + i).checked;
-                const ssid = document.getElementById('ssid' + i).value;
-                const password = document.getElementById('password' + i).value;
-                formData.append('enabled' + i, enabled ? '1' : '0');
-                formData.append('ssid' + i, ssid);
-                formData.append('password' + i, password);
-            });
-            showStatus('Saving settings...');
-            fetch('/save', {
-                method: 'POST',
-                body: formData
-            })
-            .then(r => r.json())
-            .then(data => {
-                if (data.success) {
-                    showStatus('Settings saved! Reconnecting...');
-                    setTimeout(() => window.location.reload(), 2000);
-                } else {
-                    showStatus('Failed to save: ' + data.message, true);
-                }
-            })
-            .catch(e => {
-                console.error('Error:', e);
-                showStatus('Failed to save settings', true);
-            });
-        });
-        loadCurrentSettings();
-    </script>
-</body>
-</html>
-)rawliteral";
-  return html;
+// State of one /log download between chunks
+struct LogDownload {
+  LogDownload(uint16_t session, uint32_t from, uint32_t to, bool csv)
+    : reader(flashStore, session, from, to), csv(csv), pending(false) {}
+
+  SessionLogReader reader;
+  bool csv;
+  bool pending;  // record did not fit in the last chunk
+  LogRecord record;
+};
+
+// Fill one chunk of a /log response; 0 ends it
+size_t fillLogChunk(LogDownload& download, uint8_t* buffer, size_t maxLen) {
+  size_t used = 0;
+  for (;;) {
+    if (!download.pending && !download.reader.next(download.record)) {
+      break;
+    }
+    download.pending = true;
+    if (download.csv) {
+      char line[64];
+      size_t len = formatLogRecordCsv(line, sizeof(line), download.record);
+      if (used + len > maxLen) break;
+      memcpy(buffer + used, line, len);
+      used += len;
+    } else {
+      if (used + SESSION_LOG_RECORD_SIZE > maxLen) break;
+      used += encodeLogRecord(buffer + used, download.record);
+    }
+    download.pending = false;
+  }
+  return used;
+}
+
+// Serialize a latency histogram for /latency
+void addHistogram(JsonObject obj, const LatencyHistogram& h) {
+  obj["count"] = h.count();
+  obj["min"] = h.min();
+  obj["mean"] = h.mean();
+  obj["p50"] = h.percentile(50);
+  obj["p90"] = h.percentile(90);
+  obj["p99"] = h.percentile(99);
+  obj["max"] = h.max();
+  JsonArray buckets = obj.createNestedArray("buckets");
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    buckets.add(h.bucket(i));
+  }
+}
+
+// Send a page built into the firmware (see web_assets.h) straight from
+// flash, gzipped. Browsers keep it and revalidate with If-None-Match,
+// which costs a 304 and no body until the firmware changes the page.
+bool sendWebAsset(AsyncWebServerRequest *request, const char* path) {
+  for (size_t i = 0; i < webAssetCount; i++) {
+    const WebAsset& asset = webAssets[i];
+    if (strcmp(asset.path, path) != 0) {
+      continue;
+    }
+    AsyncWebServerResponse *response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag) {
+      response = request->beginResponse(304);
+    } else {
+      response = request->beginResponse(200, asset.contentType, asset.gzipped, asset.length);
+      response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    return true;
+  }
+  request->send(404, "text/plain", "Not found");
+  return false;
 }
 
 // ElegantOTA callbacks
@@ -509,36 +375,15 @@ void elegantOTATask(void *parameter) {
   Serial.println("ElegantOTA task started");
   
   // Setup web server routes
-  // Serve index.html (status page) at root
+  // Serve index.html (status page) at root, or the WiFi config page
+  // when in captive portal mode
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    if (captivePortalActive) {
-      // When in captive portal mode, serve WiFi config page
-      if (LittleFS.exists("/wifi_config.html")) {
-        request->send(LittleFS, "/wifi_config.html", "text/html");
-      } else {
-        request->send(200, "text/html", getWiFiConfigHTML());
-      }
-    } else {
-      // Normal mode: serve status page
-      if (LittleFS.exists("/index.html")) {
-        request->send(LittleFS, "/index.html", "text/html");
-      } else {
-        // Fallback to simple status page
-        String html = "<html><body><h1>ESP32 Accelerometer</h1><p>WiFi: ";
-        html += WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected";
-        html += "</p><p><a href='/config'>WiFi Config</a> | <a href='/update'>OTA Update</a></p></body></html>";
-        request->send(200, "text/html", html);
-      }
-    }
+    sendWebAsset(request, captivePortalActive ? "/wifi_config.html" : "/index.html");
   });
   
   // Serve WiFi configuration page
   server.on("/config", HTTP_GET, [](AsyncWebServerRequest *request) {
-    if (LittleFS.exists("/wifi_config.html")) {
-      request->send(LittleFS, "/wifi_config.html", "text/html");
-    } else {
-      request->send(200, "text/html", getWiFiConfigHTML());
-    }
+    sendWebAsset(request, "/wifi_config.html");
   });
   
   // Captive portal redirects for various devices
@@ -564,16 +409,213 @@ void elegantOTATask(void *parameter) {
     }
     doc["fallbackEnabled"] = wifiSettings.fallbackEnabled;
     doc["currentNetwork"] = wifiSettings.currentNetwork;
+    doc["reuseLease"] = wifiSettings.reuseLease;
     doc["wifiStatus"] = WiFi.status() == WL_CONNECTED ? "connected" : "disconnected";
+    doc["wifiState"] = WifiManager::stateName(wifiManager.currentState());
+    doc["wifiConnects"] = wifiManager.connectCount();
+    doc["wifiDisconnects"] = wifiManager.disconnectCount();
     doc["ipAddress"] = WiFi.localIP().toString();
     doc["macAddress"] = WiFi.macAddress();
     doc["freeHeap"] = ESP.getFreeHeap();
     doc["chipModel"] = ESP.getChipModel();
+    doc["sensorSamples"] = samplePipe.sampleCount();
+    doc["sensorOverruns"] = samplePipe.overrunCount();
+    doc["sensorOverflows"] = samplePipe.overflowCount();
+    doc["sensorBacklog"] = samplePipe.backlog();
+    doc["patterns"] = patternClient.count();
+    doc["patternListHash"] = patternClient.listingHash();
+    doc["patternRefreshes"] = patternClient.refreshCount();
+    doc["patternChanges"] = patternClient.changeCount();
+    doc["poiConnects"] = patternDispatcher.connectionPool().connectCount();
+    doc["poiReuses"] = patternDispatcher.connectionPool().reuseCount();
+    doc["telemetryFrames"] = telemetry.frameCount();
+    doc["telemetryDropped"] = telemetry.droppedCount();
+    doc["logSession"] = sessionLog.session();
+    doc["logRecords"] = sessionLog.recordCount();
+    doc["logDropped"] = sessionLog.droppedCount();
+    doc["powerLevel"] = PowerManager::levelName(powerManager.level());
+    doc["powerActiveMs"] = powerManager.timeAt(POWER_ACTIVE);
+    doc["powerIdleMs"] = powerManager.timeAt(POWER_IDLE);
+    doc["powerSleepMs"] = powerManager.timeAt(POWER_SLEEP);
+    doc["powerWakes"] = powerManager.wakeCount();
     String jsonStr;
     serializeJson(doc, jsonStr);
     request->send(200, "application/json", jsonStr);
   });
   
+  // Stall-to-switch latency histograms (milliseconds)
+  server.on("/latency", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const LatencyTracker& latency = controller.latency;
+    DynamicJsonDocument doc(4096);
+    JsonArray bounds = doc.createNestedArray("bucketBounds");
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+      bounds.add(LatencyHistogram::bucketBound(i));
+    }
+    addHistogram(doc.createNestedObject("stopToConfirm"), latency.stopToConfirm);
+    addHistogram(doc.createNestedObject("confirmToRequest"), latency.confirmToRequest);
+    JsonArray servers = doc.createNestedArray("servers");
+    for (int i = 0; i < latency.servers(); i++) {
+      JsonObject srv = servers.createNestedObject();
+      srv["host"] = patternDispatcher.server(i);
+      addHistogram(srv.createNestedObject("requestToResponse"), latency.requestToResponse[i]);
+      addHistogram(srv.createNestedObject("stopToResponse"), latency.stopToResponse[i]);
+    }
+    doc["failures"] = latency.failureCount();
+    String jsonStr;
+    serializeJson(doc, jsonStr);
+    request->send(200, "application/json", jsonStr);
+  });
+
+  server.on("/latency/reset", HTTP_POST, [](AsyncWebServerRequest *request) {
+    requestLatencyReset();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+
+  // Learned gyro bias and spin rate, and the thresholds the detector runs on
+  server.on("/calibration", HTTP_GET, [](AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(512);
+    const CalibrationState& learned = controller.calibration.state();
+    const StallDetectorConfig& active = controller.detector.settings();
+    doc["enabled"] = controller.calibration.enabled();
+    doc["ready"] = controller.calibration.ready();
+    doc["biasDps"] = controller.calibration.biasDps();
+    doc["noiseDps"] = controller.calibration.noiseDps();
+    doc["spinRateDps"] = controller.calibration.spinRateDps();
+    doc["spins"] = learned.spins;
+    doc["rests"] = learned.rests;
+    doc["startThreshold"] = active.gyroThreshold;
+    doc["stopThreshold"] = active.stopThreshold;
+    doc["configuredStartThreshold"] = controller.detectorSettings().gyroThreshold;
+    doc["configuredStopThreshold"] = controller.detectorSettings().stopThreshold;
+    String jsonStr;
+    serializeJson(doc, jsonStr);
+    request->send(200, "application/json", jsonStr);
+  });
+
+  // Forget what was learned, e.g. after handing the poi to another performer
+  server.on("/calibration/reset", HTTP_POST, [](AsyncWebServerRequest *request) {
+    requestCalibrationReset();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+
+  // Rotation count and speed: RPM now and smoothed over revolutions, this
+  // session and since the totals were first saved
+  server.on("/rpm", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const RevolutionCounter& counter = controller.revolutions;
+    DynamicJsonDocument doc(256);
+    doc["rpm"] = counter.rpmTenths() / 10.0f;
+    doc["smoothedRpm"] = counter.smoothedRpmTenths() / 10.0f;
+    doc["periodMs"] = counter.lastPeriodMs();
+    doc["revolutions"] = counter.revolutions();
+    doc["spinMs"] = counter.spinTimeMs();
+    doc["totalRevolutions"] = counter.totals().revolutions;
+    doc["totalSpinMs"] = counter.totals().spinMs;
+    String jsonStr;
+    serializeJson(doc, jsonStr);
+    request->send(200, "application/json", jsonStr);
+  });
+
+  // Gestures: whether they are on, the action for each and how often
+  // each was recognized
+  server.on("/gestures", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const GestureConfig& settings = controller.gestureSettings();
+    DynamicJsonDocument doc(512);
+    doc["enabled"] = settings.enabled;
+    for (int i = GESTURE_NONE + 1; i < GESTURES; i++) {
+      JsonObject gesture = doc.createNestedObject(GestureEngine::name((Gesture)i));
+      gesture["action"] = GestureEngine::actionName((GestureAction)settings.actions[i]);
+      gesture["recognized"] = controller.gestures.recognized((Gesture)i);
+    }
+    String jsonStr;
+    serializeJson(doc, jsonStr);
+    request->send(200, "application/json", jsonStr);
+  });
+
+  // enabled=0|1 and <gesture>=none|previous|first|hold, e.g. shake=hold.
+  // Only what is given changes; loop() applies and saves it.
+  server.on("/gestures", HTTP_POST, [](AsyncWebServerRequest *request) {
+    int enabled = -1;
+    if (request->hasParam("enabled", true)) {
+      enabled = request->getParam("enabled", true)->value() == "1";
+    }
+    uint8_t actions[GESTURES];
+    for (int i = 0; i < GESTURES; i++) {
+      actions[i] = GESTURE_ACTIONS;  // unchanged
+    }
+    for (int i = GESTURE_NONE + 1; i < GESTURES; i++) {
+      const char* name = GestureEngine::name((Gesture)i);
+      if (!request->hasParam(name, true)) {
+        continue;
+      }
+      GestureAction action = GestureEngine::actionFromName(request->getParam(name, true)->value().c_str());
+      if (action == GESTURE_ACTIONS) {
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"Unknown action\"}");
+        return;
+      }
+      actions[i] = action;
+    }
+    requestGestureChange(enabled, actions);
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+
+  // Start-up stages: when each one started and finished, in ms since power on
+  server.on("/boot", HTTP_GET, [](AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(2048);
+    doc["finished"] = bootScheduler.finished();
+    doc["finishedMs"] = bootScheduler.finishedAt();
+    JsonArray stages = doc.createNestedArray("stages");
+    for (int i = 0; i < bootScheduler.count(); i++) {
+      JsonObject stage = stages.createNestedObject();
+      stage["name"] = bootScheduler.name(i);
+      stage["state"] = BootScheduler::stateName(bootScheduler.state(i));
+      if (bootScheduler.attempts(i) > 0) {
+        stage["startMs"] = bootScheduler.startedAt(i);
+      }
+      if (bootScheduler.state(i) == BOOT_DONE || bootScheduler.state(i) == BOOT_FAILED) {
+        stage["endMs"] = bootScheduler.endedAt(i);
+      }
+      stage["attempts"] = bootScheduler.attempts(i);
+      stage["longestStepMs"] = bootScheduler.longestStep(i);
+    }
+    String jsonStr;
+    serializeJson(doc, jsonStr);
+    request->send(200, "application/json", jsonStr);
+  });
+
+  // Poi registry: configured and discovered poi
+  server.on("/poi", HTTP_GET, [](AsyncWebServerRequest *request) {
+    DynamicJsonDocument doc(2048);
+    uint32_t now = millis();
+    doc["probes"] = poiDiscovery.probeCount();
+    doc["replies"] = poiDiscovery.replyCount();
+    doc["switchCommands"] = multicastSwitcher.commandCount();
+    doc["switchDatagrams"] = multicastSwitcher.datagramCount();
+    doc["switchLeadMs"] = multicastSwitcher.leadTime();
+    doc["syncRequests"] = clockSync.requestCount();
+    doc["syncReplies"] = clockSync.replyCount();
+    JsonArray list = doc.createNestedArray("poi");
+    for (int i = 0; i < poiRegistry.count(); i++) {
+      JsonObject poi = list.createNestedObject();
+      poi["host"] = poiRegistry.host(i);
+      poi["port"] = poiRegistry.port(i);
+      poi["online"] = poiRegistry.online(i);
+      poi["discovered"] = poiRegistry.discovered(i);
+      poi["udpSwitch"] = (poiRegistry.features(i) & POI_FEATURE_UDP_SWITCH) != 0;
+      // Offset is poi clock minus ours; jitter bounds how far it may be off
+      if (clockSync.synced(i)) {
+        poi["clockOffsetMs"] = clockSync.offset(i);
+        poi["roundTripMs"] = clockSync.roundTrip(i);
+        poi["clockJitterMs"] = clockSync.jitter(i);
+      }
+      if (poiRegistry.discovered(i)) {
+        poi["lastSeenMs"] = now - poiRegistry.lastSeen(i);
+      }
+    }
+    String jsonStr;
+    serializeJson(doc, jsonStr);
+    request->send(200, "application/json", jsonStr);
+  });
+
   // Save WiFi settings endpoint
   server.on("/save", HTTP_POST, [](AsyncWebServerRequest *request) {
     // Parse form data
@@ -597,7 +639,12 @@ void elegantOTATask(void *parameter) {
     if (request->hasParam("fallbackEnabled", true)) {
       wifiSettings.fallbackEnabled = request->getParam("fallbackEnabled", true)->value() == "1";
     }
-    saveWiFiSettings();
+    if (request->hasParam("reuseLease", true)) {
+      wifiSettings.reuseLease = request->getParam("reuseLease", true)->value() == "1";
+    }
+    // Credentials may have changed: scan again rather than try the cached access point
+    wifiSettings.last.network = CONFIG_NO_NETWORK;
+    requestConfigSave();
     
     DynamicJsonDocument doc(256);
     doc["success"] = true;
@@ -606,12 +653,10 @@ void elegantOTATask(void *parameter) {
     serializeJson(doc, jsonStr);
     request->send(200, "application/json", jsonStr);
     
-    // If WiFi was previously disconnected, try to reconnect
-    if (WiFi.status() != WL_CONNECTED) {
+    // If WiFi is down, start over with the new settings; loop() does the work
+    if (!wifiManager.connected()) {
       Serial.println("Attempting to reconnect with new settings...");
-      if (initWiFi()) {
-        Serial.println("Reconnected successfully!");
-      }
+      wifiManager.restart();
     }
   });
   
@@ -626,6 +671,28 @@ void elegantOTATask(void *parameter) {
     request->send(200, "application/json", jsonStr);
   });
   
+  // Session log download, oldest first, streamed from flash in chunks:
+  // /log?session=<n|all>&from=<ms>&to=<ms>&format=<csv|bin>
+  // Defaults to the current session as CSV.
+  server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request) {
+    uint16_t session = sessionLog.session();
+    if (request->hasArg("session")) {
+      String arg = request->arg("session");
+      session = arg == "all" ? SESSION_LOG_ALL_SESSIONS : (uint16_t)arg.toInt();
+    }
+    uint32_t from = request->hasArg("from") ? strtoul(request->arg("from").c_str(), NULL, 10) : 0;
+    uint32_t to = request->hasArg("to") ? strtoul(request->arg("to").c_str(), NULL, 10) : UINT32_MAX;
+    bool csv = !request->hasArg("format") || request->arg("format") != "bin";
+
+    std::shared_ptr<LogDownload> download = std::make_shared<LogDownload>(session, from, to, csv);
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+      csv ? "text/csv" : "application/octet-stream",
+      [download](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return fillLogChunk(*download, buffer, maxLen);
+      });
+    request->send(response);
+  });
+
   // Pattern control endpoints (original functionality)
   server.on("/list", HTTP_GET, [](AsyncWebServerRequest *request) {
     // Return pattern list if needed
@@ -655,6 +722,9 @@ void elegantOTATask(void *parameter) {
     }
   });
   
+  // Live telemetry, see TelemetryStream for the frame format
+  server.addHandler(&telemetrySocket);
+
   // Start ElegantOTA
   ElegantOTA.begin(&server);
   ElegantOTA.onStart(onOTAStart);
@@ -667,6 +737,7 @@ void elegantOTATask(void *parameter) {
   // Main task loop
   for (;;) {
     ElegantOTA.loop();
+    telemetrySocket.cleanupClients();
     if (captivePortalActive) {
       dnsServer.processNextRequest();
     }